@@ -0,0 +1,611 @@
+//
+// Created by alexey on 17.10.2026.
+//
+
+#include "CompactTree.h"
+#include "TreeParser.h"
+#include "TreeWriter.h"
+
+struct compactTask_t {
+    node_t *node;
+    uint32_t parent;
+    DIRECTION dir;
+};
+
+/**
+ * Function that grows compact tree storage
+ * @param tree Pointer to compactTree_t
+ * @param capacity New capacity
+ */
+
+static void compactReserve(compactTree_t *tree, size_t capacity) {
+    assert(capacity < NO_NODE);
+
+    tree->left = (uint32_t *) countedRealloc(tree->left, capacity * sizeof(uint32_t));
+    tree->right = (uint32_t *) countedRealloc(tree->right, capacity * sizeof(uint32_t));
+    tree->parent = (uint32_t *) countedRealloc(tree->parent, capacity * sizeof(uint32_t));
+    tree->values = (void **) countedRealloc(tree->values, capacity * sizeof(void *));
+    assert(tree->left && tree->right && tree->parent && tree->values);
+
+    tree->capacity = capacity;
+}
+
+/**
+ * Function that takes node slot from the free list or from the end of storage
+ * @param tree Pointer to compactTree_t
+ * @param parent Parent node index
+ * @param value Pointer to value
+ * @return New node index
+ */
+
+static uint32_t compactMakeNode(compactTree_t *tree, uint32_t parent, void *value) {
+    uint32_t node = tree->freeList;
+
+    if (node != NO_NODE) {
+        tree->freeList = tree->left[node];
+    } else {
+        if (tree->count == tree->capacity)
+            compactReserve(tree, tree->capacity ? tree->capacity * 2 : POOL_FIRST_CHUNK);
+        node = (uint32_t) tree->count++;
+    }
+
+    tree->left[node] = NO_NODE;
+    tree->right[node] = NO_NODE;
+    tree->parent[node] = parent;
+    tree->values[node] = value;
+    return node;
+}
+
+/**
+ * Compact tree "constructor"
+ * @param headValue Value for tree head
+ * @param capacity Number of nodes to reserve storage for
+ * @return Pointer to compactTree_t
+ */
+
+compactTree_t *makeCompactTree(void *headValue, size_t capacity) {
+    auto *tree = (compactTree_t *) countedCalloc(1, sizeof(compactTree_t));
+    tree->freeList = NO_NODE;
+
+    if (capacity)
+        compactReserve(tree, capacity);
+
+    tree->head = compactMakeNode(tree, NO_NODE, headValue);
+    return tree;
+}
+
+/**
+ * Compact tree "destructor"
+ * @param tree Pointer to compactTree_t
+ */
+
+void deleteCompactTree(compactTree_t *tree) {
+    assert(tree);
+
+    countedFree(tree->left);
+    countedFree(tree->right);
+    countedFree(tree->parent);
+    countedFree(tree->values);
+    countedFree(tree);
+}
+
+/**
+ * Function that adds left node. Previous left subtree is deleted
+ * @param tree Pointer to compactTree_t
+ * @param node Target node index
+ * @param value Pointer to value for new node
+ * @return New node index
+ */
+
+uint32_t compactAddLeftNode(compactTree_t *tree, uint32_t node, void *value) {
+    assert(tree);
+    assert(node < tree->count);
+
+    if (tree->left[node] != NO_NODE)
+        compactDeleteNode(tree, tree->left[node]);
+
+    uint32_t newNode = compactMakeNode(tree, node, value);
+    tree->left[node] = newNode;
+    tree->size++;
+    return newNode;
+}
+
+/**
+ * Function that adds right node. Previous right subtree is deleted
+ * @param tree Pointer to compactTree_t
+ * @param node Target node index
+ * @param value Pointer to value for new node
+ * @return New node index
+ */
+
+uint32_t compactAddRightNode(compactTree_t *tree, uint32_t node, void *value) {
+    assert(tree);
+    assert(node < tree->count);
+
+    if (tree->right[node] != NO_NODE)
+        compactDeleteNode(tree, tree->right[node]);
+
+    uint32_t newNode = compactMakeNode(tree, node, value);
+    tree->right[node] = newNode;
+    tree->size++;
+    return newNode;
+}
+
+/**
+ * Function that finds next node of the subtree in preorder using parent links
+ * @param tree Pointer to compactTree_t
+ * @param root Subtree root index
+ * @param node Current node index
+ * @return Next node index or NO_NODE if node was the last one
+ */
+
+uint32_t compactPreorderNext(const compactTree_t *tree, uint32_t root, uint32_t node) {
+    if (tree->left[node] != NO_NODE)
+        return tree->left[node];
+
+    if (tree->right[node] != NO_NODE)
+        return tree->right[node];
+
+    while (node != root) {
+        uint32_t parent = tree->parent[node];
+        if (tree->left[parent] == node && tree->right[parent] != NO_NODE)
+            return tree->right[parent];
+        node = parent;
+    }
+
+    return NO_NODE;
+}
+
+/**
+ * Function that copies subtree into the tree and deletes the subtree
+ * @param tree Pointer to compactTree_t
+ * @param parent Target node index
+ * @param subtree Pointer to compactTree_t to attach
+ * @return Index of the attached subtree head
+ */
+
+static uint32_t compactAdopt(compactTree_t *tree, uint32_t parent, compactTree_t *subtree) {
+    assert(subtree != tree);
+
+    if (tree->capacity < tree->count + subtree->count)
+        compactReserve(tree, tree->count + subtree->count);
+
+    auto *remap = (uint32_t *) countedCalloc(subtree->count, sizeof(uint32_t));
+    uint32_t head = NO_NODE;
+
+    // Preorder visits parent before children, so parent is always remapped already
+    for (uint32_t node = subtree->head; node != NO_NODE; node = compactPreorderNext(subtree, subtree->head, node)) {
+        uint32_t oldParent = subtree->parent[node];
+        uint32_t newParent = node == subtree->head ? parent : remap[oldParent];
+        uint32_t newNode = compactMakeNode(tree, newParent, subtree->values[node]);
+
+        if (node == subtree->head)
+            head = newNode;
+        else if (subtree->left[oldParent] == node)
+            tree->left[newParent] = newNode;
+        else
+            tree->right[newParent] = newNode;
+
+        remap[node] = newNode;
+    }
+
+    countedFree(remap);
+    tree->size += subtree->size + 1;
+    deleteCompactTree(subtree);
+    return head;
+}
+
+/**
+ * Function that adds subtree to the left. Subtree is copied and deleted, previous left subtree is deleted
+ * @param tree Pointer to compactTree_t
+ * @param node Target node index
+ * @param subtree Pointer to compactTree_t
+ */
+
+void compactAddLeftSubtree(compactTree_t *tree, uint32_t node, compactTree_t *subtree) {
+    assert(tree);
+    assert(subtree);
+    assert(node < tree->count);
+
+    if (tree->left[node] != NO_NODE)
+        compactDeleteNode(tree, tree->left[node]);
+
+    uint32_t head = compactAdopt(tree, node, subtree);
+    tree->left[node] = head;
+}
+
+/**
+ * Function that adds subtree to the right. Subtree is copied and deleted, previous right subtree is deleted
+ * @param tree Pointer to compactTree_t
+ * @param node Target node index
+ * @param subtree Pointer to compactTree_t
+ */
+
+void compactAddRightSubtree(compactTree_t *tree, uint32_t node, compactTree_t *subtree) {
+    assert(tree);
+    assert(subtree);
+    assert(node < tree->count);
+
+    if (tree->right[node] != NO_NODE)
+        compactDeleteNode(tree, tree->right[node]);
+
+    uint32_t head = compactAdopt(tree, node, subtree);
+    tree->right[node] = head;
+}
+
+/**
+ * Function that deletes node AND ALL THE SUBNODES. Node is detached from its parent, slots are recycled
+ * @param tree Pointer to compactTree_t
+ * @param node Node index, must not be the head
+ */
+
+void compactDeleteNode(compactTree_t *tree, uint32_t node) {
+    assert(tree);
+    assert(node < tree->count);
+    assert(node != tree->head);
+
+    uint32_t parent = tree->parent[node];
+    if (tree->left[parent] == node)
+        tree->left[parent] = NO_NODE;
+    else
+        tree->right[parent] = NO_NODE;
+
+    uint32_t current = node;
+    while (true) {
+        if (tree->left[current] != NO_NODE) {
+            current = tree->left[current];
+            continue;
+        }
+
+        if (tree->right[current] != NO_NODE) {
+            current = tree->right[current];
+            continue;
+        }
+
+        uint32_t up = tree->parent[current];
+        if (current != node) {
+            if (tree->left[up] == current)
+                tree->left[up] = NO_NODE;
+            else
+                tree->right[up] = NO_NODE;
+        }
+
+        tree->left[current] = tree->freeList;
+        tree->parent[current] = NO_NODE;
+        tree->values[current] = nullptr;
+        tree->freeList = current;
+        tree->size--;
+
+        if (current == node)
+            return;
+
+        current = up;
+    }
+}
+
+/**
+ * Function that converts tree_t into compact tree with nodes laid out in preorder
+ * @param tree Pointer to tree_t
+ * @return Pointer to compactTree_t
+ */
+
+compactTree_t *compactFromTree(tree_t *tree) {
+    assert(tree);
+
+    treeExpandAll(tree);
+
+    compactTree_t *compact = makeCompactTree(tree->head->value, tree->size + 1);
+
+    size_t capacity = 64;
+    size_t size = 0;
+    auto *tasks = (compactTask_t *) countedCalloc(capacity, sizeof(compactTask_t));
+
+    if (tree->head->right)
+        tasks[size++] = {tree->head->right, compact->head, RIGHT};
+    if (tree->head->left)
+        tasks[size++] = {tree->head->left, compact->head, LEFT};
+
+    while (size) {
+        compactTask_t task = tasks[--size];
+        uint32_t node = task.dir == LEFT ? compactAddLeftNode(compact, task.parent, task.node->value)
+                                         : compactAddRightNode(compact, task.parent, task.node->value);
+
+        if (size + 2 > capacity) {
+            capacity *= 2;
+            tasks = (compactTask_t *) countedRealloc(tasks, capacity * sizeof(compactTask_t));
+            assert(tasks);
+        }
+
+        if (task.node->right)
+            tasks[size++] = {task.node->right, node, RIGHT};
+        if (task.node->left)
+            tasks[size++] = {task.node->left, node, LEFT};
+    }
+
+    countedFree(tasks);
+    return compact;
+}
+
+/**
+ * Function that converts compact tree into tree_t
+ * @param tree Pointer to compactTree_t
+ * @param pooled Whether nodes of the new tree are taken from a node pool
+ * @return Pointer to tree_t
+ */
+
+tree_t *compactToTree(const compactTree_t *tree, bool pooled) {
+    assert(tree);
+
+    tree_t *result = pooled ? makePooledTree(tree->values[tree->head]) : makeTree(tree->values[tree->head]);
+    auto *nodes = (node_t **) countedCalloc(tree->count, sizeof(node_t *));
+    nodes[tree->head] = result->head;
+
+    for (uint32_t node = compactPreorderNext(tree, tree->head, tree->head); node != NO_NODE;
+         node = compactPreorderNext(tree, tree->head, node)) {
+        uint32_t parent = tree->parent[node];
+        nodes[node] = treeMakeNode(result, nodes[parent], nullptr, nullptr, tree->values[node]);
+        if (tree->left[parent] == node)
+            nodes[parent]->left = nodes[node];
+        else
+            nodes[parent]->right = nodes[node];
+        result->size++;
+    }
+
+    treeAugment(result->head);
+    countedFree(nodes);
+    return result;
+}
+
+/**
+ * Function that prints out node declaration in DOT format
+ * @param tree Pointer to compactTree_t
+ * @param node Node index
+ * @param sink Pointer to outputSink_t
+ * @param valueDump Optional function that renders value
+ */
+
+static void compactNodePrint(compactTree_t *tree, uint32_t node, outputSink_t *sink, char *(*valueDump)(void *)) {
+    const char *color = "mediumturquoise";
+    uint32_t parent = tree->parent[node];
+    if (parent != NO_NODE)
+        color = tree->left[parent] == node ? "indianred" : "springgreen";
+
+    char *buffer = sinkReserve(sink, 64);
+    sinkCommit(sink, snprintf(buffer, 64, "node%u[shape=record, label=\"{%u | {PARENT|%d}", node, node,
+                              (int) (parent == NO_NODE ? -1 : (int) parent)));
+
+    if (valueDump) {
+        const char *value = valueDump(tree->values[node]);
+        sinkPut(sink, "| ", 2);
+        sinkPut(sink, value, strlen(value));
+    }
+
+    buffer = sinkReserve(sink, 160);
+    sinkCommit(sink, snprintf(buffer, 160, " | {{LEFT |<left> %d} | {RIGHT |<right> %d}}}\", style=filled, "
+                                           "fillcolor=%s];\n",
+                              tree->left[node] == NO_NODE ? -1 : (int) tree->left[node],
+                              tree->right[node] == NO_NODE ? -1 : (int) tree->right[node], color));
+
+    if (parent != NO_NODE) {
+        const char *port = tree->left[parent] == node ? "left" : "right";
+        buffer = sinkReserve(sink, 96);
+        sinkCommit(sink, snprintf(buffer, 96, "node%u -> node%u:%s;\nnode%u:%s -> node%u;\n", node, parent, port,
+                                  parent, port, node));
+    }
+}
+
+/**
+ * Compact tree dumper. Node indices are used as DOT identifiers, -1 stands for no node
+ * @param tree Pointer to compactTree_t
+ * @param filename Dump file name
+ * @param valueDump Optional function that renders tree value
+ */
+
+void compactTreeDump(compactTree_t *tree, char *filename, char *(*valueDump)(void *)) {
+    assert(tree);
+    assert(filename);
+
+    FILE *dumpFile = fopen(filename, "w");
+    assert(dumpFile);
+    outputSink_t *sink = makeFileSink(dumpFile);
+
+    sinkPut(sink, "digraph {\nconcentrate=true\n", 27);
+    for (uint32_t node = tree->head; node != NO_NODE; node = compactPreorderNext(tree, tree->head, node))
+        compactNodePrint(tree, node, sink, valueDump);
+    sinkPut(sink, "}\n", 2);
+
+    deleteSink(sink);
+    fclose(dumpFile);
+}
+
+/**
+ * Function that serializes compact tree in treeSerialize format
+ * @param tree Pointer to compactTree_t
+ * @param sink Pointer to outputSink_t
+ * @param writeValue Value writer, see TreeWriter.h
+ */
+
+template<typename ValueWriter>
+static void compactSerializeText(compactTree_t *tree, outputSink_t *sink, ValueWriter &writeValue) {
+    uint32_t root = tree->head;
+    uint32_t current = root;
+
+    sinkPut(sink, "{ ", 2);
+    while (current != NO_NODE) {
+        sinkPut(sink, "\"", 1);
+        sinkPutValue(sink, writeValue, tree->values[current]);
+        sinkPut(sink, "\" ", 2);
+
+        if (tree->left[current] != NO_NODE) {
+            sinkPut(sink, "{ ", 2);
+            current = tree->left[current];
+            continue;
+        }
+
+        if (tree->right[current] != NO_NODE) {
+            sinkPut(sink, "$ { ", 4);
+            current = tree->right[current];
+            continue;
+        }
+
+        while (true) {
+            if (current == root) {
+                current = NO_NODE;
+                break;
+            }
+
+            uint32_t parent = tree->parent[current];
+            sinkPut(sink, "} ", 2);
+
+            if (tree->left[parent] == current && tree->right[parent] != NO_NODE) {
+                sinkPut(sink, "{ ", 2);
+                current = tree->right[parent];
+                break;
+            }
+
+            current = parent;
+        }
+    }
+    sinkPut(sink, "}", 1);
+}
+
+/**
+ * Function that serializes compact tree into sink
+ * @param tree Pointer to compactTree_t
+ * @param sink Pointer to outputSink_t
+ * @param writeValue Function that appends value to the buffer if it fits and returns value length
+ * @return false if any write has failed
+ */
+
+bool compactTreeSerialize(compactTree_t *tree, outputSink_t *sink, size_t (*writeValue)(void *, char *, size_t)) {
+    assert(tree);
+    assert(sink);
+    assert(writeValue);
+
+    functionValueWriter_t writer = {writeValue};
+    compactSerializeText(tree, sink, writer);
+    return sinkFlush(sink);
+}
+
+/**
+ * Function that serializes compact tree
+ * @param tree Pointer to compactTree_t
+ * @param filename Filename to write to
+ * @param serializeValue Function that serializes value
+ */
+
+void compactTreeSerialize(compactTree_t *tree, char *filename, char *(serializeValue)(void *)) {
+    assert(tree);
+    assert(filename);
+    assert(serializeValue);
+
+    FILE *serialized = fopen(filename, "w");
+    assert(serialized);
+    outputSink_t *sink = makeFileSink(serialized);
+    stringValueWriter_t writer = {serializeValue, nullptr, nullptr};
+
+    compactSerializeText(tree, sink, writer);
+
+    deleteSink(sink);
+    fclose(serialized);
+}
+
+/**
+ * Function that parses tree serialized by treeSerialize straight into compact storage
+ * @param serialized Pointer to serialized tree, does not have to be null-terminated
+ * @param length Length of serialized tree in bytes
+ * @param deserializeValue Function that deserializes value. Gets value position and length inside the input
+ * @param errorOffset Optional pointer to store byte offset of the first error
+ * @return Pointer to compactTree_t or nullptr on error
+ */
+
+compactTree_t *compactTreeParse(const char *serialized, size_t length,
+                                void *(*deserializeValue)(const char *, size_t), size_t *errorOffset) {
+    assert(serialized);
+    assert(deserializeValue);
+
+    viewValueHandler_t handler = {deserializeValue};
+    const char *pos = serialized;
+    const char *end = serialized + length;
+    compactTree_t *tree = nullptr;
+    void *value = nullptr;
+
+    size_t capacity = 64;
+    size_t depth = 0;
+    auto *nodes = (uint32_t *) countedCalloc(capacity, sizeof(uint32_t));
+    auto *states = (PARSE_STATE *) countedCalloc(capacity, sizeof(PARSE_STATE));
+
+    pos = parseSkipSpace(pos, end);
+    if (pos == end || *pos != '{')
+        goto error;
+    pos++;
+
+    if (!parseValue(&pos, end, handler, &value))
+        goto error;
+
+    tree = makeCompactTree(value);
+    nodes[0] = tree->head;
+    states[0] = AFTER_VALUE;
+    depth = 1;
+
+    while (depth) {
+        pos = parseSkipSpace(pos, end);
+        if (pos == end)
+            goto error;
+
+        PARSE_STATE *state = &states[depth - 1];
+        char token = *pos;
+
+        if (token == '}' && *state != AFTER_SKIP) {
+            depth--;
+            pos++;
+        } else if (token == '$' && *state == AFTER_VALUE) {
+            *state = AFTER_SKIP;
+            pos++;
+        } else if (token == '{' && *state != AFTER_RIGHT) {
+            pos++;
+            if (!parseValue(&pos, end, handler, &value))
+                goto error;
+
+            uint32_t child = NO_NODE;
+            if (*state == AFTER_VALUE) {
+                child = compactAddLeftNode(tree, nodes[depth - 1], value);
+                *state = AFTER_LEFT;
+            } else {
+                child = compactAddRightNode(tree, nodes[depth - 1], value);
+                *state = AFTER_RIGHT;
+            }
+
+            if (depth == capacity) {
+                capacity *= 2;
+                nodes = (uint32_t *) countedRealloc(nodes, capacity * sizeof(uint32_t));
+                states = (PARSE_STATE *) countedRealloc(states, capacity * sizeof(PARSE_STATE));
+                assert(nodes && states);
+            }
+
+            nodes[depth] = child;
+            states[depth] = AFTER_VALUE;
+            depth++;
+        } else {
+            goto error;
+        }
+    }
+
+    pos = parseSkipSpace(pos, end);
+    if (pos != end)
+        goto error;
+
+    countedFree(nodes);
+    countedFree(states);
+    return tree;
+
+    error:
+    if (errorOffset)
+        *errorOffset = pos - serialized;
+
+    countedFree(nodes);
+    countedFree(states);
+    if (tree)
+        deleteCompactTree(tree);
+    return nullptr;
+}
@@ -0,0 +1,113 @@
+//
+// Created by alexey on 17.10.2026.
+//
+
+#ifndef TREE_COMPACTTREE_H
+#define TREE_COMPACTTREE_H
+#include "Tree.h"
+#include <cstdint>
+
+/*
+ * Compact tree keeps nodes in contiguous struct-of-arrays storage and links them with 32-bit indices instead of
+ * pointers. Head is always node 0. Removed nodes are recycled through a free list threaded through left links.
+ */
+
+const uint32_t NO_NODE = UINT32_MAX;
+
+struct compactTree_t {
+    uint32_t *left;
+    uint32_t *right;
+    uint32_t *parent;
+    void **values;
+    uint32_t head;
+    uint32_t freeList;
+    size_t size;
+    size_t count;
+    size_t capacity;
+};
+
+compactTree_t *makeCompactTree(void *headValue, size_t capacity = 0);
+
+void deleteCompactTree(compactTree_t *tree);
+
+/**
+ * Function that gets left node
+ * @param tree Pointer to compactTree_t
+ * @param node Node index
+ * @return Left node index or NO_NODE
+ */
+
+inline uint32_t compactGetLeftNode(const compactTree_t *tree, uint32_t node) {
+    assert(tree);
+    assert(node < tree->count);
+
+    return tree->left[node];
+}
+
+/**
+ * Function that gets right node
+ * @param tree Pointer to compactTree_t
+ * @param node Node index
+ * @return Right node index or NO_NODE
+ */
+
+inline uint32_t compactGetRightNode(const compactTree_t *tree, uint32_t node) {
+    assert(tree);
+    assert(node < tree->count);
+
+    return tree->right[node];
+}
+
+/**
+ * Function that gets parent node
+ * @param tree Pointer to compactTree_t
+ * @param node Node index
+ * @return Parent node index or NO_NODE for the head
+ */
+
+inline uint32_t compactGetParent(const compactTree_t *tree, uint32_t node) {
+    assert(tree);
+    assert(node < tree->count);
+
+    return tree->parent[node];
+}
+
+/**
+ * Function that gets node value
+ * @param tree Pointer to compactTree_t
+ * @param node Node index
+ * @return Pointer to value
+ */
+
+inline void *compactGetValue(const compactTree_t *tree, uint32_t node) {
+    assert(tree);
+    assert(node < tree->count);
+
+    return tree->values[node];
+}
+
+uint32_t compactAddLeftNode(compactTree_t *tree, uint32_t node, void *value);
+
+uint32_t compactAddRightNode(compactTree_t *tree, uint32_t node, void *value);
+
+void compactAddLeftSubtree(compactTree_t *tree, uint32_t node, compactTree_t *subtree);
+
+void compactAddRightSubtree(compactTree_t *tree, uint32_t node, compactTree_t *subtree);
+
+void compactDeleteNode(compactTree_t *tree, uint32_t node);
+
+uint32_t compactPreorderNext(const compactTree_t *tree, uint32_t root, uint32_t node);
+
+compactTree_t *compactFromTree(tree_t *tree);
+
+tree_t *compactToTree(const compactTree_t *tree, bool pooled = false);
+
+void compactTreeDump(compactTree_t *tree, char *filename, char *(*valueDump)(void *) = nullptr);
+
+bool compactTreeSerialize(compactTree_t *tree, outputSink_t *sink, size_t (*writeValue)(void *, char *, size_t));
+
+void compactTreeSerialize(compactTree_t *tree, char *filename, char *(serializeValue)(void *));
+
+compactTree_t *compactTreeParse(const char *serialized, size_t length,
+                                void *(*deserializeValue)(const char *, size_t), size_t *errorOffset = nullptr);
+#endif //TREE_COMPACTTREE_H
@@ -0,0 +1,301 @@
+//
+// Created by alexey on 17.10.2026.
+//
+
+#include "FrozenTree.h"
+#include "TreeIterators.h"
+#include <cstdint>
+
+struct layoutOrder_t {
+    node_t **nodes;
+    size_t size;
+};
+
+struct depthTask_t {
+    node_t *node;
+    size_t depth;
+};
+
+struct positionTable_t {
+    const node_t **keys;
+    uint32_t *positions;
+    size_t capacity;
+};
+
+/**
+ * Function that finds slot of node in position table
+ * @param table Pointer to positionTable_t
+ * @param node Pointer to node_t
+ * @return Slot of the node or of the empty key where it would be
+ */
+
+static size_t positionSlot(const positionTable_t *table, const node_t *node) {
+    size_t slot = ((uintptr_t) node >> 4) * (size_t) 0x9e3779b97f4a7c15ULL;
+    slot = (slot ^ (slot >> (sizeof(size_t) * 4))) & (table->capacity - 1);
+
+    while (table->keys[slot] && table->keys[slot] != node)
+        slot = (slot + 1) & (table->capacity - 1);
+
+    return slot;
+}
+
+/**
+ * Function that gets layout position of node
+ * @param table Pointer to positionTable_t
+ * @param node Pointer to node_t of the frozen tree or nullptr
+ * @return Position or FROZEN_NONE for nullptr
+ */
+
+static uint32_t positionOf(const positionTable_t *table, const node_t *node) {
+    if (!node)
+        return FROZEN_NONE;
+
+    size_t slot = positionSlot(table, node);
+    assert(table->keys[slot]);
+    return table->positions[slot];
+}
+
+/**
+ * Function that lays nodes out in preorder
+ * @param root Pointer to tree head
+ * @param order Pointer to layoutOrder_t
+ */
+
+static void preorderLayout(node_t *root, layoutOrder_t *order) {
+    for (node_t *node : preorder(root))
+        order->nodes[order->size++] = node;
+}
+
+/**
+ * Function that lays nodes out level by level. Order array itself serves as the queue
+ * @param root Pointer to tree head
+ * @param order Pointer to layoutOrder_t
+ */
+
+static void levelLayout(node_t *root, layoutOrder_t *order) {
+    order->nodes[order->size++] = root;
+
+    for (size_t index = 0; index < order->size; index++) {
+        node_t *node = order->nodes[index];
+        if (node->left)
+            order->nodes[order->size++] = node->left;
+        if (node->right)
+            order->nodes[order->size++] = node->right;
+    }
+}
+
+/**
+ * Function that lays nodes out in van Emde Boas order: top half of the levels goes first, then every bottom
+ * subtree, each of them laid out recursively. Recursion depth is O(log height)
+ * @param root Pointer to subtree root
+ * @param height Number of levels to lay out
+ * @param order Pointer to layoutOrder_t
+ */
+
+static void vebLayout(node_t *root, size_t height, layoutOrder_t *order) {
+    if (height == 1) {
+        order->nodes[order->size++] = root;
+        return;
+    }
+
+    size_t topHeight = height / 2;
+    size_t bottomHeight = height - topHeight;
+    vebLayout(root, topHeight, order);
+
+    // Bottom subtrees are rooted at depth topHeight, collect them from left to right
+    size_t stackCapacity = 64;
+    size_t stackSize = 0;
+    auto *stack = (depthTask_t *) countedCalloc(stackCapacity, sizeof(depthTask_t));
+
+    size_t rootsCapacity = 16;
+    size_t rootsSize = 0;
+    auto *roots = (node_t **) countedCalloc(rootsCapacity, sizeof(node_t *));
+
+    stack[stackSize++] = {root, 0};
+    while (stackSize) {
+        depthTask_t task = stack[--stackSize];
+
+        if (task.depth == topHeight) {
+            if (rootsSize == rootsCapacity) {
+                rootsCapacity *= 2;
+                roots = (node_t **) countedRealloc(roots, rootsCapacity * sizeof(node_t *));
+                assert(roots);
+            }
+            roots[rootsSize++] = task.node;
+            continue;
+        }
+
+        if (stackSize + 2 > stackCapacity) {
+            stackCapacity *= 2;
+            stack = (depthTask_t *) countedRealloc(stack, stackCapacity * sizeof(depthTask_t));
+            assert(stack);
+        }
+
+        if (task.node->right)
+            stack[stackSize++] = {task.node->right, task.depth + 1};
+        if (task.node->left)
+            stack[stackSize++] = {task.node->left, task.depth + 1};
+    }
+    countedFree(stack);
+
+    for (size_t index = 0; index < rootsSize; index++)
+        vebLayout(roots[index], bottomHeight, order);
+
+    countedFree(roots);
+}
+
+/**
+ * Function that relocates tree into one contiguous read-only block. Source tree is only read, lazy tree is expanded
+ * first
+ * @param tree Pointer to tree_t
+ * @param layout Node order inside the block
+ * @return Pointer to frozenTree_t
+ */
+
+frozenTree_t *freezeTree(tree_t *tree, FROZEN_LAYOUT layout) {
+    assert(tree);
+    assert(tree->head);
+
+    treeExpandAll(tree);
+
+    size_t count = 0;
+    for (node_t *node : preorder(tree)) {
+        (void) node;
+        count++;
+    }
+    assert(count < FROZEN_NONE);
+
+    layoutOrder_t order = {(node_t **) countedCalloc(count, sizeof(node_t *)), 0};
+    assert(order.nodes);
+
+    if (layout == LEVEL_LAYOUT)
+        levelLayout(tree->head, &order);
+    else if (layout == VEB_LAYOUT)
+        vebLayout(tree->head, nodeSubtreeHeight(tree->head), &order);
+    else
+        preorderLayout(tree->head, &order);
+    assert(order.size == count);
+
+    auto *frozen = (frozenTree_t *) countedCalloc(1, sizeof(frozenTree_t) + count * sizeof(frozenNode_t));
+    auto *nodes = (frozenNode_t *) (frozen + 1);
+    frozen->nodes = nodes;
+    frozen->count = count;
+    frozen->layout = layout;
+
+    // Links are resolved through a side table of layout positions, so readers of the source see it unchanged
+    positionTable_t table = {};
+    table.capacity = 16;
+    while (table.capacity < 2 * count)
+        table.capacity *= 2;
+    table.keys = (const node_t **) countedCalloc(table.capacity, sizeof(node_t *));
+    table.positions = (uint32_t *) countedMalloc(table.capacity * sizeof(uint32_t));
+    assert(table.keys && table.positions);
+
+    for (size_t index = 0; index < count; index++) {
+        size_t slot = positionSlot(&table, order.nodes[index]);
+        table.keys[slot] = order.nodes[index];
+        table.positions[slot] = (uint32_t) index;
+    }
+
+    for (size_t index = 0; index < count; index++) {
+        node_t *node = order.nodes[index];
+        nodes[index].value = node->value;
+        nodes[index].left = positionOf(&table, node->left);
+        nodes[index].right = positionOf(&table, node->right);
+        nodes[index].parent = node != tree->head ? positionOf(&table, node->parent) : FROZEN_NONE;
+    }
+
+    countedFree(table.keys);
+    countedFree(table.positions);
+    countedFree(order.nodes);
+    return frozen;
+}
+
+/**
+ * Function that copies frozen tree back into mutable tree_t
+ * @param frozen Pointer to frozenTree_t
+ * @param pooled Whether nodes of the new tree are taken from a node pool
+ * @return Pointer to tree_t
+ */
+
+tree_t *thawTree(const frozenTree_t *frozen, bool pooled) {
+    assert(frozen);
+
+    const frozenNode_t *nodes = frozen->nodes;
+    tree_t *tree = pooled ? makePooledTree(nodes[0].value) : makeTree(nodes[0].value);
+    auto *created = (node_t **) countedCalloc(frozen->count, sizeof(node_t *));
+    created[0] = tree->head;
+
+    // Every layout puts parents before their children
+    for (size_t index = 1; index < frozen->count; index++) {
+        node_t *parent = created[nodes[index].parent];
+        assert(parent);
+
+        node_t *node = treeMakeNode(tree, parent, nullptr, nullptr, nodes[index].value);
+        if (nodes[nodes[index].parent].left == index)
+            parent->left = node;
+        else
+            parent->right = node;
+
+        created[index] = node;
+        tree->size++;
+    }
+
+    treeAugment(tree->head);
+    countedFree(created);
+    return tree;
+}
+
+/**
+ * Frozen tree "destructor"
+ * @param frozen Pointer to frozenTree_t
+ */
+
+void deleteFrozenTree(frozenTree_t *frozen) {
+    assert(frozen);
+
+    countedFree(frozen);
+}
+
+/**
+ * Function that finds next node of the subtree in preorder using parent links
+ * @param frozen Pointer to frozenTree_t
+ * @param root Subtree root index
+ * @param node Current node index
+ * @return Next node index or FROZEN_NONE if node was the last one
+ */
+
+uint32_t frozenPreorderNext(const frozenTree_t *frozen, uint32_t root, uint32_t node) {
+    const frozenNode_t *nodes = frozen->nodes;
+
+    if (nodes[node].left != FROZEN_NONE)
+        return nodes[node].left;
+
+    if (nodes[node].right != FROZEN_NONE)
+        return nodes[node].right;
+
+    while (node != root) {
+        uint32_t parent = nodes[node].parent;
+        if (nodes[parent].left == node && nodes[parent].right != FROZEN_NONE)
+            return nodes[parent].right;
+        node = parent;
+    }
+
+    return FROZEN_NONE;
+}
+
+/**
+ * Function that visits every node value in layout order. It is a plain sequential scan of the block, which is
+ * the fastest way to touch every node when visiting order does not matter
+ * @param frozen Pointer to frozenTree_t
+ * @param visit Function to call for every value
+ * @param context Pointer passed to visit as is
+ */
+
+void frozenForEach(const frozenTree_t *frozen, void (*visit)(void *value, void *context), void *context) {
+    assert(frozen);
+    assert(visit);
+
+    for (size_t index = 0; index < frozen->count; index++)
+        visit(frozen->nodes[index].value, context);
+}
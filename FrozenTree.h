@@ -0,0 +1,105 @@
+//
+// Created by alexey on 17.10.2026.
+//
+
+#ifndef TREE_FROZENTREE_H
+#define TREE_FROZENTREE_H
+#include "Tree.h"
+#include <cstdint>
+
+/*
+ * Frozen tree is a read-only copy of tree_t relocated into one contiguous block. Nodes are ordered by the chosen
+ * layout and linked with 32-bit indices, head is always node 0.
+ *
+ *     PREORDER_LAYOUT  depth-first order, best for serialization-like walks
+ *     LEVEL_LAYOUT     breadth-first order, best for walks that stop at a shallow depth
+ *     VEB_LAYOUT       van Emde Boas order, keeps every root-to-leaf path in O(log_B n) cache lines
+ */
+
+enum FROZEN_LAYOUT {
+    PREORDER_LAYOUT,
+    LEVEL_LAYOUT,
+    VEB_LAYOUT
+};
+
+const uint32_t FROZEN_NONE = UINT32_MAX;
+
+struct frozenNode_t {
+    uint32_t left;
+    uint32_t right;
+    uint32_t parent;
+    void *value;
+};
+
+struct frozenTree_t {
+    const frozenNode_t *nodes;
+    size_t count;
+    FROZEN_LAYOUT layout;
+};
+
+frozenTree_t *freezeTree(tree_t *tree, FROZEN_LAYOUT layout = PREORDER_LAYOUT);
+
+tree_t *thawTree(const frozenTree_t *frozen, bool pooled = false);
+
+void deleteFrozenTree(frozenTree_t *frozen);
+
+/**
+ * Function that gets left node
+ * @param frozen Pointer to frozenTree_t
+ * @param node Node index
+ * @return Left node index or FROZEN_NONE
+ */
+
+inline uint32_t frozenGetLeftNode(const frozenTree_t *frozen, uint32_t node) {
+    assert(frozen);
+    assert(node < frozen->count);
+
+    return frozen->nodes[node].left;
+}
+
+/**
+ * Function that gets right node
+ * @param frozen Pointer to frozenTree_t
+ * @param node Node index
+ * @return Right node index or FROZEN_NONE
+ */
+
+inline uint32_t frozenGetRightNode(const frozenTree_t *frozen, uint32_t node) {
+    assert(frozen);
+    assert(node < frozen->count);
+
+    return frozen->nodes[node].right;
+}
+
+/**
+ * Function that gets parent node
+ * @param frozen Pointer to frozenTree_t
+ * @param node Node index
+ * @return Parent node index or FROZEN_NONE for the head
+ */
+
+inline uint32_t frozenGetParent(const frozenTree_t *frozen, uint32_t node) {
+    assert(frozen);
+    assert(node < frozen->count);
+
+    return frozen->nodes[node].parent;
+}
+
+/**
+ * Function that gets node value
+ * @param frozen Pointer to frozenTree_t
+ * @param node Node index
+ * @return Pointer to value
+ */
+
+inline void *frozenGetValue(const frozenTree_t *frozen, uint32_t node) {
+    assert(frozen);
+    assert(node < frozen->count);
+
+    return frozen->nodes[node].value;
+}
+
+uint32_t frozenPreorderNext(const frozenTree_t *frozen, uint32_t root, uint32_t node);
+
+void frozenForEach(const frozenTree_t *frozen, void (*visit)(void *value, void *context), void *context);
+#endif //TREE_FROZENTREE_H
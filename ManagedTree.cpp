@@ -0,0 +1,238 @@
+//
+// Created by alexey on 17.10.2026.
+//
+
+#include "ManagedTree.h"
+#include "TreeIterators.h"
+
+/**
+ * Function that destroys values of the subtree. Nodes are not touched, lazy tree is expanded before the walk
+ * @param tree Pointer to tree_t that owns the subtree
+ * @param root Pointer to subtree root, may be nullptr
+ * @param destroyValue Value destructor, nullptr if values are not owned
+ */
+
+static void destroyValues(tree_t *tree, node_t *root, void (*destroyValue)(void *)) {
+    if (!root || !destroyValue)
+        return;
+
+    treeExpandAll(tree);
+    for (node_t *node : preorder(root))
+        destroyValue(node->value);
+}
+
+/**
+ * ManagedTree constructor
+ * @param headValue Value for tree head, owned by the tree
+ * @param destroyValue Value destructor, nullptr if values are not owned
+ * @param pooled Whether nodes are taken from a node pool
+ */
+
+ManagedTree::ManagedTree(void *headValue, void (*destroyValue)(void *), bool pooled) : tree_(nullptr),
+                                                                                      destroyValue_(destroyValue) {
+    tree_ = pooled ? makePooledTree(headValue) : makeTree(headValue);
+}
+
+/**
+ * Function that parses serialized tree into owning tree
+ * @param serialized Pointer to serialized tree, does not have to be null-terminated
+ * @param length Length of serialized tree in bytes
+ * @param deserializeValue Function that deserializes value. Gets value position and length inside the input
+ * @param destroyValue Destructor of values made by deserializeValue
+ * @param errorOffset Optional pointer to store byte offset of the first error
+ * @param pooled Whether nodes of the new tree are taken from a node pool
+ * @return Restored tree, empty on error
+ */
+
+ManagedTree ManagedTree::parse(const char *serialized, size_t length,
+                               void *(*deserializeValue)(const char *, size_t), void (*destroyValue)(void *),
+                               size_t *errorOffset, bool pooled) {
+    return {treeParse(serialized, length, deserializeValue, errorOffset, pooled), destroyValue};
+}
+
+/**
+ * Function that loads text or binary snapshot into owning tree
+ * @param filename Name of snapshot
+ * @param deserializeValue Function that deserializes value. Gets value position and length inside the mapping
+ * @param destroyValue Destructor of values made by deserializeValue
+ * @param errorOffset Optional pointer to store byte offset of the first text parse error
+ * @param pooled Whether nodes of the new tree are taken from a node pool
+ * @return Restored tree, empty on error
+ */
+
+ManagedTree ManagedTree::load(const char *filename, void *(*deserializeValue)(const char *, size_t),
+                              void (*destroyValue)(void *), size_t *errorOffset, bool pooled) {
+    return {treeLoad(filename, deserializeValue, errorOffset, pooled), destroyValue};
+}
+
+/**
+ * Function that gives up ownership. Values are not destroyed, tree is left empty
+ * @return Pointer to tree_t that should be deleted by caller
+ */
+
+tree_t *ManagedTree::release() {
+    tree_t *tree = tree_;
+    tree_ = nullptr;
+    return tree;
+}
+
+/**
+ * Function that destroys all the values and nodes. Tree is left empty
+ */
+
+void ManagedTree::reset() {
+    if (!tree_)
+        return;
+
+    destroyValues(tree_, tree_->head, destroyValue_);
+    deleteTree(tree_);
+    tree_ = nullptr;
+}
+
+/**
+ * Function that serializes tree into sink in treeSerialize format
+ * @param sink Pointer to outputSink_t
+ * @param writeValue Function that appends value to the buffer if it fits and returns value length
+ * @return false if any write has failed
+ */
+
+bool ManagedTree::save(outputSink_t *sink, size_t (*writeValue)(void *, char *, size_t)) const {
+    assert(tree_);
+
+    return treeSerialize(tree_, sink, writeValue);
+}
+
+/**
+ * Function that serializes tree into file in treeSerialize format
+ * @param filename Filename to write to
+ * @param writeValue Function that appends value to the buffer if it fits and returns value length
+ * @return false if file can not be written
+ */
+
+bool ManagedTree::save(const char *filename, size_t (*writeValue)(void *, char *, size_t)) const {
+    assert(tree_);
+    assert(filename);
+
+    FILE *out = fopen(filename, "w");
+    if (!out)
+        return false;
+
+    outputSink_t *sink = makeFileSink(out);
+    bool written = treeSerialize(tree_, sink, writeValue);
+    written = deleteSink(sink) && written;
+    return fclose(out) == 0 && written;
+}
+
+/**
+ * Function that dumps tree in compact DOT format
+ * @param filename Dump file name
+ * @param options Optional dump options, values are rendered by options->writeValue
+ * @return false if file can not be written
+ */
+
+bool ManagedTree::dump(const char *filename, const dumpOptions_t *options) const {
+    assert(tree_);
+
+    return treeDumpCompact(tree_, filename, options);
+}
+
+/**
+ * Function that replaces node value. Previous value is destroyed
+ * @param value Pointer to new value, owned by the tree
+ */
+
+void NodeRef::setValue(void *value) const {
+    assert(node_);
+
+    if (destroyValue_ && node_->value != value)
+        destroyValue_(node_->value);
+    node_->value = value;
+    treeMarkDirty(tree_, node_);
+}
+
+/**
+ * Function that adds left node. Previous left subtree is destroyed with its values
+ * @param value Pointer to value for new node, owned by the tree
+ * @return Handle of new node
+ */
+
+NodeRef NodeRef::addLeft(void *value) const {
+    assert(node_);
+
+    treeExpandAll(tree_);
+    destroyValues(tree_, node_->left, destroyValue_);
+    addLeftNode(tree_, node_, value);
+    return left();
+}
+
+/**
+ * Function that adds right node. Previous right subtree is destroyed with its values
+ * @param value Pointer to value for new node, owned by the tree
+ * @return Handle of new node
+ */
+
+NodeRef NodeRef::addRight(void *value) const {
+    assert(node_);
+
+    treeExpandAll(tree_);
+    destroyValues(tree_, node_->right, destroyValue_);
+    addRightNode(tree_, node_, value);
+    return right();
+}
+
+/**
+ * Function that moves subtree to the left. Previous left subtree is destroyed with its values
+ * @param subtree Tree with the same value destructor, left empty
+ */
+
+void NodeRef::graftLeft(ManagedTree &&subtree) const {
+    assert(node_);
+    assert(subtree.tree_);
+    assert(subtree.tree_ != tree_);
+    assert(subtree.destroyValue_ == destroyValue_);
+
+    treeExpandAll(tree_);
+    treeExpandAll(subtree.tree_);
+    destroyValues(tree_, node_->left, destroyValue_);
+    addLeftSubtree(tree_, node_, subtree.release());
+}
+
+/**
+ * Function that moves subtree to the right. Previous right subtree is destroyed with its values
+ * @param subtree Tree with the same value destructor, left empty
+ */
+
+void NodeRef::graftRight(ManagedTree &&subtree) const {
+    assert(node_);
+    assert(subtree.tree_);
+    assert(subtree.tree_ != tree_);
+    assert(subtree.destroyValue_ == destroyValue_);
+
+    treeExpandAll(tree_);
+    treeExpandAll(subtree.tree_);
+    destroyValues(tree_, node_->right, destroyValue_);
+    addRightSubtree(tree_, node_, subtree.release());
+}
+
+/**
+ * Function that unlinks node subtree into tree of its own. Values go with it, node pool is shared
+ * @return Tree owning the subtree
+ */
+
+ManagedTree NodeRef::detach() const {
+    assert(node_);
+
+    return {detachSubtree(tree_, node_), destroyValue_};
+}
+
+/**
+ * Function that deletes node AND ALL THE SUBNODES with their values. Handle must not be used afterwards
+ */
+
+void NodeRef::remove() const {
+    assert(node_);
+
+    treeExpandAll(tree_);
+    destroyValues(tree_, node_, destroyValue_);
+    deleteNode(tree_, node_);
+}
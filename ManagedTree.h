@@ -0,0 +1,168 @@
+//
+// Created by alexey on 17.10.2026.
+//
+
+#ifndef TREE_MANAGEDTREE_H
+#define TREE_MANAGEDTREE_H
+#include "Tree.h"
+
+/*
+ * Owning wrapper over tree_t. ManagedTree is move-only: moving hands the tree_t pointer over, nodes and values stay
+ * where they are. Values belong to the tree and are destroyed by its destroyValue whenever their nodes go away:
+ * on tree destruction, on removal, on replacement of a child and on setValue. Grafting takes the subtree by rvalue,
+ * so the moved-from tree is empty afterwards instead of pointing at freed tree_t.
+ *
+ * NodeRef is a non-owning node handle. It stays valid across moves of its tree and until its node is removed.
+ * Lazily loaded trees are expanded by the first change or value destruction, reads go through the expanding accessors.
+ *
+ * Saving and dumping take writeValue functions that fill caller buffers, so no value string is ever allocated.
+ */
+
+class ManagedTree;
+
+class NodeRef {
+public:
+    NodeRef() : tree_(nullptr), node_(nullptr), destroyValue_(nullptr) {
+    }
+
+    NodeRef(tree_t *tree, node_t *node, void (*destroyValue)(void *)) : tree_(tree), node_(node),
+                                                                       destroyValue_(destroyValue) {
+    }
+
+    explicit operator bool() const {
+        return node_ != nullptr;
+    }
+
+    node_t *node() const {
+        return node_;
+    }
+
+    void *value() const {
+        assert(node_);
+        return node_->value;
+    }
+
+    NodeRef left() const {
+        assert(node_);
+        return {tree_, getLeftNode(node_), destroyValue_};
+    }
+
+    NodeRef right() const {
+        assert(node_);
+        return {tree_, getRightNode(node_), destroyValue_};
+    }
+
+    NodeRef parent() const {
+        assert(node_);
+        return {tree_, node_->parent, destroyValue_};
+    }
+
+    void setValue(void *value) const;
+
+    NodeRef addLeft(void *value) const;
+
+    NodeRef addRight(void *value) const;
+
+    void graftLeft(ManagedTree &&subtree) const;
+
+    void graftRight(ManagedTree &&subtree) const;
+
+    ManagedTree detach() const;
+
+    void remove() const;
+
+private:
+    tree_t *tree_;
+    node_t *node_;
+    void (*destroyValue_)(void *);
+};
+
+class ManagedTree {
+public:
+    ManagedTree() : tree_(nullptr), destroyValue_(nullptr) {
+    }
+
+    explicit ManagedTree(void *headValue, void (*destroyValue)(void *) = nullptr, bool pooled = false);
+
+    ManagedTree(tree_t *tree, void (*destroyValue)(void *)) : tree_(tree), destroyValue_(destroyValue) {
+    }
+
+    ManagedTree(const ManagedTree &) = delete;
+
+    ManagedTree &operator=(const ManagedTree &) = delete;
+
+    /**
+     * Move constructor. Other tree is left empty
+     * @param other Tree to take ownership from
+     */
+
+    ManagedTree(ManagedTree &&other) noexcept : tree_(other.tree_), destroyValue_(other.destroyValue_) {
+        other.tree_ = nullptr;
+    }
+
+    /**
+     * Move assignment. Nodes and values of this tree are destroyed
+     * @param other Tree to take ownership from
+     * @return Reference to this tree
+     */
+
+    ManagedTree &operator=(ManagedTree &&other) noexcept {
+        if (this != &other) {
+            reset();
+            tree_ = other.tree_;
+            destroyValue_ = other.destroyValue_;
+            other.tree_ = nullptr;
+        }
+
+        return *this;
+    }
+
+    ~ManagedTree() {
+        reset();
+    }
+
+    static ManagedTree parse(const char *serialized, size_t length, void *(*deserializeValue)(const char *, size_t),
+                             void (*destroyValue)(void *), size_t *errorOffset = nullptr, bool pooled = false);
+
+    static ManagedTree load(const char *filename, void *(*deserializeValue)(const char *, size_t),
+                            void (*destroyValue)(void *), size_t *errorOffset = nullptr, bool pooled = false);
+
+    explicit operator bool() const {
+        return tree_ != nullptr;
+    }
+
+    tree_t *get() const {
+        return tree_;
+    }
+
+    /**
+     * @return Number of nodes below the head, same as tree_t::size
+     */
+
+    size_t size() const {
+        assert(tree_);
+        return tree_->size;
+    }
+
+    NodeRef head() const {
+        assert(tree_);
+        return {tree_, tree_->head, destroyValue_};
+    }
+
+    tree_t *release();
+
+    void reset();
+
+    bool save(outputSink_t *sink, size_t (*writeValue)(void *, char *, size_t)) const;
+
+    bool save(const char *filename, size_t (*writeValue)(void *, char *, size_t)) const;
+
+    bool dump(const char *filename, const dumpOptions_t *options = nullptr) const;
+
+private:
+    friend class NodeRef;
+
+    tree_t *tree_;
+    void (*destroyValue_)(void *);
+};
+#endif //TREE_MANAGEDTREE_H
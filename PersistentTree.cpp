@@ -0,0 +1,494 @@
+//
+// Created by alexey on 17.10.2026.
+//
+
+#include "PersistentTree.h"
+#include "TreeIterators.h"
+#include "TreeParser.h"
+#include "TreeWriter.h"
+
+struct persistentTask_t {
+    const persistentNode_t *node;
+    node_t *parent;
+    DIRECTION dir;
+};
+
+struct persistentFrame_t {
+    const persistentNode_t *node;
+    PARSE_STATE state;
+};
+
+/**
+ * Persistent node "constructor". References to children are handed over to the node
+ * @param value Pointer to value
+ * @param left Left child or nullptr
+ * @param right Right child or nullptr
+ * @param size Number of nodes in the subtree
+ * @return Pointer to persistentNode_t with one reference
+ */
+
+static persistentNode_t *makePersistentNode(void *value, persistentNode_t *left, persistentNode_t *right,
+                                            size_t size) {
+    auto *node = (persistentNode_t *) countedCalloc(1, sizeof(persistentNode_t));
+    assert(node);
+
+    node->left = left;
+    node->right = right;
+    node->value = value;
+    node->size = size;
+    node->refs.store(1, std::memory_order_relaxed);
+    return node;
+}
+
+/**
+ * Function that takes one more reference to node
+ * @param node Pointer to persistentNode_t or nullptr
+ * @return The same node
+ */
+
+static persistentNode_t *retainNode(persistentNode_t *node) {
+    if (node)
+        node->refs.fetch_add(1, std::memory_order_relaxed);
+
+    return node;
+}
+
+/**
+ * Function that drops reference to node and frees nodes that are no longer referenced. Does not recurse: dead nodes
+ * wait for their children to be released in a list linked through value field, values are not needed any more
+ * @param node Pointer to persistentNode_t or nullptr
+ */
+
+static void releaseNode(persistentNode_t *node) {
+    if (!node || node->refs.fetch_sub(1, std::memory_order_acq_rel) != 1)
+        return;
+
+    node->value = nullptr;
+    persistentNode_t *dead = node;
+
+    while (dead) {
+        persistentNode_t *current = dead;
+        dead = (persistentNode_t *) current->value;
+
+        persistentNode_t *children[2] = {current->left, current->right};
+        for (persistentNode_t *child : children) {
+            if (child && child->refs.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+                child->value = dead;
+                dead = child;
+            }
+        }
+
+        countedFree(current);
+    }
+}
+
+/**
+ * Function that follows path from the head
+ * @param head Pointer to head node
+ * @param path Array of LEFT and RIGHT directions
+ * @param depth Path length
+ * @return Pointer to persistentNode_t or nullptr if there is no node at the path
+ */
+
+static persistentNode_t *followPath(persistentNode_t *head, const DIRECTION *path, size_t depth) {
+    persistentNode_t *node = head;
+
+    for (size_t level = 0; node && level < depth; level++) {
+        assert(path[level] == LEFT || path[level] == RIGHT);
+        node = path[level] == LEFT ? node->left : node->right;
+    }
+
+    return node;
+}
+
+/**
+ * Function that makes path from the head to existing node private to this version. Node referenced by someone else
+ * is replaced with a copy, which references its children once more, so everything below a copy is copied as well.
+ * Subtree sizes on the path are changed by delta
+ * @param tree Pointer to persistentTree_t
+ * @param path Array of LEFT and RIGHT directions
+ * @param depth Path length
+ * @param delta Change of the number of nodes, wraps around for removed nodes
+ * @return Pointer to persistentNode_t at the path that may be changed in place
+ */
+
+static persistentNode_t *unsharePath(persistentTree_t *tree, const DIRECTION *path, size_t depth, size_t delta) {
+    persistentNode_t **link = &tree->head;
+
+    for (size_t level = 0;; level++) {
+        persistentNode_t *node = *link;
+
+        if (node->refs.load(std::memory_order_acquire) != 1) {
+            persistentNode_t *copy = makePersistentNode(node->value, retainNode(node->left), retainNode(node->right),
+                                                        node->size);
+            *link = copy;
+            releaseNode(node);
+            node = copy;
+        }
+
+        node->size += delta;
+        if (level == depth)
+            return node;
+
+        link = path[level] == LEFT ? &node->left : &node->right;
+    }
+}
+
+/**
+ * Function that hangs child from the node at path, replacing previous child on that side
+ * @param tree Pointer to persistentTree_t
+ * @param path Array of LEFT and RIGHT directions
+ * @param depth Path length
+ * @param child Pointer to persistentNode_t, reference is handed over to the tree
+ * @param dir LEFT or RIGHT
+ * @return false if there is no node at the path
+ */
+
+static bool attachChild(persistentTree_t *tree, const DIRECTION *path, size_t depth, persistentNode_t *child,
+                        DIRECTION dir) {
+    persistentNode_t *target = followPath(tree->head, path, depth);
+    if (!target) {
+        releaseNode(child);
+        return false;
+    }
+
+    persistentNode_t *previous = dir == LEFT ? target->left : target->right;
+    size_t delta = child->size - (previous ? previous->size : 0);
+
+    persistentNode_t *node = unsharePath(tree, path, depth, delta);
+    persistentNode_t **slot = dir == LEFT ? &node->left : &node->right;
+    previous = *slot;
+    *slot = child;
+    releaseNode(previous);
+
+    tree->size += delta;
+    return true;
+}
+
+/**
+ * Persistent tree "constructor"
+ * @param headValue Value for tree head
+ * @return Pointer to persistentTree_t
+ */
+
+persistentTree_t *makePersistentTree(void *headValue) {
+    auto *tree = (persistentTree_t *) countedCalloc(1, sizeof(persistentTree_t));
+    assert(tree);
+
+    tree->head = makePersistentNode(headValue, nullptr, nullptr, 1);
+    return tree;
+}
+
+/**
+ * Function that takes snapshot of the current version in O(1). Snapshot is not changed by later changes of tree
+ * and the other way round
+ * @param tree Pointer to persistentTree_t
+ * @return Pointer to new persistentTree_t sharing all nodes with tree
+ */
+
+persistentTree_t *persistentSnapshot(const persistentTree_t *tree) {
+    assert(tree);
+
+    auto *snapshot = (persistentTree_t *) countedCalloc(1, sizeof(persistentTree_t));
+    assert(snapshot);
+
+    snapshot->head = retainNode(tree->head);
+    snapshot->size = tree->size;
+    return snapshot;
+}
+
+/**
+ * Persistent tree "destructor". Frees nodes not shared with other versions
+ * @param tree Pointer to persistentTree_t
+ */
+
+void deletePersistentTree(persistentTree_t *tree) {
+    assert(tree);
+
+    releaseNode(tree->head);
+    countedFree(tree);
+}
+
+/**
+ * Function that finds node by path. Node must not be changed, it may be shared with other versions
+ * @param tree Pointer to persistentTree_t
+ * @param path Array of LEFT and RIGHT directions
+ * @param depth Path length
+ * @return Pointer to persistentNode_t or nullptr if there is no node at the path
+ */
+
+persistentNode_t *persistentFind(const persistentTree_t *tree, const DIRECTION *path, size_t depth) {
+    assert(tree);
+    assert(path || !depth);
+
+    return followPath(tree->head, path, depth);
+}
+
+/**
+ * Function that replaces node value in this version
+ * @param tree Pointer to persistentTree_t
+ * @param path Array of LEFT and RIGHT directions
+ * @param depth Path length
+ * @param value Pointer to new value
+ * @return false if there is no node at the path
+ */
+
+bool persistentSetValue(persistentTree_t *tree, const DIRECTION *path, size_t depth, void *value) {
+    assert(tree);
+    assert(path || !depth);
+
+    if (!followPath(tree->head, path, depth))
+        return false;
+
+    unsharePath(tree, path, depth, 0)->value = value;
+    return true;
+}
+
+/**
+ * Function that adds left node, replacing previous left subtree
+ * @param tree Pointer to persistentTree_t
+ * @param path Path to target node
+ * @param depth Path length
+ * @param value Pointer to value for new node
+ * @return false if there is no node at the path
+ */
+
+bool persistentAddLeftNode(persistentTree_t *tree, const DIRECTION *path, size_t depth, void *value) {
+    assert(tree);
+    assert(path || !depth);
+
+    return attachChild(tree, path, depth, makePersistentNode(value, nullptr, nullptr, 1), LEFT);
+}
+
+/**
+ * Function that adds right node, replacing previous right subtree
+ * @param tree Pointer to persistentTree_t
+ * @param path Path to target node
+ * @param depth Path length
+ * @param value Pointer to value for new node
+ * @return false if there is no node at the path
+ */
+
+bool persistentAddRightNode(persistentTree_t *tree, const DIRECTION *path, size_t depth, void *value) {
+    assert(tree);
+    assert(path || !depth);
+
+    return attachChild(tree, path, depth, makePersistentNode(value, nullptr, nullptr, 1), RIGHT);
+}
+
+/**
+ * Function that grafts current version of another tree as left subtree. Nodes are shared, not copied, so subtree
+ * stays usable and may even be this tree
+ * @param tree Pointer to persistentTree_t
+ * @param path Path to target node
+ * @param depth Path length
+ * @param subtree Pointer to persistentTree_t to graft
+ * @return false if there is no node at the path
+ */
+
+bool persistentAddLeftSubtree(persistentTree_t *tree, const DIRECTION *path, size_t depth,
+                              const persistentTree_t *subtree) {
+    assert(tree);
+    assert(subtree);
+    assert(path || !depth);
+
+    return attachChild(tree, path, depth, retainNode(subtree->head), LEFT);
+}
+
+/**
+ * Function that grafts current version of another tree as right subtree. Nodes are shared, not copied, so subtree
+ * stays usable and may even be this tree
+ * @param tree Pointer to persistentTree_t
+ * @param path Path to target node
+ * @param depth Path length
+ * @param subtree Pointer to persistentTree_t to graft
+ * @return false if there is no node at the path
+ */
+
+bool persistentAddRightSubtree(persistentTree_t *tree, const DIRECTION *path, size_t depth,
+                               const persistentTree_t *subtree) {
+    assert(tree);
+    assert(subtree);
+    assert(path || !depth);
+
+    return attachChild(tree, path, depth, retainNode(subtree->head), RIGHT);
+}
+
+/**
+ * Function that removes subtree from this version
+ * @param tree Pointer to persistentTree_t
+ * @param path Path to subtree root, head can not be removed
+ * @param depth Path length, at least one
+ * @return false if there is no node at the path
+ */
+
+bool persistentRemoveSubtree(persistentTree_t *tree, const DIRECTION *path, size_t depth) {
+    assert(tree);
+    assert(path);
+    assert(depth);
+
+    persistentNode_t *target = followPath(tree->head, path, depth);
+    if (!target)
+        return false;
+
+    size_t delta = 0 - target->size;
+    persistentNode_t *node = unsharePath(tree, path, depth - 1, delta);
+    persistentNode_t **slot = path[depth - 1] == LEFT ? &node->left : &node->right;
+    target = *slot;
+    *slot = nullptr;
+    releaseNode(target);
+
+    tree->size += delta;
+    return true;
+}
+
+/**
+ * Function that builds persistent tree with the same contents as tree_t. Values are not copied
+ * @param tree Pointer to tree_t
+ * @return Pointer to persistentTree_t
+ */
+
+persistentTree_t *persistentFromTree(tree_t *tree) {
+    assert(tree);
+
+    treeExpandAll(tree);
+
+    // In postorder both children of a node are on top of the stack when the node is reached
+    size_t capacity = 64;
+    size_t size = 0;
+    auto *stack = (persistentNode_t **) countedCalloc(capacity, sizeof(persistentNode_t *));
+    assert(stack);
+
+    for (node_t *node : postorder(tree)) {
+        persistentNode_t *right = node->right ? stack[--size] : nullptr;
+        persistentNode_t *left = node->left ? stack[--size] : nullptr;
+        size_t nodes = 1 + (left ? left->size : 0) + (right ? right->size : 0);
+
+        if (size == capacity) {
+            capacity *= 2;
+            stack = (persistentNode_t **) countedRealloc(stack, capacity * sizeof(persistentNode_t *));
+            assert(stack);
+        }
+
+        stack[size++] = makePersistentNode(node->value, left, right, nodes);
+    }
+
+    assert(size == 1);
+    auto *persistent = (persistentTree_t *) countedCalloc(1, sizeof(persistentTree_t));
+    assert(persistent);
+
+    persistent->head = stack[0];
+    persistent->size = stack[0]->size - 1;
+
+    countedFree(stack);
+    return persistent;
+}
+
+/**
+ * Function that copies version into a tree_t
+ * @param tree Pointer to persistentTree_t
+ * @param pooled Whether nodes of the new tree are taken from a node pool
+ * @return Pointer to tree_t
+ */
+
+tree_t *persistentToTree(const persistentTree_t *tree, bool pooled) {
+    assert(tree);
+
+    tree_t *copy = pooled ? makePooledTree(tree->head->value) : makeTree(tree->head->value);
+
+    size_t capacity = 64;
+    size_t size = 0;
+    auto *stack = (persistentTask_t *) countedCalloc(capacity, sizeof(persistentTask_t));
+    assert(stack);
+
+    stack[size++] = {tree->head, copy->head, HEAD};
+    while (size) {
+        persistentTask_t task = stack[--size];
+
+        node_t *node = task.parent;
+        if (task.dir != HEAD) {
+            node = treeMakeNode(copy, task.parent, nullptr, nullptr, task.node->value);
+            if (task.dir == LEFT)
+                task.parent->left = node;
+            else
+                task.parent->right = node;
+            copy->size++;
+        }
+
+        if (size + 2 > capacity) {
+            capacity *= 2;
+            stack = (persistentTask_t *) countedRealloc(stack, capacity * sizeof(persistentTask_t));
+            assert(stack);
+        }
+
+        if (task.node->right)
+            stack[size++] = {task.node->right, node, RIGHT};
+        if (task.node->left)
+            stack[size++] = {task.node->left, node, LEFT};
+    }
+
+    treeAugment(copy->head);
+    countedFree(stack);
+    return copy;
+}
+
+/**
+ * Function that serializes version in treeSerialize text format. Does not recurse and may run on any thread while
+ * other versions are changed
+ * @param tree Pointer to persistentTree_t
+ * @param sink Pointer to outputSink_t
+ * @param writeValue Function that appends value to the buffer if it fits and returns value length
+ * @return false if any write has failed
+ */
+
+bool persistentTreeSerialize(const persistentTree_t *tree, outputSink_t *sink,
+                             size_t (*writeValue)(void *, char *, size_t)) {
+    assert(tree);
+    assert(sink);
+    assert(writeValue);
+
+    functionValueWriter_t writer = {writeValue};
+
+    size_t capacity = 64;
+    size_t size = 0;
+    auto *stack = (persistentFrame_t *) countedCalloc(capacity, sizeof(persistentFrame_t));
+    assert(stack);
+
+    const persistentNode_t *child = tree->head;
+    while (true) {
+        if (child) {
+            sinkPut(sink, "{ \"", 3);
+            sinkPutValue(sink, writer, child->value);
+            sinkPut(sink, "\" ", 2);
+
+            if (size == capacity) {
+                capacity *= 2;
+                stack = (persistentFrame_t *) countedRealloc(stack, capacity * sizeof(persistentFrame_t));
+                assert(stack);
+            }
+            stack[size++] = {child, AFTER_VALUE};
+        }
+
+        persistentFrame_t *top = &stack[size - 1];
+        child = nullptr;
+
+        if (top->state == AFTER_VALUE) {
+            top->state = AFTER_LEFT;
+            child = top->node->left;
+            if (!child && top->node->right)
+                sinkPut(sink, "$ ", 2);
+        } else if (top->state == AFTER_LEFT) {
+            top->state = AFTER_RIGHT;
+            child = top->node->right;
+        } else {
+            size--;
+            if (!size)
+                break;
+            sinkPut(sink, "} ", 2);
+        }
+    }
+
+    sinkPut(sink, "}", 1);
+    countedFree(stack);
+    return sinkFlush(sink);
+}
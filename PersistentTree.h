@@ -0,0 +1,63 @@
+//
+// Created by alexey on 17.10.2026.
+//
+
+#ifndef TREE_PERSISTENTTREE_H
+#define TREE_PERSISTENTTREE_H
+#include "Tree.h"
+#include <atomic>
+
+/*
+ * Persistent tree is a tree whose versions share nodes. Nodes have no parent pointers and are reference counted,
+ * a version is a handle holding one reference to its head. Taking a snapshot is O(1): the new handle just shares
+ * the head. Changes go through a handle and copy the path from the head to the changed node, so every other version
+ * stays as it was. Nodes that are referenced by this handle only are changed in place without copying.
+ *
+ * Nodes are addressed by path from the head: array of LEFT and RIGHT directions.
+ *
+ * Any version may be read and deleted on any thread while others are changed. Snapshot of a handle has to be taken
+ * on the thread that changes it.
+ */
+
+struct persistentNode_t {
+    persistentNode_t *left;
+    persistentNode_t *right;
+    void *value;
+    size_t size;
+    std::atomic<size_t> refs;
+};
+
+struct persistentTree_t {
+    persistentNode_t *head;
+    size_t size;
+};
+
+persistentTree_t *makePersistentTree(void *headValue);
+
+persistentTree_t *persistentSnapshot(const persistentTree_t *tree);
+
+void deletePersistentTree(persistentTree_t *tree);
+
+persistentNode_t *persistentFind(const persistentTree_t *tree, const DIRECTION *path, size_t depth);
+
+bool persistentSetValue(persistentTree_t *tree, const DIRECTION *path, size_t depth, void *value);
+
+bool persistentAddLeftNode(persistentTree_t *tree, const DIRECTION *path, size_t depth, void *value);
+
+bool persistentAddRightNode(persistentTree_t *tree, const DIRECTION *path, size_t depth, void *value);
+
+bool persistentAddLeftSubtree(persistentTree_t *tree, const DIRECTION *path, size_t depth,
+                              const persistentTree_t *subtree);
+
+bool persistentAddRightSubtree(persistentTree_t *tree, const DIRECTION *path, size_t depth,
+                               const persistentTree_t *subtree);
+
+bool persistentRemoveSubtree(persistentTree_t *tree, const DIRECTION *path, size_t depth);
+
+persistentTree_t *persistentFromTree(tree_t *tree);
+
+tree_t *persistentToTree(const persistentTree_t *tree, bool pooled = false);
+
+bool persistentTreeSerialize(const persistentTree_t *tree, outputSink_t *sink,
+                             size_t (*writeValue)(void *, char *, size_t));
+#endif //TREE_PERSISTENTTREE_H
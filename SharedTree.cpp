@@ -0,0 +1,637 @@
+//
+// Created by alexey on 17.10.2026.
+//
+
+#include "SharedTree.h"
+#include "TreeIterators.h"
+#include "TreeParser.h"
+#include "TreeWriter.h"
+#include <cstdint>
+
+struct expandTask_t {
+    const sharedNode_t *node;
+    node_t *parent;
+    DIRECTION dir;
+};
+
+struct writeFrame_t {
+    sharedNode_t *node;
+    PARSE_STATE state;
+};
+
+struct sharedParseFrame_t {
+    void *value;
+    sharedNode_t *left;
+    sharedNode_t *right;
+    size_t id;
+    PARSE_STATE state;
+};
+
+struct nodeIds_t {
+    const sharedNode_t **keys;
+    size_t *ids;
+    size_t mask;
+};
+
+/**
+ * Function that mixes one more word into hash
+ * @param hash Hash so far
+ * @param word Word to mix in
+ * @return New hash
+ */
+
+static size_t mixHash(size_t hash, size_t word) {
+    return hash ^ (word + (size_t) 0x9e3779b97f4a7c15ULL + (hash << 6) + (hash >> 2));
+}
+
+/**
+ * Function that adds sizes, stopping at SIZE_MAX. Expanded size of a DAG may be exponential in its node count
+ * @param first First size
+ * @param second Second size
+ * @return Sum or SIZE_MAX
+ */
+
+static size_t saturatingAdd(size_t first, size_t second) {
+    return first > SIZE_MAX - second ? SIZE_MAX : first + second;
+}
+
+/**
+ * Function that computes node hash from value hash and hashes of already canonical children
+ * @param tree Pointer to sharedTree_t
+ * @param value Pointer to value
+ * @param left Left child or nullptr
+ * @param right Right child or nullptr
+ * @return Node hash
+ */
+
+static size_t nodeHash(const sharedTree_t *tree, void *value, const sharedNode_t *left, const sharedNode_t *right) {
+    size_t hash = tree->hashValue(value);
+    hash = mixHash(hash, left ? left->hash : 0);
+    return mixHash(hash, right ? right->hash : 1);
+}
+
+/**
+ * Function that doubles hash table and moves every node to its new bucket
+ * @param tree Pointer to sharedTree_t
+ */
+
+static void growBuckets(sharedTree_t *tree) {
+    size_t bucketCount = tree->bucketCount * 2;
+    auto *buckets = (sharedNode_t **) countedCalloc(bucketCount, sizeof(sharedNode_t *));
+    assert(buckets);
+
+    for (size_t bucket = 0; bucket < tree->bucketCount; bucket++) {
+        sharedNode_t *node = tree->buckets[bucket];
+        while (node) {
+            sharedNode_t *next = node->next;
+            size_t target = node->hash & (bucketCount - 1);
+            node->next = buckets[target];
+            buckets[target] = node;
+            node = next;
+        }
+    }
+
+    countedFree(tree->buckets);
+    tree->buckets = buckets;
+    tree->bucketCount = bucketCount;
+}
+
+/**
+ * Function that drops one reference. Node that is no longer referenced is taken out of hash table and put on
+ * the stack of nodes to free, linked through next field
+ * @param tree Pointer to sharedTree_t
+ * @param node Pointer to sharedNode_t, may be nullptr
+ * @param stack Pointer to the top of stack of nodes to free
+ */
+
+static void dropReference(sharedTree_t *tree, sharedNode_t *node, sharedNode_t **stack) {
+    if (!node)
+        return;
+
+    assert(node->refs);
+    if (--node->refs)
+        return;
+
+    sharedNode_t **link = &tree->buckets[node->hash & (tree->bucketCount - 1)];
+    while (*link != node)
+        link = &(*link)->next;
+    *link = node->next;
+
+    node->next = *stack;
+    *stack = node;
+}
+
+/**
+ * Shared tree "constructor"
+ * @param hashValue Function that hashes value
+ * @param equalValues Function that compares two values
+ * @return Pointer to sharedTree_t without head
+ */
+
+sharedTree_t *makeSharedTree(size_t (*hashValue)(void *), bool (*equalValues)(void *, void *)) {
+    assert(hashValue);
+    assert(equalValues);
+
+    auto *tree = (sharedTree_t *) countedCalloc(1, sizeof(sharedTree_t));
+    assert(tree);
+
+    tree->bucketCount = SHARED_FIRST_BUCKETS;
+    tree->buckets = (sharedNode_t **) countedCalloc(tree->bucketCount, sizeof(sharedNode_t *));
+    assert(tree->buckets);
+
+    tree->hashValue = hashValue;
+    tree->equalValues = equalValues;
+    return tree;
+}
+
+/**
+ * Shared tree "destructor". Frees every node of the tree, including the ones still referenced by the caller
+ * @param tree Pointer to sharedTree_t
+ */
+
+void deleteSharedTree(sharedTree_t *tree) {
+    assert(tree);
+
+    for (size_t bucket = 0; bucket < tree->bucketCount; bucket++) {
+        sharedNode_t *node = tree->buckets[bucket];
+        while (node) {
+            sharedNode_t *next = node->next;
+            countedFree(node);
+            node = next;
+        }
+    }
+
+    countedFree(tree->buckets);
+    countedFree(tree);
+}
+
+/**
+ * Function that finds node with the given value and children or creates it. References to children held by
+ * the caller are handed over to the node, reference to the node is returned to the caller
+ * @param tree Pointer to sharedTree_t
+ * @param value Pointer to value
+ * @param left Left child of this tree or nullptr
+ * @param right Right child of this tree or nullptr
+ * @return Pointer to canonical sharedNode_t
+ */
+
+sharedNode_t *sharedMakeNode(sharedTree_t *tree, void *value, sharedNode_t *left, sharedNode_t *right) {
+    assert(tree);
+
+    size_t hash = nodeHash(tree, value, left, right);
+    for (sharedNode_t *node = tree->buckets[hash & (tree->bucketCount - 1)]; node; node = node->next) {
+        if (node->hash != hash || node->left != left || node->right != right ||
+            !tree->equalValues(node->value, value))
+            continue;
+
+        // Existing node already references both children, references of the caller are not needed
+        node->refs++;
+        if (left)
+            left->refs--;
+        if (right)
+            right->refs--;
+        return node;
+    }
+
+    auto *node = (sharedNode_t *) countedCalloc(1, sizeof(sharedNode_t));
+    assert(node);
+
+    node->left = left;
+    node->right = right;
+    node->value = value;
+    node->hash = hash;
+    node->refs = 1;
+
+    node->size = saturatingAdd(1, left ? left->size : 0);
+    node->size = saturatingAdd(node->size, right ? right->size : 0);
+
+    if (tree->count == tree->bucketCount)
+        growBuckets(tree);
+
+    size_t bucket = hash & (tree->bucketCount - 1);
+    node->next = tree->buckets[bucket];
+    tree->buckets[bucket] = node;
+    tree->count++;
+
+    return node;
+}
+
+/**
+ * Function that takes one more reference to node
+ * @param node Pointer to sharedNode_t
+ * @return The same node
+ */
+
+sharedNode_t *sharedRetain(sharedNode_t *node) {
+    assert(node);
+
+    node->refs++;
+    return node;
+}
+
+/**
+ * Function that drops reference to node and frees nodes that are no longer referenced. Does not recurse
+ * @param tree Pointer to sharedTree_t
+ * @param node Pointer to sharedNode_t, may be nullptr
+ */
+
+void sharedRelease(sharedTree_t *tree, sharedNode_t *node) {
+    assert(tree);
+
+    sharedNode_t *stack = nullptr;
+    dropReference(tree, node, &stack);
+
+    while (stack) {
+        sharedNode_t *current = stack;
+        stack = current->next;
+
+        dropReference(tree, current->left, &stack);
+        dropReference(tree, current->right, &stack);
+        countedFree(current);
+        tree->count--;
+    }
+}
+
+/**
+ * Function that replaces tree head. Reference to the new head is handed over to the tree
+ * @param tree Pointer to sharedTree_t
+ * @param head Pointer to sharedNode_t of this tree or nullptr
+ */
+
+void sharedSetHead(sharedTree_t *tree, sharedNode_t *head) {
+    assert(tree);
+
+    sharedNode_t *previous = tree->head;
+    tree->head = head;
+    sharedRelease(tree, previous);
+}
+
+/**
+ * Function that builds shared tree with the same contents as tree_t. Tree itself is not changed, values are not
+ * copied: every distinct subtree keeps the value pointers of its first occurrence in postorder
+ * @param tree Pointer to tree_t
+ * @param hashValue Function that hashes value
+ * @param equalValues Function that compares two values
+ * @return Pointer to sharedTree_t
+ */
+
+sharedTree_t *deduplicate(tree_t *tree, size_t (*hashValue)(void *), bool (*equalValues)(void *, void *)) {
+    assert(tree);
+
+    treeExpandAll(tree);
+
+    sharedTree_t *shared = makeSharedTree(hashValue, equalValues);
+
+    // In postorder both children of a node are on top of the stack when the node is reached
+    size_t capacity = 64;
+    size_t size = 0;
+    auto *stack = (sharedNode_t **) countedCalloc(capacity, sizeof(sharedNode_t *));
+    assert(stack);
+
+    for (node_t *node : postorder(tree)) {
+        sharedNode_t *right = node->right ? stack[--size] : nullptr;
+        sharedNode_t *left = node->left ? stack[--size] : nullptr;
+
+        if (size == capacity) {
+            capacity *= 2;
+            stack = (sharedNode_t **) countedRealloc(stack, capacity * sizeof(sharedNode_t *));
+            assert(stack);
+        }
+
+        stack[size++] = sharedMakeNode(shared, node->value, left, right);
+    }
+
+    assert(size == 1);
+    shared->head = stack[0];
+
+    countedFree(stack);
+    return shared;
+}
+
+/**
+ * Function that expands shared tree back into a tree_t where every occurrence of a subtree is a separate copy
+ * @param tree Pointer to sharedTree_t with head
+ * @param pooled Whether nodes of the new tree are taken from a node pool
+ * @return Pointer to tree_t
+ */
+
+tree_t *sharedToTree(const sharedTree_t *tree, bool pooled) {
+    assert(tree);
+    assert(tree->head);
+
+    tree_t *expanded = pooled ? makePooledTree(tree->head->value) : makeTree(tree->head->value);
+
+    size_t capacity = 64;
+    size_t size = 0;
+    auto *stack = (expandTask_t *) countedCalloc(capacity, sizeof(expandTask_t));
+    assert(stack);
+
+    stack[size++] = {tree->head, expanded->head, HEAD};
+    while (size) {
+        expandTask_t task = stack[--size];
+
+        node_t *node = task.parent;
+        if (task.dir != HEAD) {
+            node = treeMakeNode(expanded, task.parent, nullptr, nullptr, task.node->value);
+            if (task.dir == LEFT)
+                task.parent->left = node;
+            else
+                task.parent->right = node;
+            expanded->size++;
+        }
+
+        if (size + 2 > capacity) {
+            capacity *= 2;
+            stack = (expandTask_t *) countedRealloc(stack, capacity * sizeof(expandTask_t));
+            assert(stack);
+        }
+
+        if (task.node->right)
+            stack[size++] = {task.node->right, node, RIGHT};
+        if (task.node->left)
+            stack[size++] = {task.node->left, node, LEFT};
+    }
+
+    treeAugment(expanded->head);
+    countedFree(stack);
+    return expanded;
+}
+
+/**
+ * Function that looks node up in the table of written subtrees
+ * @param written Pointer to nodeIds_t
+ * @param node Pointer to sharedNode_t
+ * @return Index of the slot of the node, key of the slot is nullptr if node has not been written yet
+ */
+
+static size_t nodeIdSlot(const nodeIds_t *written, const sharedNode_t *node) {
+    size_t slot = ((uintptr_t) node >> 4) * (size_t) 0x9e3779b97f4a7c15ULL;
+    slot = (slot ^ (slot >> (sizeof(size_t) * 4))) & written->mask;
+    while (written->keys[slot] && written->keys[slot] != node)
+        slot = (slot + 1) & written->mask;
+
+    return slot;
+}
+
+/**
+ * Function that writes child subtree: back-reference if it has been written already, opening brace and value
+ * otherwise
+ * @param sink Pointer to outputSink_t
+ * @param writer Value writer
+ * @param written Pointer to nodeIds_t
+ * @param next Pointer to the number of written subtrees
+ * @param node Pointer to sharedNode_t
+ * @return true if subtree is opened and its frame has to be pushed
+ */
+
+static bool writeSubtree(outputSink_t *sink, functionValueWriter_t &writer, nodeIds_t *written, size_t *next,
+                         sharedNode_t *node) {
+    size_t slot = nodeIdSlot(written, node);
+
+    if (written->keys[slot]) {
+        char *buffer = sinkReserve(sink, 32);
+        sinkCommit(sink, snprintf(buffer, 32, "@%zu ", written->ids[slot]));
+        return false;
+    }
+
+    written->keys[slot] = node;
+    written->ids[slot] = (*next)++;
+
+    sinkPut(sink, "{ \"", 3);
+    sinkPutValue(sink, writer, node->value);
+    sinkPut(sink, "\" ", 2);
+    return true;
+}
+
+/**
+ * Function that serializes shared tree in text format with back-references, so every distinct subtree is written
+ * once. Does not recurse
+ * @param tree Pointer to sharedTree_t with head
+ * @param sink Pointer to outputSink_t
+ * @param writeValue Function that appends value to the buffer if it fits and returns value length
+ * @return false if any write has failed
+ */
+
+bool sharedTreeSerialize(sharedTree_t *tree, outputSink_t *sink, size_t (*writeValue)(void *, char *, size_t)) {
+    assert(tree);
+    assert(tree->head);
+    assert(sink);
+    assert(writeValue);
+
+    functionValueWriter_t writer = {writeValue};
+
+    size_t tableSize = 16;
+    while (tableSize < tree->count * 2)
+        tableSize *= 2;
+
+    nodeIds_t written = {};
+    written.keys = (const sharedNode_t **) countedCalloc(tableSize, sizeof(sharedNode_t *));
+    written.ids = (size_t *) countedCalloc(tableSize, sizeof(size_t));
+    written.mask = tableSize - 1;
+    assert(written.keys && written.ids);
+
+    size_t capacity = 64;
+    size_t size = 0;
+    auto *stack = (writeFrame_t *) countedCalloc(capacity, sizeof(writeFrame_t));
+    assert(stack);
+
+    size_t next = 0;
+    writeSubtree(sink, writer, &written, &next, tree->head);
+    stack[size++] = {tree->head, AFTER_VALUE};
+
+    while (size) {
+        writeFrame_t *top = &stack[size - 1];
+        sharedNode_t *child = nullptr;
+
+        if (top->state == AFTER_VALUE) {
+            top->state = AFTER_LEFT;
+            child = top->node->left;
+            if (!child && top->node->right)
+                sinkPut(sink, "$ ", 2);
+        } else if (top->state == AFTER_LEFT) {
+            top->state = AFTER_RIGHT;
+            child = top->node->right;
+        } else {
+            size--;
+            sinkPut(sink, size ? "} " : "}", size ? 2 : 1);
+            continue;
+        }
+
+        if (!child || !writeSubtree(sink, writer, &written, &next, child))
+            continue;
+
+        if (size == capacity) {
+            capacity *= 2;
+            stack = (writeFrame_t *) countedRealloc(stack, capacity * sizeof(writeFrame_t));
+            assert(stack);
+        }
+        stack[size++] = {child, AFTER_VALUE};
+    }
+
+    countedFree(stack);
+    countedFree(written.keys);
+    countedFree(written.ids);
+    return sinkFlush(sink);
+}
+
+/**
+ * Function that reads back-reference number
+ * @param pos Pointer to current position at '@', moved past the number on success
+ * @param end Pointer past the end of input
+ * @param id Pointer to store the number
+ * @return false if there are no digits or number overflows
+ */
+
+static bool parseReference(const char **pos, const char *end, size_t *id) {
+    const char *current = *pos + 1;
+    size_t number = 0;
+
+    const char *digits = current;
+    while (current < end && *current >= '0' && *current <= '9') {
+        size_t digit = *current - '0';
+        if (number > (SIZE_MAX - digit) / 10) {
+            *pos = digits;
+            return false;
+        }
+        number = number * 10 + digit;
+        current++;
+    }
+
+    if (current == digits) {
+        *pos = current;
+        return false;
+    }
+
+    *pos = current;
+    *id = number;
+    return true;
+}
+
+/**
+ * Function that hands child over to the frame of its parent
+ * @param frame Pointer to sharedParseFrame_t of the parent
+ * @param child Pointer to sharedNode_t
+ */
+
+static void attachChild(sharedParseFrame_t *frame, sharedNode_t *child) {
+    if (frame->state == AFTER_LEFT)
+        frame->left = child;
+    else
+        frame->right = child;
+}
+
+/**
+ * Function that parses shared tree written by sharedTreeSerialize. Subtrees are hash-consed as they are closed,
+ * so equal subtrees written out in full are shared too
+ * @param serialized Pointer to serialized tree, does not have to be null-terminated
+ * @param length Length of serialized tree in bytes
+ * @param deserializeValue Function that gets value position and length inside the input
+ * @param hashValue Function that hashes value
+ * @param equalValues Function that compares two values
+ * @param errorOffset Optional pointer to store byte offset of the first error
+ * @return Pointer to sharedTree_t or nullptr on error
+ */
+
+sharedTree_t *sharedTreeParse(const char *serialized, size_t length, void *(*deserializeValue)(const char *, size_t),
+                              size_t (*hashValue)(void *), bool (*equalValues)(void *, void *),
+                              size_t *errorOffset) {
+    assert(serialized);
+    assert(deserializeValue);
+
+    viewValueHandler_t handleValue = {deserializeValue};
+    sharedTree_t *tree = makeSharedTree(hashValue, equalValues);
+    const char *pos = serialized;
+    const char *end = serialized + length;
+
+    size_t capacity = 64;
+    size_t size = 0;
+    auto *stack = (sharedParseFrame_t *) countedCalloc(capacity, sizeof(sharedParseFrame_t));
+
+    size_t idsCapacity = 64;
+    size_t idsCount = 0;
+    auto *ids = (sharedNode_t **) countedCalloc(idsCapacity, sizeof(sharedNode_t *));
+    assert(stack && ids);
+
+    void *value = nullptr;
+    size_t id = 0;
+
+    pos = parseSkipSpace(pos, end);
+    if (pos == end || *pos != '{')
+        goto error;
+
+    do {
+        pos = parseSkipSpace(pos, end);
+        if (pos == end)
+            goto error;
+
+        sharedParseFrame_t *top = size ? &stack[size - 1] : nullptr;
+        char token = *pos;
+
+        if (token == '{' && (!top || top->state != AFTER_RIGHT)) {
+            pos++;
+            if (!parseValue(&pos, end, handleValue, &value))
+                goto error;
+
+            if (top)
+                top->state = top->state == AFTER_VALUE ? AFTER_LEFT : AFTER_RIGHT;
+
+            if (size == capacity) {
+                capacity *= 2;
+                stack = (sharedParseFrame_t *) countedRealloc(stack, capacity * sizeof(sharedParseFrame_t));
+                assert(stack);
+            }
+            if (idsCount == idsCapacity) {
+                idsCapacity *= 2;
+                ids = (sharedNode_t **) countedRealloc(ids, idsCapacity * sizeof(sharedNode_t *));
+                assert(ids);
+            }
+
+            ids[idsCount] = nullptr;
+            stack[size++] = {value, nullptr, nullptr, idsCount++, AFTER_VALUE};
+        } else if (token == '@' && top && top->state != AFTER_RIGHT) {
+            // Only subtrees closed before this point may be referenced, so the result is always acyclic
+            const char *reference = pos;
+            if (!parseReference(&pos, end, &id))
+                goto error;
+            if (id >= idsCount || !ids[id]) {
+                pos = reference;
+                goto error;
+            }
+
+            top->state = top->state == AFTER_VALUE ? AFTER_LEFT : AFTER_RIGHT;
+            attachChild(top, sharedRetain(ids[id]));
+        } else if (token == '$' && top && top->state == AFTER_VALUE) {
+            top->state = AFTER_SKIP;
+            pos++;
+        } else if (token == '}' && top && top->state != AFTER_SKIP) {
+            pos++;
+            sharedNode_t *node = sharedMakeNode(tree, top->value, top->left, top->right);
+            ids[top->id] = node;
+            size--;
+
+            if (size)
+                attachChild(&stack[size - 1], node);
+            else
+                tree->head = node;
+        } else {
+            goto error;
+        }
+    } while (size);
+
+    pos = parseSkipSpace(pos, end);
+    if (pos != end)
+        goto error;
+
+    countedFree(stack);
+    countedFree(ids);
+    return tree;
+
+    error:
+    if (errorOffset)
+        *errorOffset = pos - serialized;
+
+    countedFree(stack);
+    countedFree(ids);
+    deleteSharedTree(tree);
+    return nullptr;
+}
@@ -0,0 +1,66 @@
+//
+// Created by alexey on 17.10.2026.
+//
+
+#ifndef TREE_SHAREDTREE_H
+#define TREE_SHAREDTREE_H
+#include "Tree.h"
+
+/*
+ * Shared tree is a hash-consed DAG: every distinct subtree, by value hash and equality given by the user, exists once
+ * and is reference counted. Nodes are built bottom-up and have no parent pointers, as one node can hang from many
+ * parents. Children of a node are canonical already, so two nodes are equal when their values are equal and their
+ * children are the same pointers, and lookup is O(1) per node.
+ *
+ * Text format is the treeSerialize one plus back-references: '@' N stands for the N-th subtree written so far,
+ * counting opening braces from zero.
+ *
+ *     tree  := '{' node '}'
+ *     node  := '"' value '"' [ child | '$' ] [ child ]
+ *     child := '{' node '}' | '@' number
+ */
+
+const size_t SHARED_FIRST_BUCKETS = 64;
+
+struct sharedNode_t {
+    sharedNode_t *left;
+    sharedNode_t *right;
+    void *value;
+    size_t hash;
+    size_t refs;
+    size_t size;
+    sharedNode_t *next;
+};
+
+struct sharedTree_t {
+    sharedNode_t *head;
+    sharedNode_t **buckets;
+    size_t bucketCount;
+    size_t count;
+    size_t (*hashValue)(void *);
+    bool (*equalValues)(void *, void *);
+};
+
+sharedTree_t *makeSharedTree(size_t (*hashValue)(void *), bool (*equalValues)(void *, void *));
+
+void deleteSharedTree(sharedTree_t *tree);
+
+sharedNode_t *sharedMakeNode(sharedTree_t *tree, void *value, sharedNode_t *left = nullptr,
+                             sharedNode_t *right = nullptr);
+
+sharedNode_t *sharedRetain(sharedNode_t *node);
+
+void sharedRelease(sharedTree_t *tree, sharedNode_t *node);
+
+void sharedSetHead(sharedTree_t *tree, sharedNode_t *head);
+
+sharedTree_t *deduplicate(tree_t *tree, size_t (*hashValue)(void *), bool (*equalValues)(void *, void *));
+
+tree_t *sharedToTree(const sharedTree_t *tree, bool pooled = false);
+
+bool sharedTreeSerialize(sharedTree_t *tree, outputSink_t *sink, size_t (*writeValue)(void *, char *, size_t));
+
+sharedTree_t *sharedTreeParse(const char *serialized, size_t length, void *(*deserializeValue)(const char *, size_t),
+                              size_t (*hashValue)(void *), bool (*equalValues)(void *, void *),
+                              size_t *errorOffset = nullptr);
+#endif //TREE_SHAREDTREE_H
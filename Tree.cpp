@@ -3,6 +3,123 @@
 //
 
 #include "Tree.h"
+#include "TreeIterators.h"
+#include "TreeParser.h"
+#include "TreeWriter.h"
+#include <atomic>
+
+static std::atomic<size_t> allocCalls(0);
+static std::atomic<size_t> freeCalls(0);
+static std::atomic<size_t> bytesAllocated(0);
+
+/**
+ * calloc wrapper that keeps allocation counters up to date. All the library allocations go through counted wrappers
+ * @param count Number of elements
+ * @param size Size of element
+ * @return Pointer to zeroed memory
+ */
+
+void *countedCalloc(size_t count, size_t size) {
+    allocCalls.fetch_add(1, std::memory_order_relaxed);
+    bytesAllocated.fetch_add(count * size, std::memory_order_relaxed);
+    return calloc(count, size);
+}
+
+/**
+ * malloc wrapper that keeps allocation counters up to date
+ * @param size Number of bytes
+ * @return Pointer to memory
+ */
+
+void *countedMalloc(size_t size) {
+    allocCalls.fetch_add(1, std::memory_order_relaxed);
+    bytesAllocated.fetch_add(size, std::memory_order_relaxed);
+    return malloc(size);
+}
+
+/**
+ * realloc wrapper that keeps allocation counters up to date. Moving existing block counts as one allocation of the
+ * new size and one free, so the counters stay balanced
+ * @param ptr Pointer to memory obtained from counted wrappers or nullptr
+ * @param size New size in bytes, not 0
+ * @return Pointer to memory
+ */
+
+void *countedRealloc(void *ptr, size_t size) {
+    assert(size);
+
+    allocCalls.fetch_add(1, std::memory_order_relaxed);
+    bytesAllocated.fetch_add(size, std::memory_order_relaxed);
+    if (ptr)
+        freeCalls.fetch_add(1, std::memory_order_relaxed);
+    return realloc(ptr, size);
+}
+
+/**
+ * aligned_alloc wrapper that keeps allocation counters up to date
+ * @param align Alignment, power of two
+ * @param size Number of bytes, multiple of align
+ * @return Pointer to memory, released with countedFree
+ */
+
+void *countedAlignedAlloc(size_t align, size_t size) {
+    allocCalls.fetch_add(1, std::memory_order_relaxed);
+    bytesAllocated.fetch_add(size, std::memory_order_relaxed);
+    return aligned_alloc(align, size);
+}
+
+/**
+ * free wrapper that keeps allocation counters up to date
+ * @param ptr Pointer to memory obtained from counted wrappers
+ */
+
+void countedFree(void *ptr) {
+    if (ptr)
+        freeCalls.fetch_add(1, std::memory_order_relaxed);
+    free(ptr);
+}
+
+/**
+ * Function that recomputes subtree size and height of node from its children
+ * @param node Pointer to node_t
+ */
+
+static void augmentNode(node_t *node) {
+#ifdef TREE_AUGMENT
+    size_t leftSize = node->left ? node->left->subtreeSize : 0;
+    size_t rightSize = node->right ? node->right->subtreeSize : 0;
+    size_t leftHeight = node->left ? node->left->height : 0;
+    size_t rightHeight = node->right ? node->right->height : 0;
+
+    node->subtreeSize = 1 + leftSize + rightSize;
+    node->height = 1 + (leftHeight > rightHeight ? leftHeight : rightHeight);
+#else
+    (void) node;
+#endif
+}
+
+/**
+ * Function that returns library-wide allocation counters
+ * @return Snapshot of allocation counters
+ */
+
+allocStats_t getAllocStats() {
+    allocStats_t stats = {};
+    stats.allocCalls = allocCalls.load(std::memory_order_relaxed);
+    stats.freeCalls = freeCalls.load(std::memory_order_relaxed);
+    stats.bytesAllocated = bytesAllocated.load(std::memory_order_relaxed);
+    return stats;
+}
+
+/**
+ * Function that resets library-wide allocation counters
+ */
+
+void resetAllocStats() {
+    allocCalls = 0;
+    freeCalls = 0;
+    bytesAllocated = 0;
+}
 
 /**
  * Tree "constructor" i. e. function that creates tree
@@ -11,12 +128,45 @@
  */
 
 tree_t *makeTree(void *headValue) {
-    auto *tree = (tree_t *) calloc(1, sizeof(tree_t));
+    auto *tree = (tree_t *) countedCalloc(1, sizeof(tree_t));
     node_t *head = makeNode(nullptr, nullptr, nullptr, headValue);
     tree->head = head;
     return tree;
 }
 
+/**
+ * Tree "constructor" for trees whose nodes live in a node pool
+ * @param headValue Value for tree head
+ * @param maxChunk Maximal number of nodes in one pool chunk
+ * @return Pointer to tree_t
+ */
+
+tree_t *makePooledTree(void *headValue, size_t maxChunk) {
+    auto *tree = (tree_t *) countedCalloc(1, sizeof(tree_t));
+    tree->pool = makeNodePool(maxChunk);
+    tree->head = poolMakeNode(tree->pool, nullptr, nullptr, nullptr, headValue);
+    return tree;
+}
+
+/**
+ * Tree "constructor" that takes ownership of nodes linked by the caller
+ * @param head Pointer to head node, its parent must be nullptr
+ * @param size Number of nodes below the head
+ * @param pool Pointer to nodePool_t holding the nodes, nullptr for calloc'ed nodes
+ * @return Pointer to tree_t
+ */
+
+tree_t *adoptTree(node_t *head, size_t size, nodePool_t *pool) {
+    assert(head);
+    assert(!head->parent);
+
+    auto *tree = (tree_t *) countedCalloc(1, sizeof(tree_t));
+    tree->head = head;
+    tree->size = size;
+    tree->pool = pool;
+    return tree;
+}
+
 /**
  * Node "constructor" i. e. function that creates tree
  * @param parent Pointer to parent node
@@ -27,16 +177,246 @@ tree_t *makeTree(void *headValue) {
  */
 
 node_t *makeNode(node_t *parent, node_t *left, node_t *right, void *value) {
-    auto node = (node_t *) calloc(1, sizeof(node_t));
+    auto node = (node_t *) countedCalloc(1, sizeof(node_t));
 
     node->parent = parent;
     node->left = left;
     node->right = right;
     node->value = value;
+    augmentNode(node);
 
     return node;
 }
 
+/**
+ * Node pool "constructor". Pool hands out nodes from slab chunks that grow geometrically up to maxChunk nodes
+ * @param maxChunk Maximal number of nodes in one chunk
+ * @return Pointer to nodePool_t
+ */
+
+nodePool_t *makeNodePool(size_t maxChunk) {
+    assert(maxChunk);
+
+    auto *pool = (nodePool_t *) countedCalloc(1, sizeof(nodePool_t));
+    pool->maxChunk = maxChunk;
+    pool->owners = 1;
+    return pool;
+}
+
+/**
+ * Function that adds a new chunk to the pool
+ * @param pool Pointer to nodePool_t
+ */
+
+static void poolGrow(nodePool_t *pool) {
+    size_t capacity = POOL_FIRST_CHUNK;
+    if (pool->chunks)
+        capacity = pool->chunks->capacity * 2;
+    if (capacity > pool->maxChunk)
+        capacity = pool->maxChunk;
+
+    auto *chunk = (nodeChunk_t *) countedCalloc(1, sizeof(nodeChunk_t) + capacity * sizeof(node_t));
+    chunk->capacity = capacity;
+    chunk->next = pool->chunks;
+    pool->chunks = chunk;
+    pool->chunkCount++;
+}
+
+/**
+ * Node "constructor" that takes node from the pool instead of the system allocator
+ * @param pool Pointer to nodePool_t
+ * @param parent Pointer to parent node
+ * @param left Pointer to left node
+ * @param right Pointer to right node
+ * @param value Pointer to value
+ * @return Pointer to node_t
+ */
+
+node_t *poolMakeNode(nodePool_t *pool, node_t *parent, node_t *left, node_t *right, void *value) {
+    assert(pool);
+
+    node_t *node = pool->freeList;
+    if (node) {
+        pool->freeList = node->left;
+    } else {
+        if (!pool->chunks || pool->chunks->used == pool->chunks->capacity)
+            poolGrow(pool);
+
+        node = (node_t *) (pool->chunks + 1) + pool->chunks->used++;
+    }
+    pool->nodesAllocated++;
+
+    node->parent = parent;
+    node->left = left;
+    node->right = right;
+    node->value = value;
+    augmentNode(node);
+
+    return node;
+}
+
+/**
+ * Function that takes count contiguous zeroed nodes from the pool. Nodes come from a chunk of their own unless the
+ * current chunk has room for all of them, so maxChunk does not apply
+ * @param pool Pointer to nodePool_t
+ * @param count Number of nodes
+ * @return Pointer to the first node of count nodes
+ */
+
+node_t *poolTakeNodes(nodePool_t *pool, size_t count) {
+    assert(pool);
+    assert(count);
+
+    pool->nodesAllocated += count;
+    nodeChunk_t *current = pool->chunks;
+    if (current && current->capacity - current->used >= count) {
+        node_t *nodes = (node_t *) (current + 1) + current->used;
+        current->used += count;
+        return nodes;
+    }
+
+    auto *chunk = (nodeChunk_t *) countedCalloc(1, sizeof(nodeChunk_t) + count * sizeof(node_t));
+    chunk->capacity = count;
+    chunk->used = count;
+    pool->chunkCount++;
+
+    // New chunk is full, keep the current one first so that new nodes are still bump-allocated from it
+    if (current) {
+        chunk->next = current->next;
+        current->next = chunk;
+    } else {
+        pool->chunks = chunk;
+    }
+
+    return (node_t *) (chunk + 1);
+}
+
+/**
+ * Function that returns single node to the pool free list. Subnodes are not touched
+ * @param pool Pointer to nodePool_t
+ * @param node Pointer to node taken from this pool
+ */
+
+void poolFreeNode(nodePool_t *pool, node_t *node) {
+    assert(pool);
+    assert(node);
+
+    node->left = pool->freeList;
+    node->right = nullptr;
+    node->parent = nullptr;
+    node->value = nullptr;
+    pool->freeList = node;
+    pool->nodesFreed++;
+}
+
+/**
+ * Node pool "destructor". Releases all the chunks at once, so it takes O(chunks) rather than O(nodes)
+ * @param pool Pointer to nodePool_t
+ */
+
+void deleteNodePool(nodePool_t *pool) {
+    assert(pool);
+
+    nodeChunk_t *chunk = pool->chunks;
+    while (chunk) {
+        nodeChunk_t *next = chunk->next;
+        countedFree(chunk);
+        chunk = next;
+    }
+
+    countedFree(pool);
+}
+
+/**
+ * Function that moves all the chunks and free nodes of one pool into another. Source pool is deleted
+ * @param pool Pointer to destination nodePool_t
+ * @param source Pointer to nodePool_t to merge, must not be shared by several trees
+ */
+
+void poolMerge(nodePool_t *pool, nodePool_t *source) {
+    assert(pool);
+    assert(source);
+    assert(pool != source);
+    assert(source->owners == 1);
+
+    if (source->chunks) {
+        nodeChunk_t *last = source->chunks;
+        while (last->next)
+            last = last->next;
+
+        // Keep the chunk with spare room first so that new nodes are still bump-allocated from it
+        if (pool->chunks) {
+            last->next = pool->chunks->next;
+            pool->chunks->next = source->chunks;
+        } else {
+            pool->chunks = source->chunks;
+        }
+    }
+
+    if (source->freeList) {
+        node_t *last = source->freeList;
+        while (last->left)
+            last = last->left;
+        last->left = pool->freeList;
+        pool->freeList = source->freeList;
+    }
+
+    pool->chunkCount += source->chunkCount;
+    pool->nodesAllocated += source->nodesAllocated;
+    pool->nodesFreed += source->nodesFreed;
+
+    countedFree(source);
+}
+
+/**
+ * Node "constructor" that uses tree allocator: pool for pooled trees and calloc otherwise
+ * @param tree Pointer to tree that will own the node
+ * @param parent Pointer to parent node
+ * @param left Pointer to left node
+ * @param right Pointer to right node
+ * @param value Pointer to value
+ * @return Pointer to node_t
+ */
+
+node_t *treeMakeNode(tree_t *tree, node_t *parent, node_t *left, node_t *right, void *value) {
+    assert(tree);
+
+    if (tree->pool)
+        return poolMakeNode(tree->pool, parent, left, right, value);
+
+    return makeNode(parent, left, right, value);
+}
+
+/**
+ * Function that frees node AND ALL THE SUBNODES without recursion. Walks the subtree in postorder through parent
+ * pointers, so it needs O(1) extra space regardless of tree height
+ * @param tree Pointer to tree whose allocator owns nodes, nullptr for calloc'ed nodes
+ * @param node Pointer to subtree root
+ * @return Number of deleted nodes
+ */
+
+static size_t freeSubtree(tree_t *tree, node_t *node) {
+    size_t deleted = 0;
+    node_t *current = postorderFirst(node);
+
+    // Children are always freed before their parent, and the next node is found before the current one is freed
+    while (current) {
+        node_t *next = postorderNext(node, current);
+
+        if (tree && tree->cache)
+            treeForgetNode(tree, current);
+        if (tree && tree->pool)
+            poolFreeNode(tree->pool, current);
+        else
+            countedFree(current);
+        deleted++;
+
+        current = next;
+    }
+
+    return deleted;
+}
+
 /**
  * Node "destructor" i. e. function that deletes node AND ALL THE SUBNODES
  * @param node Pointer to node for deleting
@@ -45,31 +425,106 @@ node_t *makeNode(node_t *parent, node_t *left, node_t *right, void *value) {
 void deleteNode(node_t *node) {
     assert(node);
 
-    if (node->left)
-        deleteNode(node->left);
+    freeSubtree(nullptr, node);
+}
 
-    if (node->right)
-        deleteNode(node->right);
+/**
+ * Function that deletes node AND ALL THE SUBNODES using tree allocator. Node is detached from its parent
+ * @param tree Pointer to tree that owns the node
+ * @param node Pointer to node for deleting. Must not be the tree head
+ */
 
-    free(node);
+void deleteNode(tree_t *tree, node_t *node) {
+    assert(tree);
+    assert(node);
+    assert(node != tree->head);
+    assert(!tree->lazy);
+
+    node_t *parent = node->parent;
+    if (parent)
+        treeMarkDirty(tree, parent);
+    if (parent && parent->left == node)
+        parent->left = nullptr;
+    else if (parent && parent->right == node)
+        parent->right = nullptr;
+    nodeAugmentPath(parent);
+
+    size_t deleted = freeSubtree(tree, node);
+    tree->size = tree->size > deleted ? tree->size - deleted : 0;
 }
 
 /**
- * Tree "destructor" i. e. function that deletes the whole tree
+ * Tree "destructor" i. e. function that deletes the whole tree. Pool and value arena are released at once by their
+ * last owner, a tree that shares its pool with detached subtrees returns its nodes to the pool one by one
  * @param tree Pointer to the tree for deleting
  */
 
 void deleteTree(tree_t *tree) {
     assert(tree);
 
-    deleteNode(tree->head);
+    treeDisableSerialCache(tree);
+    if (tree->lazy)
+        deleteLazySource(tree->lazy);
+    if (tree->pool && tree->pool->owners > 1) {
+        freeSubtree(tree, tree->head);
+        tree->pool->owners--;
+    } else if (tree->pool) {
+        deleteNodePool(tree->pool);
+    } else {
+        deleteNode(tree->head);
+    }
+    if (tree->arena && --tree->arena->owners == 0)
+        deleteValueArena(tree->arena);
     tree->size = 0;
 
-    free(tree);
+    countedFree(tree);
 }
 
 /**
- * Function that adds left node
+ * Function that moves node pool of the subtree into the tree. Subtree detached from the tree gives its share back,
+ * otherwise the pool that is not shared is merged into the other one
+ * @param tree Pointer to pooled tree that takes the subtree
+ * @param subtree Pointer to pooled subtree
+ */
+
+static void takePool(tree_t *tree, tree_t *subtree) {
+    if (subtree->pool == tree->pool) {
+        tree->pool->owners--;
+    } else if (subtree->pool->owners == 1) {
+        poolMerge(tree->pool, subtree->pool);
+    } else {
+        // Subtree pool is still used by other trees, so the tree moves its nodes there and takes subtree's share
+        poolMerge(subtree->pool, tree->pool);
+        tree->pool = subtree->pool;
+    }
+    subtree->pool = nullptr;
+}
+
+/**
+ * Function that moves value arena of the subtree into the tree, the same way takePool does with node pools
+ * @param tree Pointer to tree that takes the subtree
+ * @param subtree Pointer to subtree
+ */
+
+static void takeArena(tree_t *tree, tree_t *subtree) {
+    if (!subtree->arena)
+        return;
+
+    if (subtree->arena == tree->arena) {
+        tree->arena->owners--;
+    } else if (!tree->arena) {
+        tree->arena = subtree->arena;
+    } else if (subtree->arena->owners == 1) {
+        arenaMerge(tree->arena, subtree->arena);
+    } else {
+        arenaMerge(subtree->arena, tree->arena);
+        tree->arena = subtree->arena;
+    }
+    subtree->arena = nullptr;
+}
+
+/**
+ * Function that adds left node. Previous left subtree is deleted
  * @param tree Pointer to tree for adding node
  * @param node Pointer to target node
  * @param value Pointer to value for new node
@@ -78,10 +533,16 @@ void deleteTree(tree_t *tree) {
 void addLeftNode(tree_t *tree, node_t *node, void *value) {
     assert(node);
     assert(tree);
+    assert(!tree->lazy);
+
+    if (node->left)
+        deleteNode(tree, node->left);
 
-    node_t *newNode = makeNode(node, nullptr, nullptr, value);
+    node_t *newNode = treeMakeNode(tree, node, nullptr, nullptr, value);
+    treeMarkDirty(tree, node);
     node->left = newNode;
     tree->size++;
+    nodeAugmentPath(node);
 }
 
 /**
@@ -97,27 +558,40 @@ void addLeftNode(node_t *node, node_t *existingNode) {
 
     node->left = existingNode;
     existingNode->parent = node;
+    nodeAugmentPath(node);
 }
 
 /**
- * Function that adds subtree to the left
+ * Function that adds subtree to the left. Previous left subtree is deleted
  * @param tree Pointer to tree for subtree
  * @param node Pointer to target node
- * @param subtree Pointer to subtree
+ * @param subtree Pointer to subtree. Pooled subtree can be attached to pooled tree only, its pool is merged. If both
+ * pools are shared with other trees, they must be the same pool
  */
 
 void addLeftSubtree(tree_t *tree, node_t *node, tree_t *subtree) {
     assert(tree);
     assert(subtree);
+    assert(!tree->lazy && !subtree->lazy);
+
+    assert(!tree->pool == !subtree->pool);
+
+    if (node->left)
+        deleteNode(tree, node->left);
 
+    treeMarkDirty(tree, node);
+    treeDisableSerialCache(subtree);
     addLeftNode(node, subtree->head);
 
-    tree->size += subtree->size;
-    free(subtree);
+    tree->size += subtree->size + 1;
+    if (subtree->pool)
+        takePool(tree, subtree);
+    takeArena(tree, subtree);
+    countedFree(subtree);
 }
 
 /**
- * Function that adds right node
+ * Function that adds right node. Previous right subtree is deleted
  * @param tree Pointer to tree for adding node
  * @param node Pointer to target node
  * @param value Pointer to value for new node
@@ -126,10 +600,16 @@ void addLeftSubtree(tree_t *tree, node_t *node, tree_t *subtree) {
 void addRightNode(tree_t *tree, node_t *node, void *value) {
     assert(node);
     assert(tree);
+    assert(!tree->lazy);
 
-    node_t *newNode = makeNode(node, nullptr, nullptr, value);
+    if (node->right)
+        deleteNode(tree, node->right);
+
+    node_t *newNode = treeMakeNode(tree, node, nullptr, nullptr, value);
+    treeMarkDirty(tree, node);
     node->right = newNode;
     tree->size++;
+    nodeAugmentPath(node);
 }
 
 /**
@@ -145,27 +625,206 @@ void addRightNode(node_t *node, node_t *existingNode) {
 
     node->right = existingNode;
     existingNode->parent = node;
+    nodeAugmentPath(node);
 }
 
 /**
- * Function that adds subtree to the right
+ * Function that adds subtree to the right. Previous right subtree is deleted
  * @param tree Pointer to tree for subtree
  * @param node Pointer to target node
- * @param subtree Pointer to subtree
+ * @param subtree Pointer to subtree. Pooled subtree can be attached to pooled tree only, its pool is merged. If both
+ * pools are shared with other trees, they must be the same pool
  */
 
 void addRightSubtree(tree_t *tree, node_t *node, tree_t *subtree) {
     assert(tree);
     assert(subtree);
+    assert(!tree->lazy && !subtree->lazy);
+
+    assert(!tree->pool == !subtree->pool);
 
+    if (node->right)
+        deleteNode(tree, node->right);
+
+    treeMarkDirty(tree, node);
+    treeDisableSerialCache(subtree);
     addRightNode(node, subtree->head);
 
-    tree->size += subtree->size;
-    free(subtree);
+    tree->size += subtree->size + 1;
+    if (subtree->pool)
+        takePool(tree, subtree);
+    takeArena(tree, subtree);
+    countedFree(subtree);
+}
+
+/**
+ * Function that detaches subtree into a tree of its own. Takes O(depth) with TREE_AUGMENT, otherwise subtree is
+ * walked to count its nodes. Serial cache forgets fragments of the subtree without visiting its nodes, lazy tree is
+ * expanded first. Detached subtree shares node pool and value arena of the tree, they are released by the last tree
+ * that uses them, so trees sharing them must not be changed from different threads at the same time
+ * @param tree Pointer to tree that owns the node
+ * @param node Pointer to subtree root. Must not be the tree head
+ * @return Pointer to tree_t with node as head
+ */
+
+tree_t *detachSubtree(tree_t *tree, node_t *node) {
+    assert(tree);
+    assert(node);
+    assert(node->parent);
+
+    treeExpandAll(tree);
+
+    node_t *parent = node->parent;
+    treeMarkDirty(tree, parent);
+    if (tree->cache)
+        treeForgetSubtree(tree, node);
+
+    if (parent->left == node)
+        parent->left = nullptr;
+    else
+        parent->right = nullptr;
+    node->parent = nullptr;
+    nodeAugmentPath(parent);
+
+    size_t detached = nodeSubtreeSize(node);
+    tree->size = tree->size > detached ? tree->size - detached : 0;
+
+    auto *subtree = (tree_t *) countedCalloc(1, sizeof(tree_t));
+    subtree->head = node;
+    subtree->size = detached - 1;
+    subtree->pool = tree->pool;
+    if (subtree->pool)
+        subtree->pool->owners++;
+    subtree->arena = tree->arena;
+    if (subtree->arena)
+        subtree->arena->owners++;
+    return subtree;
+}
+
+/**
+ * Function that gets number of nodes in subtree. O(1) with TREE_AUGMENT, walks the subtree through parent pointers
+ * otherwise, expanding lazy children on the way
+ * @param node Pointer to subtree root
+ * @return Number of nodes including the root
+ */
+
+size_t nodeSubtreeSize(node_t *node) {
+    assert(node);
+
+#ifdef TREE_AUGMENT
+    return node->subtreeSize;
+#else
+    size_t size = 0;
+    node_t *current = node;
+
+    while (true) {
+        size++;
+
+        if (getLeftNode(current)) {
+            current = current->left;
+            continue;
+        }
+
+        if (getRightNode(current)) {
+            current = current->right;
+            continue;
+        }
+
+        while (current != node) {
+            node_t *parent = current->parent;
+            if (parent->left == current && parent->right)
+                break;
+            current = parent;
+        }
+
+        if (current == node)
+            return size;
+
+        current = getRightNode(current->parent);
+    }
+#endif
 }
 
 /**
- * Function that gets left node
+ * Function that gets subtree height. O(1) with TREE_AUGMENT, walks the subtree through parent pointers otherwise
+ * @param node Pointer to subtree root
+ * @return Number of levels in the subtree, 1 for a leaf
+ */
+
+size_t nodeSubtreeHeight(node_t *node) {
+    assert(node);
+
+#ifdef TREE_AUGMENT
+    return node->height;
+#else
+    size_t height = 0;
+    size_t depth = 1;
+    node_t *current = node;
+
+    while (true) {
+        if (depth > height)
+            height = depth;
+
+        if (getLeftNode(current)) {
+            current = current->left;
+            depth++;
+            continue;
+        }
+
+        if (getRightNode(current)) {
+            current = current->right;
+            depth++;
+            continue;
+        }
+
+        while (current != node) {
+            node_t *parent = current->parent;
+            if (parent->left == current && parent->right)
+                break;
+            current = parent;
+            depth--;
+        }
+
+        if (current == node)
+            return height;
+
+        current = getRightNode(current->parent);
+    }
+#endif
+}
+
+/**
+ * Function that recomputes subtree sizes and heights from node up to the root after its children have changed.
+ * Takes O(depth), does nothing without TREE_AUGMENT
+ * @param node Pointer to changed node, may be nullptr
+ */
+
+void nodeAugmentPath(node_t *node) {
+#ifdef TREE_AUGMENT
+    for (; node; node = node->parent)
+        augmentNode(node);
+#else
+    (void) node;
+#endif
+}
+
+/**
+ * Function that recomputes subtree sizes and heights of the whole subtree in one postorder pass. Bulk builders link
+ * nodes directly and call it once instead of paying O(depth) per node. Does nothing without TREE_AUGMENT
+ * @param root Pointer to subtree root
+ */
+
+void treeAugment(node_t *root) {
+#ifdef TREE_AUGMENT
+    for (node_t *node : postorder(root))
+        augmentNode(node);
+#else
+    (void) root;
+#endif
+}
+
+/**
+ * Function that gets left node. Subtree of a lazy tree is decoded when it is reached for the first time
  * @param node Pointer to node
  * @return Pointer to left node
  */
@@ -173,11 +832,14 @@ void addRightSubtree(tree_t *tree, node_t *node, tree_t *subtree) {
 node_t *getLeftNode(node_t *node) {
     assert(node);
 
+    if ((uintptr_t) node->left & LAZY_TAG)
+        return lazyExpandChild(node, LEFT);
+
     return node->left;
 }
 
 /**
- * Function that gets right node
+ * Function that gets right node. Subtree of a lazy tree is decoded when it is reached for the first time
  * @param node Pointer to node
  * @return Pointer to right node
  */
@@ -185,6 +847,9 @@ node_t *getLeftNode(node_t *node) {
 node_t *getRightNode(node_t *node) {
     assert(node);
 
+    if ((uintptr_t) node->right & LAZY_TAG)
+        return lazyExpandChild(node, RIGHT);
+
     return node->right;
 }
 
@@ -225,7 +890,26 @@ void nodePrint(node_t *node, FILE *dumpFile, DIRECTION dir, char *(*valueDump)(v
 }
 
 /**
- * Function that recursively dumps nodes in DOT format
+ * Function that prints out DOT edges between node and its parent
+ * @param node Pointer to node_t
+ * @param dumpFile Pointer to FILE
+ * @param dir Node direction (left, right or head)
+ */
+
+static void edgePrint(node_t *node, FILE *dumpFile, DIRECTION dir) {
+    if (!node->parent)
+        return;
+
+    if (dir == LEFT)
+        fprintf(dumpFile, "node%p -> node%p:left;\nnode%p:left -> node%p;\n", node, node->parent, node->parent,
+                node);
+    else if (dir == RIGHT)
+        fprintf(dumpFile, "node%p -> node%p:right;\nnode%p:right -> node%p;\n", node, node->parent, node->parent,
+                node);
+}
+
+/**
+ * Function that dumps nodes in DOT format. Walks the subtree through parent pointers, so it does not recurse
  * @param node Pointer to node_t
  * @param dumpFile Pointer to FILE
  * @param dir Node direction (left, right or head)
@@ -234,22 +918,16 @@ void nodePrint(node_t *node, FILE *dumpFile, DIRECTION dir, char *(*valueDump)(v
 void nodeDump(node_t *node, FILE *dumpFile, DIRECTION dir, char *(*valueDump)(void *)) {
     assert(node);
     assert(dumpFile);
-    if (node->parent)
-        if (dir == LEFT)
-            fprintf(dumpFile, "node%p -> node%p:left;\nnode%p:left -> node%p;\n", node, node->parent, node->parent,
-                    node);
-        else if (dir == RIGHT)
-            fprintf(dumpFile, "node%p -> node%p:right;\nnode%p:right -> node%p;\n", node, node->parent, node->parent,
-                    node);
-
-    if (node->left) {
-        nodePrint(node->left, dumpFile, LEFT, valueDump);
-        nodeDump(node->left, dumpFile, LEFT, valueDump);
-    }
 
-    if (node->right) {
-        nodePrint(node->right, dumpFile, RIGHT, valueDump);
-        nodeDump(node->right, dumpFile, RIGHT, valueDump);
+    edgePrint(node, dumpFile, dir);
+
+    for (node_t *current : preorder(node)) {
+        if (current == node)
+            continue;
+
+        DIRECTION currentDir = current->parent->left == current ? LEFT : RIGHT;
+        nodePrint(current, dumpFile, currentDir, valueDump);
+        edgePrint(current, dumpFile, currentDir);
     }
 }
 
@@ -264,6 +942,8 @@ void treeDump(tree_t *tree, char *filename, char *(*valueDump)(void *)) {
     assert(tree);
     assert(filename);
 
+    treeExpandAll(tree);
+
     FILE *dumpFile = fopen(filename, "w");
     fprintf(dumpFile, "digraph {\nconcentrate=true\n");
 
@@ -275,7 +955,7 @@ void treeDump(tree_t *tree, char *filename, char *(*valueDump)(void *)) {
 }
 
 /**
- * Function that recursively serializes nodes
+ * Function that serializes nodes through a buffered sink, so there are no per-node stdio calls
  * @param node Pointer to node_t
  * @param serialized Pointer to FILE to write to
  * @param serializeValue Pointer to value serializer function
@@ -286,23 +966,11 @@ void nodeSerialize(node_t *node, FILE *serialized, char *(serializeValue)(void *
     assert(node);
     assert(serializeValue);
 
+    outputSink_t *sink = makeFileSink(serialized);
+    stringValueWriter_t writer = {serializeValue, nullptr, nullptr};
 
-    fprintf(serialized, "\"%s\" ", serializeValue(node->value));
-
-    if (node->left) {
-        fprintf(serialized, "{ ");
-        nodeSerialize(node->left, serialized, serializeValue);
-        fprintf(serialized, "} ");
-    } else if (node->right)
-        fprintf(serialized, "$ ");
-
-    if (node->right) {
-        fprintf(serialized, "{ ");
-        nodeSerialize(node->right, serialized, serializeValue);
-        fprintf(serialized, "} ");
-    }
-    //else
-    //fprintf(serialized, "$ ");
+    serializeText(node, sink, writer);
+    deleteSink(sink);
 }
 
 /**
@@ -315,87 +983,109 @@ void nodeSerialize(node_t *node, FILE *serialized, char *(serializeValue)(void *
 void treeSerialize(tree_t *tree, char *filename, char *(serializeValue)(void *)) {
     assert(tree);
     assert(filename);
-    FILE *serialized = fopen(filename, "w");
-    fprintf(serialized, "{ ");
 
-    nodeSerialize(tree->head, serialized, serializeValue);
+    treeExpandAll(tree);
+
+    FILE *serialized = fopen(filename, "w");
+    outputSink_t *sink = makeFileSink(serialized);
+    stringValueWriter_t writer = {serializeValue, nullptr, nullptr};
 
-    fprintf(serialized, "}");
+    sinkPut(sink, "{ ", 2);
+    serializeText(tree->head, sink, writer);
+    sinkPut(sink, "}", 1);
 
+    deleteSink(sink);
     fclose(serialized);
 }
 
-char *findClosed(char *str, char opened, char closed) {
-    int depth = 0;
-    while (*str && (*str != closed || depth > 1)) {
-        if (*str == opened)
-            depth++;
-        else if (*str == closed)
-            depth--;
-        str++;
-    }
-
-    return str;
-}
+/**
+ * Function that parses tree serialized by treeSerialize in a single left-to-right pass. Input is not modified
+ * @param serialized Pointer to serialized tree, does not have to be null-terminated
+ * @param length Length of serialized tree in bytes
+ * @param deserializeValue Function that deserializes value. Gets a temporary null-terminated copy of the value
+ * @param errorOffset Optional pointer to store byte offset of the first error
+ * @param pooled Whether nodes of the new tree are taken from a node pool
+ * @return Pointer to restored tree or nullptr on error
+ */
 
-void nodeDeserialize(tree_t *tree, node_t *node, char *serialized, void *(*deserializeValue)(char *)) {
-    assert(node);
+tree_t *treeParse(const char *serialized, size_t length, void *(*deserializeValue)(char *), size_t *errorOffset,
+                  bool pooled) {
     assert(serialized);
+    assert(deserializeValue);
 
-    serialized = strchr(serialized, '"') + 1;
-    char *end = strchr(serialized, '"');
-    *end = '\0';
-    void *value = deserializeValue(serialized);
-    node->value = value;
-    serialized = end + 1;
-
-    char *leftSkip = strchr(serialized, '$');
+    copyingValueHandler_t handler = {deserializeValue, nullptr, 0};
+    tree_t *restored = parseTree(serialized, length, handler, pooled, errorOffset);
 
-    serialized = strchr(serialized, '{');
-    if (!serialized)
-        return;
+    countedFree(handler.buffer);
+    return restored;
+}
 
-    end = findClosed(serialized, '{', '}');
-    if (!end)
-        return;
+/**
+ * Function that parses tree serialized by treeSerialize without copying or modifying input
+ * @param serialized Pointer to serialized tree, does not have to be null-terminated
+ * @param length Length of serialized tree in bytes
+ * @param deserializeValue Function that deserializes value. Gets value position and length inside the input
+ * @param errorOffset Optional pointer to store byte offset of the first error
+ * @param pooled Whether nodes of the new tree are taken from a node pool
+ * @return Pointer to restored tree or nullptr on error
+ */
 
-    serialized++;
-    *end = '\0';
+tree_t *treeParse(const char *serialized, size_t length, void *(*deserializeValue)(const char *, size_t),
+                  size_t *errorOffset, bool pooled) {
+    assert(serialized);
+    assert(deserializeValue);
 
+    viewValueHandler_t handler = {deserializeValue};
+    return parseTree(serialized, length, handler, pooled, errorOffset);
+}
 
-    if (leftSkip >= serialized || !leftSkip) {
-        node->left = makeNode(node, nullptr, nullptr, nullptr);
-        tree->size++;
-        nodeDeserialize(tree, node->left, serialized, deserializeValue);
+/**
+ * Function that deserializes tree. Values are null-terminated in place, so the buffer is modified
+ * @param serialized Null-terminated serialized tree
+ * @param deserializeValue Function that deserializes value. Gets a pointer into the serialized buffer
+ * @param pooled Whether nodes of the new tree are taken from a node pool
+ * @return Pointer to restored tree or nullptr if input is malformed
+ */
 
+tree_t *treeDeserialize(char *serialized, void *(*deserializeValue)(char *), bool pooled) {
+    assert(serialized);
+    assert(deserializeValue);
 
-        serialized = end + 1;
+    inPlaceValueHandler_t handler = {deserializeValue};
+    return parseTree(serialized, strlen(serialized), handler, pooled, nullptr);
+}
 
-        serialized = strchr(serialized, '{');
-        if (!serialized)
-            return;
+/**
+ * Function that parses tree serialized by treeSerialize on several threads without copying or modifying input
+ * @param serialized Pointer to serialized tree, does not have to be null-terminated
+ * @param length Length of serialized tree in bytes
+ * @param deserializeValue Function that deserializes value, called concurrently. Gets value position and length
+ * @param errorOffset Optional pointer to store byte offset of the first error
+ * @param threads Number of threads, 0 for the number of hardware threads
+ * @return Pointer to restored pooled tree or nullptr on error
+ */
 
-        end = findClosed(serialized, '{', '}');
-        if (!end)
-            return;
+tree_t *treeParseParallel(const char *serialized, size_t length, void *(*deserializeValue)(const char *, size_t),
+                          size_t *errorOffset, size_t threads) {
+    assert(serialized);
+    assert(deserializeValue);
 
-        serialized++;
-        *end = '\0';
-    }
-    node->right = makeNode(node, nullptr, nullptr, nullptr);
-    tree->size++;
-    nodeDeserialize(tree, node->right, serialized, deserializeValue);
+    viewValueHandler_t handler = {deserializeValue};
+    return parseTreeParallel(serialized, length, handler, errorOffset, threads);
 }
 
-tree_t *treeDeserialize(char *serialized, void *(*deserializeValue)(char *)) {
+/**
+ * Function that deserializes tree on several threads. Values are null-terminated in place, so the buffer is modified
+ * @param serialized Null-terminated serialized tree
+ * @param deserializeValue Function that deserializes value, called concurrently. Gets a pointer into the buffer
+ * @param threads Number of threads, 0 for the number of hardware threads
+ * @return Pointer to restored pooled tree or nullptr if input is malformed
+ */
+
+tree_t *treeDeserializeParallel(char *serialized, void *(*deserializeValue)(char *), size_t threads) {
     assert(serialized);
     assert(deserializeValue);
-    tree_t *restored = makeTree(nullptr);
-
-    serialized = strchr(serialized, '{') + 1;
-    char *end = strrchr(serialized, '}');
-    *end = '\0';
 
-    nodeDeserialize(restored, restored->head, serialized, deserializeValue);
-    return restored;
-}
\ No newline at end of file
+    inPlaceValueHandler_t handler = {deserializeValue};
+    return parseTreeParallel(serialized, strlen(serialized), handler, nullptr, threads);
+}
@@ -8,6 +8,13 @@
 #include<cstdio>
 #include<cassert>
 #include<cstring>
+#include<cstdint>
+
+enum VALUE_CODEC {
+    INT_CODEC,
+    DOUBLE_CODEC,
+    STRING_CODEC
+};
 
 enum DIRECTION {
     HEAD,
@@ -20,11 +27,105 @@ struct node_t {
     node_t *right;
     node_t *parent;
     void *value;
+#ifdef TREE_AUGMENT
+    size_t subtreeSize;
+    size_t height;
+#endif
+};
+
+const char BINARY_MAGIC[4] = {'T', 'R', 'E', 'B'};
+
+const size_t POOL_FIRST_CHUNK = 64;
+const size_t POOL_MAX_CHUNK = 65536;
+
+struct nodeChunk_t {
+    nodeChunk_t *next;
+    size_t capacity;
+    size_t used;
+};
+
+struct nodePool_t {
+    nodeChunk_t *chunks;
+    node_t *freeList;
+    size_t maxChunk;
+    size_t chunkCount;
+    size_t nodesAllocated;
+    size_t nodesFreed;
+    size_t owners;
 };
 
+const size_t ARENA_FIRST_CHUNK = 4096;
+const size_t ARENA_MAX_CHUNK = 1 << 20;
+
+struct arenaChunk_t {
+    arenaChunk_t *next;
+    size_t capacity;
+    size_t used;
+};
+
+struct valueArena_t {
+    arenaChunk_t *chunks;
+    size_t maxChunk;
+    size_t chunkCount;
+    size_t bytesUsed;
+    size_t owners;
+};
+
+struct serialCache_t;
+
+struct lazySource_t;
+
 struct tree_t {
     node_t *head;
     size_t size;
+    nodePool_t *pool;
+    serialCache_t *cache;
+    valueArena_t *arena;
+    lazySource_t *lazy;
+};
+
+const uintptr_t LAZY_TAG = 1;
+const size_t LAZY_STUB_BYTES = 4096;
+
+struct mappedFile_t {
+    const char *data;
+    size_t length;
+};
+
+enum SINK_KIND {
+    FILE_SINK,
+    FD_SINK,
+    MEMORY_SINK
+};
+
+const size_t SINK_BUFFER_SIZE = 1 << 20;
+
+struct outputSink_t {
+    SINK_KIND kind;
+    FILE *file;
+    int fd;
+    char *buffer;
+    size_t used;
+    size_t capacity;
+    bool failed;
+};
+
+struct allocStats_t {
+    size_t allocCalls;
+    size_t freeCalls;
+    size_t bytesAllocated;
+};
+
+const size_t SERIAL_FRAGMENT_BYTES = 4096;
+
+const size_t DUMP_UNLIMITED = (size_t) -1;
+const size_t DUMP_COUNT_LIMIT = 1000;
+
+struct dumpOptions_t {
+    node_t *root;
+    size_t maxDepth;
+    size_t maxNodes;
+    size_t (*writeValue)(void *, char *, size_t);
 };
 
 node_t *makeNode(node_t *parent, node_t *left, node_t *right, void *value);
@@ -35,8 +136,54 @@ node_t *getRightNode(node_t *node);
 
 tree_t *makeTree(void *headValue);
 
+tree_t *makePooledTree(void *headValue, size_t maxChunk = POOL_MAX_CHUNK);
+
+tree_t *adoptTree(node_t *head, size_t size, nodePool_t *pool = nullptr);
+
+nodePool_t *makeNodePool(size_t maxChunk = POOL_MAX_CHUNK);
+
+node_t *poolMakeNode(nodePool_t *pool, node_t *parent, node_t *left, node_t *right, void *value);
+
+node_t *poolTakeNodes(nodePool_t *pool, size_t count);
+
+void poolFreeNode(nodePool_t *pool, node_t *node);
+
+void poolMerge(nodePool_t *pool, nodePool_t *source);
+
+void deleteNodePool(nodePool_t *pool);
+
+valueArena_t *makeValueArena(size_t maxChunk = ARENA_MAX_CHUNK);
+
+void *arenaAlloc(valueArena_t *arena, size_t size);
+
+char *arenaCopyString(valueArena_t *arena, const char *string, size_t length);
+
+void arenaMerge(valueArena_t *arena, valueArena_t *source);
+
+void deleteValueArena(valueArena_t *arena);
+
+void *treeAllocValue(tree_t *tree, size_t size);
+
+node_t *treeMakeNode(tree_t *tree, node_t *parent, node_t *left, node_t *right, void *value);
+
+void *countedCalloc(size_t count, size_t size);
+
+void *countedMalloc(size_t size);
+
+void *countedRealloc(void *ptr, size_t size);
+
+void *countedAlignedAlloc(size_t align, size_t size);
+
+void countedFree(void *ptr);
+
+allocStats_t getAllocStats();
+
+void resetAllocStats();
+
 void deleteNode(node_t *node);
 
+void deleteNode(tree_t *tree, node_t *node);
+
 void deleteTree(tree_t *tree);
 
 void addLeftNode(tree_t *tree, node_t *node, void *value);
@@ -47,6 +194,20 @@ void addRightNode(tree_t *tree, node_t *node, void *value);
 
 void addRightNode(node_t *node, node_t *existingNode);
 
+void addLeftSubtree(tree_t *tree, node_t *node, tree_t *subtree);
+
+void addRightSubtree(tree_t *tree, node_t *node, tree_t *subtree);
+
+tree_t *detachSubtree(tree_t *tree, node_t *node);
+
+size_t nodeSubtreeSize(node_t *node);
+
+size_t nodeSubtreeHeight(node_t *node);
+
+void nodeAugmentPath(node_t *node);
+
+void treeAugment(node_t *root);
+
 void treeDump(tree_t *tree, char *filename, char *(*valueDump)(void *) = nullptr);
 
 void nodeDump(node_t *node, FILE *dumpFile, DIRECTION dir);
@@ -57,5 +218,176 @@ void treeSerialize(tree_t *tree, char *filename, char *(serializeValue)(void *))
 
 void nodeSerialize(node_t *node, FILE *serialized, char *(serializeValue)(void *));
 
-tree_t *treeDeserialize(char *serialized, void *(*deserializeValue)(char *));
+outputSink_t *makeFileSink(FILE *file, size_t bufferSize = SINK_BUFFER_SIZE);
+
+outputSink_t *makeFdSink(int fd, size_t bufferSize = SINK_BUFFER_SIZE);
+
+outputSink_t *makeMemorySink(size_t initialCapacity = 4096);
+
+void sinkMakeRoom(outputSink_t *sink, size_t length);
+
+void sinkWrite(outputSink_t *sink, const char *data, size_t length);
+
+bool sinkFlush(outputSink_t *sink);
+
+const char *sinkData(const outputSink_t *sink, size_t *length);
+
+void sinkReset(outputSink_t *sink);
+
+char *sinkRelease(outputSink_t *sink, size_t *length);
+
+bool deleteSink(outputSink_t *sink);
+
+void nodeSerialize(node_t *node, outputSink_t *sink, size_t (*writeValue)(void *, char *, size_t));
+
+bool treeSerialize(tree_t *tree, outputSink_t *sink, size_t (*writeValue)(void *, char *, size_t));
+
+char *treeSerializeToMemory(tree_t *tree, size_t (*writeValue)(void *, char *, size_t), size_t *length);
+
+void treeEnableSerialCache(tree_t *tree, size_t (*writeValue)(void *, char *, size_t),
+                           size_t fragmentBytes = SERIAL_FRAGMENT_BYTES);
+
+void treeDisableSerialCache(tree_t *tree);
+
+void treeMarkDirty(tree_t *tree, node_t *node);
+
+bool treeSerializeIncremental(tree_t *tree, outputSink_t *sink);
+
+bool treeDumpCompact(tree_t *tree, outputSink_t *sink, const dumpOptions_t *options = nullptr);
+
+bool treeDumpCompact(tree_t *tree, const char *filename, const dumpOptions_t *options = nullptr);
+
+bool treeSerializeParallel(tree_t *tree, outputSink_t *sink, size_t (*writeValue)(void *, char *, size_t),
+                           size_t threads = 0);
+
+bool treeSerializeParallel(tree_t *tree, const char *filename, size_t (*writeValue)(void *, char *, size_t),
+                           size_t threads = 0);
+
+size_t writeIntValue(void *value, char *buffer, size_t capacity);
+
+size_t writeDoubleValue(void *value, char *buffer, size_t capacity);
+
+size_t writeStringValue(void *value, char *buffer, size_t capacity);
+
+bool treeSerialize(tree_t *tree, outputSink_t *sink, VALUE_CODEC codec);
+
+tree_t *treeParse(const char *serialized, size_t length, VALUE_CODEC codec, size_t *errorOffset = nullptr,
+                  bool pooled = false);
+
+tree_t *treeParse(const char *serialized, size_t length, void *(*deserializeValue)(char *), size_t *errorOffset = nullptr,
+                  bool pooled = false);
+
+tree_t *treeParse(const char *serialized, size_t length, void *(*deserializeValue)(const char *, size_t),
+                  size_t *errorOffset = nullptr, bool pooled = false);
+
+tree_t *treeFromPreorderBits(const uint8_t *bits, size_t bitCount, void *const *values, size_t valueCount,
+                             size_t *errorOffset = nullptr);
+
+tree_t *treeFromLevelOrder(void *const *values, size_t count, size_t *errorOffset = nullptr);
+
+tree_t *treeFromLevelOrder(void *const *values, const uint8_t *present, size_t count, size_t *errorOffset = nullptr);
+
+uint8_t *treeToPreorderBits(tree_t *tree, size_t *bitCount);
+
+tree_t *treeDeserialize(char *serialized, void *(*deserializeValue)(char *), bool pooled = false);
+
+tree_t *treeParseLazy(const char *serialized, size_t length, void *(*deserializeValue)(const char *, size_t),
+                      size_t *errorOffset = nullptr, size_t stubBytes = LAZY_STUB_BYTES);
+
+tree_t *treeDeserializeLazy(char *serialized, void *(*deserializeValue)(char *), size_t stubBytes = LAZY_STUB_BYTES);
+
+node_t *lazyExpandChild(node_t *node, DIRECTION dir);
+
+void treeExpandAll(tree_t *tree);
+
+void deleteLazySource(lazySource_t *source);
+
+tree_t *treeParseParallel(const char *serialized, size_t length, void *(*deserializeValue)(const char *, size_t),
+                          size_t *errorOffset = nullptr, size_t threads = 0);
+
+tree_t *treeDeserializeParallel(char *serialized, void *(*deserializeValue)(char *), size_t threads = 0);
+
+bool treeSerializeBinary(tree_t *tree, char *filename, char *(serializeValue)(void *));
+
+bool treeSerializeBinary(tree_t *tree, outputSink_t *sink, size_t (*writeValue)(void *, char *, size_t));
+
+tree_t *treeDeserializeBinary(const char *data, size_t length, void *(*deserializeValue)(char *), bool pooled = false);
+
+tree_t *treeDeserializeBinary(const char *data, size_t length, void *(*deserializeValue)(const char *, size_t),
+                              bool pooled = false);
+
+tree_t *treeDeserializeBinary(const char *data, size_t length, VALUE_CODEC codec, bool pooled = false);
+
+tree_t *treeDeserializeBinaryParallel(const char *data, size_t length,
+                                      void *(*deserializeValue)(const char *, size_t), size_t threads = 0);
+
+bool serializedToBinary(const char *serialized, size_t length, char *filename, size_t *errorOffset = nullptr);
+
+bool binaryToSerialized(const char *data, size_t length, char *filename);
+
+mappedFile_t *mapFile(const char *filename);
+
+void unmapFile(mappedFile_t *file);
+
+tree_t *treeLoadMapped(const mappedFile_t *file, void *(*deserializeValue)(const char *, size_t),
+                       size_t *errorOffset = nullptr, bool pooled = false);
+
+tree_t *treeLoad(const char *filename, void *(*deserializeValue)(const char *, size_t), size_t *errorOffset = nullptr,
+                 bool pooled = false);
+
+tree_t *treeLoad(const char *filename, VALUE_CODEC codec, size_t *errorOffset = nullptr, bool pooled = false);
+
+tree_t *treeLoadLazy(const char *filename, void *(*deserializeValue)(const char *, size_t),
+                     size_t *errorOffset = nullptr, size_t stubBytes = LAZY_STUB_BYTES);
+
+tree_t *treeLoadParallel(const char *filename, void *(*deserializeValue)(const char *, size_t),
+                         size_t *errorOffset = nullptr, size_t threads = 0);
+
+/**
+ * Function that stores integer right in the value slot, INT_CODEC values are made this way. intValue(0) is nullptr,
+ * so level-order arrays of such values mark holes with presence bitmap
+ * @param number Integer
+ * @return Value for node_t::value
+ */
+
+inline void *intValue(int64_t number) {
+    static_assert(sizeof(void *) >= sizeof(int64_t), "integer values need 64-bit pointers");
+    return (void *) (intptr_t) number;
+}
+
+/**
+ * Function that reads integer stored by intValue
+ * @param value Value of node
+ * @return Integer
+ */
+
+inline int64_t valueToInt(void *value) {
+    return (int64_t) (intptr_t) value;
+}
+
+/**
+ * Function that stores double right in the value slot, DOUBLE_CODEC values are made this way
+ * @param number Double
+ * @return Value for node_t::value
+ */
+
+inline void *doubleValue(double number) {
+    static_assert(sizeof(void *) >= sizeof(double), "double values need 64-bit pointers");
+    uintptr_t bits = 0;
+    memcpy(&bits, &number, sizeof(number));
+    return (void *) bits;
+}
+
+/**
+ * Function that reads double stored by doubleValue
+ * @param value Value of node
+ * @return Double
+ */
+
+inline double valueToDouble(void *value) {
+    auto bits = (uintptr_t) value;
+    double number = 0;
+    memcpy(&number, &bits, sizeof(number));
+    return number;
+}
 #endif //TREE_TREE_H
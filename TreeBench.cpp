@@ -0,0 +1,588 @@
+//
+// Created by alexey on 17.10.2026.
+//
+
+/*
+ * TreeBench times every Tree.h operation on generated trees and prints results as JSON:
+ *
+ *     TreeBench [--nodes N] [--repeat R] [--shape balanced|degenerate|random|bushy|all] [--threads T] [--dir D]
+ *
+ * Every operation runs R times, the best run is reported. Allocation counters cover the library only, values are
+ * pointers into a static array, so callbacks never allocate. Peak RSS is the peak of the whole process so far.
+ */
+
+#include "Tree.h"
+#include "TreeConcurrent.h"
+#include "TreeIterators.h"
+#include "TreeParallel.h"
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <sys/resource.h>
+#include <thread>
+
+enum BENCH_SHAPE {
+    BALANCED_SHAPE,
+    DEGENERATE_SHAPE,
+    RANDOM_SHAPE,
+    BUSHY_SHAPE,
+    SHAPE_COUNT
+};
+
+static const char *SHAPE_NAMES[SHAPE_COUNT] = {"balanced", "degenerate", "random", "bushy"};
+
+enum BENCH_OPERATION {
+    BUILD_OP,
+    BUILD_POOLED_OP,
+    BUILD_CONCURRENT_OP,
+    BUILD_BULK_OP,
+    PREORDER_OP,
+    SERIALIZE_OP,
+    SERIALIZE_PARALLEL_OP,
+    DESERIALIZE_OP,
+    PARSE_OP,
+    PARSE_PARALLEL_OP,
+    PARSE_CODEC_OP,
+    PARSE_LAZY_OP,
+    SERIALIZE_BINARY_OP,
+    DESERIALIZE_BINARY_OP,
+    DESERIALIZE_BINARY_PARALLEL_OP,
+    LOAD_OP,
+    DUMP_OP,
+    OPERATION_COUNT
+};
+
+static const char *OPERATION_NAMES[OPERATION_COUNT] = {
+        "build", "buildPooled", "buildConcurrent", "buildBulk", "preorder", "serialize", "serializeParallel",
+        "deserialize", "parse", "parseParallel", "parseCodec", "parseLazy", "serializeBinary", "deserializeBinary",
+        "deserializeBinaryParallel", "load", "dump"
+};
+
+struct benchStep_t {
+    size_t parent;
+    DIRECTION dir;
+};
+
+struct benchConfig_t {
+    size_t nodes;
+    size_t repeat;
+    size_t threads;
+    int shape;
+    const char *dir;
+};
+
+struct benchResult_t {
+    double seconds;
+    size_t outputBytes;
+    allocStats_t allocs;
+};
+
+struct benchState_t {
+    const benchConfig_t *config;
+    const benchStep_t *plan;
+    tree_t *tree;
+    char *text;
+    size_t textLength;
+    char *binary;
+    size_t binaryLength;
+    uint8_t *bits;
+    size_t bitCount;
+    void **preorderValues;
+    char textFile[4096];
+    char binaryFile[4096];
+    char dumpFile[4096];
+    bool first;
+};
+
+static size_t *values = nullptr;
+
+/**
+ * Function that generates order of node creation for the shape. Node i is attached to plan[i].parent, node 0 is head
+ * @param shape Tree shape
+ * @param nodes Number of nodes
+ * @return Pointer to calloc'ed plan
+ */
+
+static benchStep_t *makePlan(BENCH_SHAPE shape, size_t nodes) {
+    auto *plan = (benchStep_t *) calloc(nodes, sizeof(benchStep_t));
+    assert(plan);
+    srand(1);
+
+    if (shape == BALANCED_SHAPE) {
+        for (size_t index = 1; index < nodes; index++)
+            plan[index] = {(index - 1) / 2, index % 2 ? LEFT : RIGHT};
+    } else if (shape == DEGENERATE_SHAPE) {
+        for (size_t index = 1; index < nodes; index++)
+            plan[index] = {index - 1, LEFT};
+    } else if (shape == RANDOM_SHAPE) {
+        // Every free child slot is equally likely to get the next node
+        auto *slots = (benchStep_t *) calloc(nodes * 2 + 2, sizeof(benchStep_t));
+        size_t slotCount = 0;
+        slots[slotCount++] = {0, LEFT};
+        slots[slotCount++] = {0, RIGHT};
+
+        for (size_t index = 1; index < nodes; index++) {
+            size_t slot = ((size_t) rand() * RAND_MAX + rand()) % slotCount;
+            plan[index] = slots[slot];
+            slots[slot] = slots[--slotCount];
+            slots[slotCount++] = {index, LEFT};
+            slots[slotCount++] = {index, RIGHT};
+        }
+        free(slots);
+    } else {
+        // Every node with at least two descendants gets both children, remaining nodes are split at random
+        struct bushyTask_t {
+            size_t node;
+            size_t size;
+        };
+
+        auto *stack = (bushyTask_t *) calloc(nodes + 1, sizeof(bushyTask_t));
+        size_t stackSize = 0;
+        size_t created = 1;
+        stack[stackSize++] = {0, nodes};
+
+        while (stackSize) {
+            bushyTask_t task = stack[--stackSize];
+            size_t rest = task.size - 1;
+            if (!rest)
+                continue;
+
+            size_t leftSize = rest == 1 ? 1 : 1 + (size_t) rand() % (rest - 1);
+            size_t rightSize = rest - leftSize;
+
+            size_t left = created++;
+            plan[left] = {task.node, LEFT};
+            if (rightSize) {
+                size_t right = created++;
+                plan[right] = {task.node, RIGHT};
+                stack[stackSize++] = {right, rightSize};
+            }
+            stack[stackSize++] = {left, leftSize};
+        }
+        free(stack);
+    }
+
+    return plan;
+}
+
+/**
+ * Function that builds tree by the plan
+ * @param plan Pointer to plan
+ * @param nodes Number of nodes
+ * @param pooled Whether tree uses node pool
+ * @return Pointer to tree_t
+ */
+
+static tree_t *buildTree(const benchStep_t *plan, size_t nodes, bool pooled) {
+    auto *created = (node_t **) malloc(nodes * sizeof(node_t *));
+    assert(created);
+
+    tree_t *tree = pooled ? makePooledTree(&values[0]) : makeTree(&values[0]);
+    created[0] = tree->head;
+
+    for (size_t index = 1; index < nodes; index++) {
+        node_t *parent = created[plan[index].parent];
+        if (plan[index].dir == LEFT) {
+            addLeftNode(tree, parent, &values[index]);
+            created[index] = parent->left;
+        } else {
+            addRightNode(tree, parent, &values[index]);
+            created[index] = parent->right;
+        }
+    }
+
+    free(created);
+    return tree;
+}
+
+const size_t CONCURRENT_BUILD_BATCH = 4096;
+
+struct concurrentBuild_t {
+    const benchStep_t *plan;
+    size_t nodes;
+    concurrentTree_t *tree;
+    std::atomic<node_t *> *created;
+};
+
+/**
+ * Task of buildTreeConcurrent: attaches one batch of plan nodes, waiting for parents that other writers attach
+ * @param batch Batch index
+ * @param context Pointer to concurrentBuild_t
+ */
+
+static void buildBatch(size_t batch, void *context) {
+    auto *build = (concurrentBuild_t *) context;
+    size_t last = (batch + 1) * CONCURRENT_BUILD_BATCH;
+    if (last > build->nodes)
+        last = build->nodes;
+
+    for (size_t index = batch * CONCURRENT_BUILD_BATCH; index < last; index++) {
+        if (!index)
+            continue;
+
+        // Parents come earlier in the plan, batches are taken in order, so the wait is short
+        node_t *parent = nullptr;
+        while (!(parent = build->created[build->plan[index].parent].load(std::memory_order_acquire)))
+            std::this_thread::yield();
+
+        node_t *child = build->plan[index].dir == LEFT ? concurrentAddLeftNode(build->tree, parent, &values[index])
+                                                       : concurrentAddRightNode(build->tree, parent, &values[index]);
+        build->created[index].store(child, std::memory_order_release);
+    }
+}
+
+/**
+ * Function that builds tree by the plan with several writer threads
+ * @param plan Pointer to plan
+ * @param nodes Number of nodes
+ * @param threads Number of writers, 0 for the number of hardware threads
+ * @return Pointer to tree_t, nullptr if some slot has been attached twice
+ */
+
+static tree_t *buildTreeConcurrent(const benchStep_t *plan, size_t nodes, size_t threads) {
+    auto *created = new std::atomic<node_t *>[nodes]();
+    tree_t *tree = makeTree(&values[0]);
+    created[0] = tree->head;
+
+    concurrentBuild_t build = {plan, nodes, beginConcurrent(tree), created};
+    parallelRun((nodes + CONCURRENT_BUILD_BATCH - 1) / CONCURRENT_BUILD_BATCH, buildBatch, &build, threads);
+    size_t conflicts = endConcurrent(build.tree);
+
+    delete[] created;
+    if (conflicts) {
+        deleteTree(tree);
+        return nullptr;
+    }
+
+    return tree;
+}
+
+static size_t writeValue(void *value, char *buffer, size_t capacity) {
+    char digits[24];
+    int length = snprintf(digits, sizeof(digits), "%zu", *(size_t *) value);
+    if ((size_t) length <= capacity)
+        memcpy(buffer, digits, length);
+
+    return length;
+}
+
+static char *serializeValue(void *value) {
+    static char digits[24];
+    snprintf(digits, sizeof(digits), "%zu", *(size_t *) value);
+    return digits;
+}
+
+static char *dumpValue(void *value) {
+    static char label[48];
+    snprintf(label, sizeof(label), "{VALUE | %zu}", *(size_t *) value);
+    return label;
+}
+
+static void *viewValue(const char *value, size_t length) {
+    size_t index = 0;
+    for (size_t pos = 0; pos < length; pos++)
+        index = index * 10 + (value[pos] - '0');
+
+    return &values[index];
+}
+
+static void *stringValue(char *value) {
+    return &values[strtoull(value, nullptr, 10)];
+}
+
+static size_t fileSize(const char *filename) {
+    FILE *file = fopen(filename, "rb");
+    if (!file)
+        return 0;
+
+    fseek(file, 0, SEEK_END);
+    long size = ftell(file);
+    fclose(file);
+    return size < 0 ? 0 : (size_t) size;
+}
+
+static size_t peakRss() {
+    rusage usage = {};
+    getrusage(RUSAGE_SELF, &usage);
+    return (size_t) usage.ru_maxrss;
+}
+
+static double now() {
+    return std::chrono::duration<double>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+/**
+ * Function that runs one measured operation. Setup and cleanup happen outside of the measured interval
+ * @param state Pointer to benchState_t
+ * @param operation Operation to run
+ * @param result Pointer to benchResult_t to store measurement, build operations store deletion measurement next to it
+ * @return false if operation has failed
+ */
+
+static bool runOperation(benchState_t *state, BENCH_OPERATION operation, benchResult_t *result) {
+    const benchConfig_t *config = state->config;
+    tree_t *tree = state->tree;
+    tree_t *restored = nullptr;
+    char *copy = nullptr;
+    bool ok = true;
+
+    if (operation == DESERIALIZE_OP) {
+        copy = (char *) malloc(state->textLength + 1);
+        memcpy(copy, state->text, state->textLength);
+        copy[state->textLength] = '\0';
+    }
+
+    resetAllocStats();
+    double start = now();
+
+    switch (operation) {
+        case BUILD_OP:
+            restored = buildTree(state->plan, config->nodes, false);
+            break;
+        case BUILD_POOLED_OP:
+            restored = buildTree(state->plan, config->nodes, true);
+            break;
+        case BUILD_CONCURRENT_OP:
+            restored = buildTreeConcurrent(state->plan, config->nodes, config->threads);
+            break;
+        case BUILD_BULK_OP:
+            restored = treeFromPreorderBits(state->bits, state->bitCount, state->preorderValues, config->nodes);
+            break;
+        case PREORDER_OP: {
+            size_t sum = 0;
+            for (node_t *node : preorder(tree))
+                sum += *(size_t *) node->value;
+            ok = sum == config->nodes * (config->nodes - 1) / 2;
+            break;
+        }
+        case SERIALIZE_OP:
+            treeSerialize(tree, state->textFile, serializeValue);
+            break;
+        case SERIALIZE_PARALLEL_OP:
+            ok = treeSerializeParallel(tree, state->textFile, writeValue, config->threads);
+            break;
+        case DESERIALIZE_OP:
+            restored = treeDeserialize(copy, stringValue, true);
+            break;
+        case PARSE_OP:
+            restored = treeParse(state->text, state->textLength, viewValue, nullptr, true);
+            break;
+        case PARSE_PARALLEL_OP:
+            restored = treeParseParallel(state->text, state->textLength, viewValue, nullptr, config->threads);
+            break;
+        case PARSE_CODEC_OP:
+            restored = treeParse(state->text, state->textLength, INT_CODEC, nullptr, true);
+            break;
+        case PARSE_LAZY_OP:
+            restored = treeParseLazy(state->text, state->textLength, viewValue);
+            break;
+        case SERIALIZE_BINARY_OP:
+            ok = treeSerializeBinary(tree, state->binaryFile, serializeValue);
+            break;
+        case DESERIALIZE_BINARY_OP:
+            restored = treeDeserializeBinary(state->binary, state->binaryLength, viewValue, true);
+            break;
+        case DESERIALIZE_BINARY_PARALLEL_OP:
+            restored = treeDeserializeBinaryParallel(state->binary, state->binaryLength, viewValue, config->threads);
+            break;
+        case LOAD_OP:
+            restored = treeLoad(state->textFile, viewValue, nullptr, true);
+            break;
+        case DUMP_OP:
+            treeDump(tree, state->dumpFile, dumpValue);
+            break;
+        default:
+            break;
+    }
+
+    result->seconds = now() - start;
+    result->allocs = getAllocStats();
+    result->outputBytes = 0;
+
+    if (operation == SERIALIZE_OP || operation == SERIALIZE_PARALLEL_OP)
+        result->outputBytes = fileSize(state->textFile);
+    else if (operation == SERIALIZE_BINARY_OP)
+        result->outputBytes = fileSize(state->binaryFile);
+    else if (operation == DUMP_OP)
+        result->outputBytes = fileSize(state->dumpFile);
+
+    bool builds = operation == BUILD_OP || operation == BUILD_POOLED_OP;
+    bool restores = builds || operation == BUILD_CONCURRENT_OP || operation == BUILD_BULK_OP ||
+                    operation == DESERIALIZE_OP || operation == PARSE_OP || operation == PARSE_PARALLEL_OP ||
+                    operation == PARSE_CODEC_OP || operation == PARSE_LAZY_OP || operation == DESERIALIZE_BINARY_OP ||
+                    operation == DESERIALIZE_BINARY_PARALLEL_OP || operation == LOAD_OP;
+    if (restores && (!restored || restored->size + 1 != config->nodes))
+        ok = false;
+
+    if (restored) {
+        // Deletion of freshly built trees is measured as operations of its own
+        resetAllocStats();
+        double deleteStart = now();
+        deleteTree(restored);
+        if (builds) {
+            result[1].seconds = now() - deleteStart;
+            result[1].allocs = getAllocStats();
+            result[1].outputBytes = 0;
+        }
+    }
+
+    free(copy);
+    return ok;
+}
+
+/**
+ * Function that prints one JSON result record
+ * @param state Pointer to benchState_t
+ * @param shape Tree shape
+ * @param name Operation name
+ * @param result Best result
+ * @param ok Whether operation has succeeded every time
+ */
+
+static void printResult(benchState_t *state, BENCH_SHAPE shape, const char *name, const benchResult_t *result,
+                        bool ok) {
+    double nodes = (double) state->config->nodes;
+
+    printf("%s\n    {\"shape\": \"%s\", \"operation\": \"%s\", \"ok\": %s, \"seconds\": %.6f, \"nsPerNode\": %.3f, "
+           "\"bytesPerNode\": %.3f, \"outputBytesPerNode\": %.3f, \"allocCalls\": %zu, \"freeCalls\": %zu, "
+           "\"bytesAllocated\": %zu, \"peakRssKb\": %zu}",
+           state->first ? "" : ",", SHAPE_NAMES[shape], name, ok ? "true" : "false", result->seconds,
+           result->seconds * 1e9 / nodes, (double) result->allocs.bytesAllocated / nodes,
+           (double) result->outputBytes / nodes, result->allocs.allocCalls, result->allocs.freeCalls,
+           result->allocs.bytesAllocated, peakRss());
+    state->first = false;
+}
+
+/**
+ * Function that benchmarks every operation on one shape
+ * @param state Pointer to benchState_t
+ * @param shape Tree shape
+ */
+
+static void benchShape(benchState_t *state, BENCH_SHAPE shape) {
+    const benchConfig_t *config = state->config;
+    benchStep_t *plan = makePlan(shape, config->nodes);
+    state->plan = plan;
+    state->tree = buildTree(plan, config->nodes, false);
+    state->text = treeSerializeToMemory(state->tree, writeValue, &state->textLength);
+
+    outputSink_t *sink = makeMemorySink();
+    treeSerializeBinary(state->tree, sink, writeValue);
+    state->binary = sinkRelease(sink, &state->binaryLength);
+    deleteSink(sink);
+
+    treeSerialize(state->tree, state->textFile, serializeValue);
+    treeSerializeBinary(state->tree, state->binaryFile, serializeValue);
+
+    state->bits = treeToPreorderBits(state->tree, &state->bitCount);
+    state->preorderValues = (void **) malloc(config->nodes * sizeof(void *));
+    size_t visited = 0;
+    for (node_t *node : preorder(state->tree))
+        state->preorderValues[visited++] = node->value;
+
+    for (int index = 0; index < OPERATION_COUNT; index++) {
+        auto operation = (BENCH_OPERATION) index;
+        bool builds = operation == BUILD_OP || operation == BUILD_POOLED_OP;
+        benchResult_t best[2] = {};
+        bool ok = true;
+
+        for (size_t run = 0; run < config->repeat; run++) {
+            benchResult_t current[2] = {};
+            ok = runOperation(state, operation, current) && ok;
+
+            if (!run || current[0].seconds < best[0].seconds)
+                best[0] = current[0];
+            if (builds && (!run || current[1].seconds < best[1].seconds))
+                best[1] = current[1];
+        }
+
+        printResult(state, shape, OPERATION_NAMES[operation], &best[0], ok);
+        if (builds)
+            printResult(state, shape, operation == BUILD_POOLED_OP ? "deletePooled" : "delete", &best[1], ok);
+    }
+
+    deleteTree(state->tree);
+    free(state->text);
+    free(state->binary);
+    free(state->bits);
+    free(state->preorderValues);
+    free(plan);
+}
+
+/**
+ * Function that parses command line
+ * @param argc Number of arguments
+ * @param argv Arguments
+ * @param config Pointer to benchConfig_t to fill
+ * @return false if arguments are invalid
+ */
+
+static bool parseArguments(int argc, char **argv, benchConfig_t *config) {
+    for (int index = 1; index < argc; index++) {
+        if (index + 1 == argc)
+            return false;
+
+        const char *option = argv[index];
+        const char *argument = argv[++index];
+
+        if (!strcmp(option, "--nodes")) {
+            config->nodes = strtoull(argument, nullptr, 10);
+        } else if (!strcmp(option, "--repeat")) {
+            config->repeat = strtoull(argument, nullptr, 10);
+        } else if (!strcmp(option, "--threads")) {
+            config->threads = strtoull(argument, nullptr, 10);
+        } else if (!strcmp(option, "--dir")) {
+            config->dir = argument;
+        } else if (!strcmp(option, "--shape")) {
+            config->shape = -1;
+            for (int shape = 0; shape < SHAPE_COUNT; shape++)
+                if (!strcmp(argument, SHAPE_NAMES[shape]))
+                    config->shape = shape;
+            if (config->shape < 0 && strcmp(argument, "all") != 0)
+                return false;
+        } else {
+            return false;
+        }
+    }
+
+    return config->nodes >= 1 && config->repeat >= 1;
+}
+
+int main(int argc, char **argv) {
+    benchConfig_t config = {100000, 3, 0, -1, "."};
+    if (!parseArguments(argc, argv, &config)) {
+        fprintf(stderr, "usage: %s [--nodes N] [--repeat R] [--shape balanced|degenerate|random|bushy|all] "
+                        "[--threads T] [--dir D]\n", argv[0]);
+        return 1;
+    }
+
+    values = (size_t *) malloc(config.nodes * sizeof(size_t));
+    assert(values);
+    for (size_t index = 0; index < config.nodes; index++)
+        values[index] = index;
+
+    benchState_t state = {};
+    state.config = &config;
+    state.first = true;
+    snprintf(state.textFile, sizeof(state.textFile), "%s/treebench.txt", config.dir);
+    snprintf(state.binaryFile, sizeof(state.binaryFile), "%s/treebench.bin", config.dir);
+    snprintf(state.dumpFile, sizeof(state.dumpFile), "%s/treebench.dot", config.dir);
+
+    printf("{\n  \"nodes\": %zu,\n  \"repeat\": %zu,\n  \"threads\": %zu,\n  \"results\": [", config.nodes,
+           config.repeat, parallelThreads(config.threads));
+
+    for (int shape = 0; shape < SHAPE_COUNT; shape++)
+        if (config.shape < 0 || config.shape == shape)
+            benchShape(&state, (BENCH_SHAPE) shape);
+
+    printf("\n  ]\n}\n");
+
+    remove(state.textFile);
+    remove(state.binaryFile);
+    remove(state.dumpFile);
+    free(values);
+    return 0;
+}
@@ -0,0 +1,814 @@
+//
+// Created by alexey on 17.10.2026.
+//
+
+/*
+ * Binary snapshot format:
+ *
+ *     header   "TREB", version byte, 3 reserved bytes, node count as little-endian u64
+ *     shape    2 bits per node in preorder (bit 0 - has left child, bit 1 - has right child), LSB first
+ *     values   for every node in preorder: LEB128 length followed by value bytes
+ *
+ * Value bytes are exactly the characters that the text format keeps between quotes, which makes conversion
+ * between formats a plain copy.
+ */
+
+#include "Tree.h"
+#include "TreeCodec.h"
+#include "TreeIterators.h"
+#include "TreeParallel.h"
+#include "TreeParser.h"
+#include "TreeWriter.h"
+#include <cstdint>
+
+static const unsigned char BINARY_VERSION = 1;
+static const size_t BINARY_HEADER_SIZE = 16;
+
+struct binaryReader_t {
+    const unsigned char *shape;
+    const unsigned char *values;
+    const unsigned char *end;
+    size_t nodeCount;
+};
+
+struct binarySpan_t {
+    size_t first;
+    size_t end;
+    size_t depth;
+    const unsigned char *values;
+};
+
+struct shapeFrame_t {
+    size_t span;
+    size_t depth;
+    unsigned remaining;
+};
+
+struct binaryFrame_t {
+    node_t *node;
+    size_t end;
+    unsigned bits;
+    size_t children;
+};
+
+struct binaryTask_t {
+    binaryReader_t reader;
+    size_t first;
+    size_t end;
+    node_t *parent;
+    bool left;
+    viewValueHandler_t handleValue;
+    tree_t *subtree;
+};
+
+/**
+ * Function that writes binary header
+ * @param sink Pointer to outputSink_t
+ * @param nodeCount Number of nodes in tree
+ */
+
+static void writeHeader(outputSink_t *sink, size_t nodeCount) {
+    unsigned char header[BINARY_HEADER_SIZE] = {};
+    memcpy(header, BINARY_MAGIC, sizeof(BINARY_MAGIC));
+    header[4] = BINARY_VERSION;
+
+    for (int i = 0; i < 8; i++)
+        header[8 + i] = (unsigned char) (nodeCount >> (8 * i));
+
+    sinkPut(sink, (const char *) header, BINARY_HEADER_SIZE);
+}
+
+/**
+ * Function that encodes blob length as LEB128
+ * @param prefix Buffer of at least 10 bytes
+ * @param length Length of value
+ * @return Length of prefix
+ */
+
+static size_t encodeLength(char *prefix, size_t length) {
+    size_t prefixLength = 0;
+
+    do {
+        unsigned char byte = length & 0x7F;
+        length >>= 7;
+        prefix[prefixLength++] = (char) (length ? byte | 0x80 : byte);
+    } while (length);
+
+    return prefixLength;
+}
+
+/**
+ * Function that writes value blob with LEB128 length prefix
+ * @param sink Pointer to outputSink_t
+ * @param value Pointer to value bytes
+ * @param length Length of value
+ */
+
+static void writeBlob(outputSink_t *sink, const char *value, size_t length) {
+    char prefix[10];
+    size_t prefixLength = encodeLength(prefix, length);
+
+    sinkPut(sink, prefix, prefixLength);
+    sinkPut(sink, value, length);
+}
+
+/**
+ * Function that lets value writer write value blob right into the sink buffer
+ * @param sink Pointer to outputSink_t
+ * @param writeValue Value writer, see TreeWriter.h
+ * @param value Pointer to value
+ */
+
+template<typename ValueWriter>
+static void writeValueBlob(outputSink_t *sink, ValueWriter &writeValue, void *value) {
+    // Values shorter than 128 bytes have one byte prefix, so it can be filled in after the value is written
+    char *buffer = sinkReserve(sink, SINK_VALUE_RESERVE + 1);
+    size_t available = sink->capacity - sink->used - 1;
+    size_t length = writeValue(value, buffer + 1, available);
+
+    if (length < 0x80 && length <= available) {
+        buffer[0] = (char) length;
+        sinkCommit(sink, length + 1);
+        return;
+    }
+
+    char prefix[10];
+    size_t prefixLength = encodeLength(prefix, length);
+
+    buffer = sinkReserve(sink, prefixLength + length);
+    memcpy(buffer, prefix, prefixLength);
+    writeValue(value, buffer + prefixLength, length);
+    sinkCommit(sink, prefixLength + length);
+}
+
+/**
+ * Function that reads value blob with LEB128 length prefix
+ * @param reader Pointer to binaryReader_t, values position is moved past the blob
+ * @param value Pointer to store value bytes position
+ * @param length Pointer to store value length
+ * @return true on success
+ */
+
+static bool readBlob(binaryReader_t *reader, const char **value, size_t *length) {
+    size_t result = 0;
+    int shift = 0;
+
+    while (true) {
+        if (reader->values == reader->end || shift > 63)
+            return false;
+
+        unsigned char byte = *reader->values++;
+        result |= (size_t) (byte & 0x7F) << shift;
+        shift += 7;
+
+        if (!(byte & 0x80))
+            break;
+    }
+
+    if ((size_t) (reader->end - reader->values) < result)
+        return false;
+
+    *value = (const char *) reader->values;
+    *length = result;
+    reader->values += result;
+    return true;
+}
+
+/**
+ * Function that validates binary header and sets up reader
+ * @param data Pointer to binary snapshot
+ * @param length Length of snapshot in bytes
+ * @param reader Pointer to binaryReader_t to fill
+ * @return true if header is valid
+ */
+
+static bool openBinary(const char *data, size_t length, binaryReader_t *reader) {
+    auto *bytes = (const unsigned char *) data;
+
+    if (length < BINARY_HEADER_SIZE || memcmp(bytes, BINARY_MAGIC, sizeof(BINARY_MAGIC)) != 0 ||
+        bytes[4] != BINARY_VERSION)
+        return false;
+
+    size_t nodeCount = 0;
+    for (int i = 0; i < 8; i++)
+        nodeCount |= (size_t) bytes[8 + i] << (8 * i);
+
+    size_t shapeBytes = (nodeCount + 3) / 4;
+    if (nodeCount == 0 || nodeCount > length || length - BINARY_HEADER_SIZE < shapeBytes)
+        return false;
+
+    reader->nodeCount = nodeCount;
+    reader->shape = bytes + BINARY_HEADER_SIZE;
+    reader->values = reader->shape + shapeBytes;
+    reader->end = bytes + length;
+    return true;
+}
+
+/**
+ * Function that gets child presence bits of the node
+ * @param reader Pointer to binaryReader_t
+ * @param index Preorder index of the node
+ * @return Bit 0 is set if node has left child, bit 1 - if node has right child
+ */
+
+static inline unsigned shapeBits(const binaryReader_t *reader, size_t index) {
+    return (reader->shape[index / 4] >> (2 * (index % 4))) & 3u;
+}
+
+/**
+ * Function that writes shape bitstream of the tree
+ * @param tree Pointer to tree_t
+ * @param sink Pointer to outputSink_t
+ */
+
+static void writeShape(tree_t *tree, outputSink_t *sink) {
+    size_t nodeCount = 0;
+    for (node_t *node : preorder(tree)) {
+        (void) node;
+        nodeCount++;
+    }
+
+    writeHeader(sink, nodeCount);
+
+    unsigned char byte = 0;
+    size_t index = 0;
+    for (node_t *node : preorder(tree)) {
+        unsigned bits = (node->left ? 1u : 0u) | (node->right ? 2u : 0u);
+        byte |= bits << (2 * (index % 4));
+
+        if (index % 4 == 3) {
+            sinkPut(sink, (const char *) &byte, 1);
+            byte = 0;
+        }
+        index++;
+    }
+
+    if (index % 4)
+        sinkPut(sink, (const char *) &byte, 1);
+}
+
+/**
+ * Function that serializes tree into binary snapshot
+ * @param tree Pointer to tree_t
+ * @param filename Filename to write to
+ * @param serializeValue Function that serializes value
+ * @return true on success
+ */
+
+bool treeSerializeBinary(tree_t *tree, char *filename, char *(serializeValue)(void *)) {
+    assert(tree);
+    assert(filename);
+    assert(serializeValue);
+
+    treeExpandAll(tree);
+
+    FILE *out = fopen(filename, "wb");
+    if (!out)
+        return false;
+
+    outputSink_t *sink = makeFileSink(out);
+    stringValueWriter_t writer = {serializeValue, nullptr, nullptr};
+
+    writeShape(tree, sink);
+    for (node_t *node : preorder(tree))
+        writeValueBlob(sink, writer, node->value);
+
+    bool written = deleteSink(sink);
+    return fclose(out) == 0 && written;
+}
+
+/**
+ * Function that serializes tree into binary snapshot through sink. File and descriptor sinks are flushed afterwards
+ * @param tree Pointer to tree_t
+ * @param sink Pointer to outputSink_t
+ * @param writeValue Function that appends value to the buffer if it fits and returns value length
+ * @return false if any write has failed
+ */
+
+bool treeSerializeBinary(tree_t *tree, outputSink_t *sink, size_t (*writeValue)(void *, char *, size_t)) {
+    assert(tree);
+    assert(sink);
+    assert(writeValue);
+
+    treeExpandAll(tree);
+
+    functionValueWriter_t writer = {writeValue};
+
+    writeShape(tree, sink);
+    for (node_t *node : preorder(tree))
+        writeValueBlob(sink, writer, node->value);
+
+    return sinkFlush(sink);
+}
+
+/**
+ * Function that restores subtree made of a preorder range of nodes. Reader values position has to point at the
+ * blob of the first node of the range
+ * @param reader Pointer to binaryReader_t
+ * @param first Preorder index of the subtree root
+ * @param end Preorder index past the last node of the subtree
+ * @param tree Pointer to tree_t whose head is the subtree root
+ * @param handleValue Value handler, see TreeParser.h
+ * @return false if snapshot is malformed
+ */
+
+template<typename ValueHandler>
+static bool buildBinary(binaryReader_t *reader, size_t first, size_t end, tree_t *tree, ValueHandler &handleValue) {
+    // Nodes that have both children wait here for their right subtree
+    node_t **pending = (node_t **) countedCalloc(64, sizeof(node_t *));
+    size_t pendingSize = 0;
+    size_t pendingCapacity = 64;
+
+    node_t *node = tree->head;
+    for (size_t index = first; index < end; index++) {
+        const char *value = nullptr;
+        size_t valueLength = 0;
+        if (!readBlob(reader, &value, &valueLength))
+            goto error;
+
+        if (!handleValue(value, valueLength, &node->value))
+            goto error;
+
+        if (index + 1 == end)
+            break;
+
+        unsigned bits = shapeBits(reader, index);
+        node_t *next = nullptr;
+
+        if (bits & 1u) {
+            if (bits & 2u) {
+                if (pendingSize == pendingCapacity) {
+                    pendingCapacity *= 2;
+                    pending = (node_t **) countedRealloc(pending, pendingCapacity * sizeof(node_t *));
+                    assert(pending);
+                }
+                pending[pendingSize++] = node;
+            }
+
+            next = treeMakeNode(tree, node, nullptr, nullptr, nullptr);
+            node->left = next;
+        } else {
+            node_t *parent = node;
+            if (!(bits & 2u)) {
+                if (!pendingSize)
+                    goto error;
+                parent = pending[--pendingSize];
+            }
+
+            next = treeMakeNode(tree, parent, nullptr, nullptr, nullptr);
+            parent->right = next;
+        }
+
+        tree->size++;
+        node = next;
+    }
+
+    // Shape must describe exactly the nodes of the range
+    if (pendingSize || (shapeBits(reader, end - 1) != 0))
+        goto error;
+
+    treeAugment(tree->head);
+    countedFree(pending);
+    return true;
+
+    error:
+    countedFree(pending);
+    return false;
+}
+
+/**
+ * Function that restores tree from binary snapshot
+ * @param data Pointer to binary snapshot
+ * @param length Length of snapshot in bytes
+ * @param handleValue Value handler, see TreeParser.h
+ * @param pooled Whether nodes of the new tree are taken from a node pool
+ * @return Pointer to restored tree or nullptr if snapshot is malformed
+ */
+
+template<typename ValueHandler>
+static tree_t *parseBinary(const char *data, size_t length, ValueHandler &handleValue, bool pooled) {
+    binaryReader_t reader = {};
+    if (!openBinary(data, length, &reader))
+        return nullptr;
+
+    tree_t *tree = pooled ? makePooledTree(nullptr) : makeTree(nullptr);
+    if (!buildBinary(&reader, 0, reader.nodeCount, tree, handleValue)) {
+        deleteTree(tree);
+        return nullptr;
+    }
+
+    return tree;
+}
+
+/**
+ * Function that deserializes binary snapshot
+ * @param data Pointer to binary snapshot
+ * @param length Length of snapshot in bytes
+ * @param deserializeValue Function that deserializes value. Gets a temporary null-terminated copy of the value
+ * @param pooled Whether nodes of the new tree are taken from a node pool
+ * @return Pointer to restored tree or nullptr if snapshot is malformed
+ */
+
+tree_t *treeDeserializeBinary(const char *data, size_t length, void *(*deserializeValue)(char *), bool pooled) {
+    assert(data);
+    assert(deserializeValue);
+
+    copyingValueHandler_t handler = {deserializeValue, nullptr, 0};
+    tree_t *tree = parseBinary(data, length, handler, pooled);
+
+    countedFree(handler.buffer);
+    return tree;
+}
+
+/**
+ * Function that deserializes binary snapshot without copying or modifying it
+ * @param data Pointer to binary snapshot
+ * @param length Length of snapshot in bytes
+ * @param deserializeValue Function that deserializes value. Gets value position and length inside the snapshot
+ * @param pooled Whether nodes of the new tree are taken from a node pool
+ * @return Pointer to restored tree or nullptr if snapshot is malformed
+ */
+
+tree_t *treeDeserializeBinary(const char *data, size_t length, void *(*deserializeValue)(const char *, size_t),
+                              bool pooled) {
+    assert(data);
+    assert(deserializeValue);
+
+    viewValueHandler_t handler = {deserializeValue};
+    return parseBinary(data, length, handler, pooled);
+}
+
+/**
+ * Function that deserializes binary snapshot with built-in value codec
+ * @param data Pointer to binary snapshot
+ * @param length Length of snapshot in bytes
+ * @param codec Value codec
+ * @param pooled Whether nodes of the new tree are taken from a node pool
+ * @return Pointer to restored tree or nullptr if snapshot is malformed or value can not be read by the codec
+ */
+
+tree_t *treeDeserializeBinary(const char *data, size_t length, VALUE_CODEC codec, bool pooled) {
+    assert(data);
+
+    return parseWithCodec(codec, [&](auto &handler) {
+        return parseBinary(data, length, handler, pooled);
+    });
+}
+
+/**
+ * Function that finds subtrees of binary snapshot without decoding values. Shape bits give preorder ranges of the
+ * subtrees, then blob lengths are skipped to find where values of every subtree start
+ * @param reader Pointer to binaryReader_t
+ * @param maxDepth Depth of the deepest subtree to record
+ * @param spans Pointer to store calloc'ed array of subtrees in preorder
+ * @param count Pointer to store number of subtrees
+ * @return false if snapshot is malformed
+ */
+
+static bool scanBinarySpans(const binaryReader_t *reader, size_t maxDepth, binarySpan_t **spans, size_t *count) {
+    size_t spanCapacity = 64;
+    size_t stackCapacity = 64;
+    size_t stackSize = 0;
+    auto *stack = (shapeFrame_t *) countedCalloc(stackCapacity, sizeof(shapeFrame_t));
+    *spans = (binarySpan_t *) countedCalloc(spanCapacity, sizeof(binarySpan_t));
+    *count = 0;
+    assert(stack && *spans);
+
+    bool valid = true;
+    for (size_t index = 0; index < reader->nodeCount && valid; index++) {
+        if (index && !stackSize) {
+            valid = false;
+            break;
+        }
+
+        size_t depth = stackSize ? stack[stackSize - 1].depth + 1 : 0;
+        size_t span = SIZE_MAX;
+        if (depth <= maxDepth) {
+            if (*count == spanCapacity) {
+                spanCapacity *= 2;
+                *spans = (binarySpan_t *) countedRealloc(*spans, spanCapacity * sizeof(binarySpan_t));
+                assert(*spans);
+            }
+
+            span = (*count)++;
+            (*spans)[span] = {index, 0, depth, nullptr};
+        }
+
+        unsigned bits = shapeBits(reader, index);
+        unsigned children = (bits & 1u) + ((bits >> 1) & 1u);
+        if (children) {
+            if (stackSize == stackCapacity) {
+                stackCapacity *= 2;
+                stack = (shapeFrame_t *) countedRealloc(stack, stackCapacity * sizeof(shapeFrame_t));
+                assert(stack);
+            }
+
+            stack[stackSize++] = {span, depth, children};
+            continue;
+        }
+
+        if (span != SIZE_MAX)
+            (*spans)[span].end = index + 1;
+
+        // Leaf completes every ancestor that was waiting for its last child
+        while (stackSize && !--stack[stackSize - 1].remaining) {
+            if (stack[stackSize - 1].span != SIZE_MAX)
+                (*spans)[stack[stackSize - 1].span].end = index + 1;
+            stackSize--;
+        }
+    }
+    countedFree(stack);
+
+    if (!valid || stackSize)
+        return false;
+
+    binaryReader_t values = *reader;
+    size_t span = 0;
+    for (size_t index = 0; index < reader->nodeCount; index++) {
+        if (span < *count && (*spans)[span].first == index)
+            (*spans)[span++].values = values.values;
+
+        const char *value = nullptr;
+        size_t valueLength = 0;
+        if (!readBlob(&values, &value, &valueLength))
+            return false;
+    }
+
+    return true;
+}
+
+/**
+ * Function that restores one split off subtree, runs on parallelRun worker
+ * @param index Task index
+ * @param context Array of binaryTask_t
+ */
+
+static void runBinaryTask(size_t index, void *context) {
+    binaryTask_t *task = (binaryTask_t *) context + index;
+
+    task->subtree = makePooledTree(nullptr);
+    if (!buildBinary(&task->reader, task->first, task->end, task->subtree, task->handleValue)) {
+        deleteTree(task->subtree);
+        task->subtree = nullptr;
+    }
+}
+
+/**
+ * Function that deserializes binary snapshot on several threads without copying or modifying it. The upper part of
+ * the tree is restored on the calling thread, large enough subtrees below it are restored concurrently into their own
+ * node pools and grafted afterwards
+ * @param data Pointer to binary snapshot
+ * @param length Length of snapshot in bytes
+ * @param deserializeValue Function that deserializes value, called concurrently. Gets value position and length
+ * @param threads Number of threads, 0 for the number of hardware threads
+ * @return Pointer to restored pooled tree or nullptr if snapshot is malformed
+ */
+
+tree_t *treeDeserializeBinaryParallel(const char *data, size_t length,
+                                      void *(*deserializeValue)(const char *, size_t), size_t threads) {
+    assert(data);
+    assert(deserializeValue);
+
+    viewValueHandler_t handler = {deserializeValue};
+    threads = parallelThreads(threads);
+    if (threads <= 1 || length < PARALLEL_MIN_INPUT)
+        return parseBinary(data, length, handler, true);
+
+    binaryReader_t reader = {};
+    if (!openBinary(data, length, &reader))
+        return nullptr;
+
+    size_t splitDepth = parallelSplitDepth(threads);
+    binarySpan_t *spans = nullptr;
+    size_t spanCount = 0;
+    if (!scanBinarySpans(&reader, splitDepth, &spans, &spanCount)) {
+        countedFree(spans);
+        return nullptr;
+    }
+
+    size_t target = reader.nodeCount / (threads * PARALLEL_TASKS_PER_THREAD);
+    auto *tasks = (binaryTask_t *) countedCalloc(spanCount, sizeof(binaryTask_t));
+    auto *frames = (binaryFrame_t *) countedCalloc(splitDepth + 1, sizeof(binaryFrame_t));
+    assert(tasks && frames);
+
+    size_t taskCount = 0;
+    size_t frameCount = 0;
+    bool valid = true;
+    tree_t *tree = nullptr;
+
+    for (size_t index = 0; index < spanCount && valid;) {
+        const binarySpan_t *span = &spans[index];
+
+        while (frameCount && frames[frameCount - 1].end <= span->first)
+            frameCount--;
+
+        binaryFrame_t *parent = frameCount ? &frames[frameCount - 1] : nullptr;
+        bool left = parent && (parent->bits & 1u) && !parent->children;
+        if (parent)
+            parent->children++;
+
+        if (parent && (span->end - span->first <= target || span->depth == splitDepth)) {
+            binaryReader_t taskReader = reader;
+            taskReader.values = span->values;
+            tasks[taskCount++] = {taskReader, span->first, span->end, parent->node, left, handler, nullptr};
+
+            for (index++; index < spanCount && spans[index].first < span->end; index++);
+            continue;
+        }
+
+        const char *value = nullptr;
+        size_t valueLength = 0;
+        void *decoded = nullptr;
+        reader.values = span->values;
+        if (!readBlob(&reader, &value, &valueLength) || !handler(value, valueLength, &decoded)) {
+            valid = false;
+            break;
+        }
+
+        node_t *node = nullptr;
+        if (parent) {
+            node = treeMakeNode(tree, parent->node, nullptr, nullptr, decoded);
+            if (left)
+                parent->node->left = node;
+            else
+                parent->node->right = node;
+            nodeAugmentPath(parent->node);
+            tree->size++;
+        } else {
+            tree = makePooledTree(decoded);
+            node = tree->head;
+        }
+
+        frames[frameCount++] = {node, span->end, shapeBits(&reader, span->first), 0};
+        index++;
+    }
+
+    if (valid)
+        parallelRun(taskCount, runBinaryTask, tasks, threads);
+
+    for (size_t index = 0; index < taskCount; index++)
+        valid = valid && tasks[index].subtree;
+
+    for (size_t index = 0; index < taskCount; index++) {
+        if (valid && tasks[index].left)
+            addLeftSubtree(tree, tasks[index].parent, tasks[index].subtree);
+        else if (valid)
+            addRightSubtree(tree, tasks[index].parent, tasks[index].subtree);
+        else if (tasks[index].subtree)
+            deleteTree(tasks[index].subtree);
+    }
+
+    if (!valid && tree) {
+        deleteTree(tree);
+        tree = nullptr;
+    }
+
+    countedFree(frames);
+    countedFree(tasks);
+    countedFree(spans);
+    return tree;
+}
+
+/**
+ * Value handler that stores raw value spans in preorder
+ */
+
+struct spanValueHandler_t {
+    const char **values;
+    size_t *lengths;
+    size_t size;
+    size_t capacity;
+
+    bool operator()(const char *value, size_t length, void **result) {
+        if (size == capacity) {
+            capacity = capacity ? capacity * 2 : 1024;
+            values = (const char **) countedRealloc(values, capacity * sizeof(const char *));
+            lengths = (size_t *) countedRealloc(lengths, capacity * sizeof(size_t));
+            assert(values && lengths);
+        }
+
+        values[size] = value;
+        lengths[size] = length;
+        *result = nullptr;
+        size++;
+        return true;
+    }
+};
+
+/**
+ * Function that converts text serialized tree into binary snapshot. Values are copied verbatim
+ * @param serialized Pointer to text serialized tree
+ * @param length Length of serialized tree in bytes
+ * @param filename Filename to write binary snapshot to
+ * @param errorOffset Optional pointer to store byte offset of the first parse error
+ * @return true on success
+ */
+
+bool serializedToBinary(const char *serialized, size_t length, char *filename, size_t *errorOffset) {
+    assert(serialized);
+    assert(filename);
+
+    spanValueHandler_t handler = {};
+    tree_t *tree = parseTree(serialized, length, handler, true, errorOffset);
+    FILE *out = tree ? fopen(filename, "wb") : nullptr;
+    bool written = out != nullptr;
+
+    if (out) {
+        outputSink_t *sink = makeFileSink(out);
+
+        writeShape(tree, sink);
+        // Parser creates nodes in preorder, so spans are already in the binary order
+        for (size_t index = 0; index < handler.size; index++)
+            writeBlob(sink, handler.values[index], handler.lengths[index]);
+
+        written = deleteSink(sink);
+        if (fclose(out) != 0)
+            written = false;
+    }
+
+    if (tree)
+        deleteTree(tree);
+    countedFree(handler.values);
+    countedFree(handler.lengths);
+    return written;
+}
+
+/**
+ * Function that converts binary snapshot into text serialized tree, byte-identical to treeSerialize output
+ * @param data Pointer to binary snapshot
+ * @param length Length of snapshot in bytes
+ * @param filename Filename to write text serialized tree to
+ * @return true on success
+ */
+
+bool binaryToSerialized(const char *data, size_t length, char *filename) {
+    assert(data);
+    assert(filename);
+
+    binaryReader_t reader = {};
+    if (!openBinary(data, length, &reader))
+        return false;
+
+    FILE *out = fopen(filename, "w");
+    if (!out)
+        return false;
+
+    outputSink_t *sink = makeFileSink(out);
+
+    // Every open subtree remembers whether its parent still has to emit right subtree after it
+    bool *pendingRight = (bool *) countedCalloc(64, sizeof(bool));
+    size_t depth = 0;
+    size_t capacity = 64;
+    bool valid = true;
+
+    sinkPut(sink, "{ ", 2);
+    for (size_t index = 0; index < reader.nodeCount && valid; index++) {
+        const char *value = nullptr;
+        size_t valueLength = 0;
+        if (!readBlob(&reader, &value, &valueLength)) {
+            valid = false;
+            break;
+        }
+
+        sinkPut(sink, "\"", 1);
+        sinkPut(sink, value, valueLength);
+        sinkPut(sink, "\" ", 2);
+
+        unsigned bits = shapeBits(&reader, index);
+        if (bits) {
+            if (depth == capacity) {
+                capacity *= 2;
+                pendingRight = (bool *) countedRealloc(pendingRight, capacity * sizeof(bool));
+                assert(pendingRight);
+            }
+
+            pendingRight[depth++] = bits == 3u;
+            if (bits & 1u)
+                sinkPut(sink, "{ ", 2);
+            else
+                sinkPut(sink, "$ { ", 4);
+            continue;
+        }
+
+        while (depth) {
+            sinkPut(sink, "} ", 2);
+            if (pendingRight[depth - 1]) {
+                pendingRight[depth - 1] = false;
+                sinkPut(sink, "{ ", 2);
+                break;
+            }
+            depth--;
+        }
+
+        if (!depth && index + 1 != reader.nodeCount)
+            valid = false;
+    }
+    sinkPut(sink, "}", 1);
+
+    if (depth)
+        valid = false;
+
+    countedFree(pendingRight);
+    bool written = deleteSink(sink);
+    return fclose(out) == 0 && written && valid;
+}
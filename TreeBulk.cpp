@@ -0,0 +1,244 @@
+//
+// Created by alexey on 17.10.2026.
+//
+
+#include "Tree.h"
+
+/**
+ * Function that moves from a finished child slot to the next free one of the extended preorder walk
+ * @param parent Pointer to slot owner, set to nullptr when the whole tree is finished
+ * @param dir Pointer to slot direction
+ */
+
+static void nextSlot(node_t **parent, DIRECTION *dir) {
+    while (*parent) {
+        if (*dir == LEFT) {
+            *dir = RIGHT;
+            return;
+        }
+
+        // Subtree of parent is finished, so is the slot parent hangs from
+        node_t *up = (*parent)->parent;
+        *dir = up && up->left == *parent ? LEFT : RIGHT;
+        *parent = up;
+    }
+}
+
+/**
+ * Function that builds tree from preorder presence bitmap. Every child slot of the extended preorder walk is one bit,
+ * 1 for a node and 0 for no node, so tree of n nodes takes 2n + 1 bits. Bit i is bits[i / 8] >> (i % 8) & 1.
+ * All the nodes are taken in one allocation and laid out in preorder
+ * @param bits Pointer to bitmap
+ * @param bitCount Number of bits
+ * @param values Values of nodes in preorder
+ * @param valueCount Number of values, must be the number of 1 bits
+ * @param errorOffset Optional pointer to store index of the first wrong bit
+ * @return Pointer to pooled tree or nullptr on error
+ */
+
+tree_t *treeFromPreorderBits(const uint8_t *bits, size_t bitCount, void *const *values, size_t valueCount,
+                             size_t *errorOffset) {
+    assert(bits);
+    assert(values);
+
+    size_t index = 0;
+    size_t taken = 0;
+    nodePool_t *pool = nullptr;
+    node_t *nodes = nullptr;
+    node_t *parent = nullptr;
+    DIRECTION dir = LEFT;
+
+    if (!bitCount || !valueCount || !(bits[0] & 1))
+        goto error;
+
+    pool = makeNodePool();
+    nodes = poolTakeNodes(pool, valueCount);
+    nodes[taken].value = values[taken];
+    parent = &nodes[taken++];
+
+    for (index = 1; index < bitCount; index++) {
+        if (!parent)
+            goto error;
+
+        if (!(bits[index / 8] >> (index % 8) & 1)) {
+            nextSlot(&parent, &dir);
+            continue;
+        }
+
+        if (taken == valueCount)
+            goto error;
+
+        node_t *node = &nodes[taken];
+        node->value = values[taken++];
+        node->parent = parent;
+        if (dir == LEFT)
+            parent->left = node;
+        else
+            parent->right = node;
+
+        parent = node;
+        dir = LEFT;
+    }
+
+    if (parent || taken != valueCount)
+        goto error;
+
+    treeAugment(nodes);
+    return adoptTree(nodes, valueCount - 1, pool);
+
+    error:
+    if (errorOffset)
+        *errorOffset = index;
+
+    if (pool)
+        deleteNodePool(pool);
+    return nullptr;
+}
+
+/**
+ * Function that checks whether level-order entry is present
+ * @param values Array of values
+ * @param present Presence bitmap, nullptr if nullptr values are holes
+ * @param index Entry index
+ * @return true if entry is a node
+ */
+
+static bool entryPresent(void *const *values, const uint8_t *present, size_t index) {
+    if (present)
+        return present[index / 8] >> (index % 8) & 1;
+
+    return values[index] != nullptr;
+}
+
+/**
+ * Function that builds tree from heap-style level-order array with holes marked by bitmap or by nullptr values
+ * @param values Array of values
+ * @param present Presence bitmap, nullptr if nullptr values are holes
+ * @param count Number of array entries
+ * @param errorOffset Optional pointer to store index of the first entry without parent
+ * @return Pointer to pooled tree or nullptr on error
+ */
+
+static tree_t *levelOrderTree(void *const *values, const uint8_t *present, size_t count, size_t *errorOffset) {
+    if (!count || !entryPresent(values, present, 0)) {
+        if (errorOffset)
+            *errorOffset = 0;
+        return nullptr;
+    }
+
+    size_t nodeCount = 0;
+    for (size_t index = 0; index < count; index++)
+        nodeCount += entryPresent(values, present, index);
+
+    nodePool_t *pool = makeNodePool();
+    node_t *nodes = poolTakeNodes(pool, nodeCount);
+    nodes[0].value = values[0];
+
+    // Parent index never decreases, so its rank among present entries is tracked without an index map
+    size_t parentIndex = 0;
+    size_t parentRank = 0;
+    size_t taken = 1;
+
+    for (size_t index = 1; index < count; index++) {
+        if (!entryPresent(values, present, index))
+            continue;
+
+        size_t parentEntry = (index - 1) / 2;
+        for (; parentIndex < parentEntry; parentIndex++)
+            parentRank += entryPresent(values, present, parentIndex);
+
+        if (!entryPresent(values, present, parentEntry)) {
+            if (errorOffset)
+                *errorOffset = index;
+            deleteNodePool(pool);
+            return nullptr;
+        }
+
+        node_t *parent = &nodes[parentRank];
+        node_t *node = &nodes[taken++];
+        node->value = values[index];
+        node->parent = parent;
+        if (index % 2)
+            parent->left = node;
+        else
+            parent->right = node;
+    }
+
+    treeAugment(nodes);
+    return adoptTree(nodes, nodeCount - 1, pool);
+}
+
+/**
+ * Function that builds tree from heap-style level-order array: children of entry i are entries 2i + 1 and 2i + 2,
+ * nullptr entries are holes. Every node but the head must have its parent entry present.
+ * All the nodes are taken in one allocation and laid out in level order. Values that may be nullptr, such as
+ * intValue(0), need the overload with presence bitmap
+ * @param values Array of values
+ * @param count Number of array entries
+ * @param errorOffset Optional pointer to store index of the first entry without parent
+ * @return Pointer to pooled tree or nullptr on error
+ */
+
+tree_t *treeFromLevelOrder(void *const *values, size_t count, size_t *errorOffset) {
+    assert(values);
+
+    return levelOrderTree(values, nullptr, count, errorOffset);
+}
+
+/**
+ * Function that builds tree from heap-style level-order array whose holes are marked by bitmap, so any value,
+ * nullptr included, can be stored. Bit i is bit i % 8 of byte i / 8, like in treeFromPreorderBits
+ * @param values Array of values, entries of holes are not read
+ * @param present Presence bitmap of count bits
+ * @param count Number of array entries
+ * @param errorOffset Optional pointer to store index of the first entry without parent
+ * @return Pointer to pooled tree or nullptr on error
+ */
+
+tree_t *treeFromLevelOrder(void *const *values, const uint8_t *present, size_t count, size_t *errorOffset) {
+    assert(values);
+    assert(present);
+
+    return levelOrderTree(values, present, count, errorOffset);
+}
+
+/**
+ * Function that writes tree shape as preorder presence bitmap that treeFromPreorderBits reads. Values are not
+ * written, preorder(tree) visits them in the matching order
+ * @param tree Pointer to tree_t
+ * @param bitCount Pointer to store number of bits
+ * @return Pointer to bitmap, should be freed by caller
+ */
+
+uint8_t *treeToPreorderBits(tree_t *tree, size_t *bitCount) {
+    assert(tree);
+    assert(bitCount);
+
+    treeExpandAll(tree);
+
+    size_t count = 2 * (tree->size + 1) + 1;
+    auto *bits = (uint8_t *) countedCalloc((count + 7) / 8, 1);
+    assert(bits);
+
+    size_t index = 0;
+    bits[index / 8] |= 1 << (index % 8);
+    index++;
+
+    node_t *parent = tree->head;
+    DIRECTION dir = LEFT;
+    while (parent) {
+        assert(index < count);
+        node_t *child = dir == LEFT ? parent->left : parent->right;
+        if (child) {
+            bits[index / 8] |= 1 << (index % 8);
+            parent = child;
+            dir = LEFT;
+        } else {
+            nextSlot(&parent, &dir);
+        }
+        index++;
+    }
+
+    *bitCount = index;
+    return bits;
+}
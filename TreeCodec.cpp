@@ -0,0 +1,254 @@
+//
+// Created by alexey on 17.10.2026.
+//
+
+#include "TreeCodec.h"
+#include "TreeParser.h"
+#include "TreeWriter.h"
+#include <cstddef>
+
+static const size_t ARENA_CHUNK_HEADER = (sizeof(arenaChunk_t) + alignof(std::max_align_t) - 1) /
+                                         alignof(std::max_align_t) * alignof(std::max_align_t);
+
+/**
+ * Value arena "constructor". Arena hands out memory from chunks that grow geometrically up to maxChunk bytes and
+ * frees them all at once
+ * @param maxChunk Maximal size of one chunk in bytes
+ * @return Pointer to valueArena_t
+ */
+
+valueArena_t *makeValueArena(size_t maxChunk) {
+    assert(maxChunk);
+
+    auto *arena = (valueArena_t *) countedCalloc(1, sizeof(valueArena_t));
+    arena->maxChunk = maxChunk;
+    arena->owners = 1;
+    return arena;
+}
+
+/**
+ * Function that takes size bytes aligned to align from the arena. Requests that do not fit into a regular chunk get
+ * a chunk of their own
+ * @param arena Pointer to valueArena_t
+ * @param size Number of bytes
+ * @param align Alignment, power of two not greater than max_align_t one
+ * @return Pointer to memory
+ */
+
+static void *arenaTake(valueArena_t *arena, size_t size, size_t align) {
+    arena->bytesUsed += size;
+
+    arenaChunk_t *current = arena->chunks;
+    if (current) {
+        size_t offset = (current->used + align - 1) & ~(align - 1);
+        if (offset <= current->capacity && current->capacity - offset >= size) {
+            current->used = offset + size;
+            return (char *) current + ARENA_CHUNK_HEADER + offset;
+        }
+    }
+
+    size_t capacity = current ? current->capacity * 2 : ARENA_FIRST_CHUNK;
+    if (capacity > arena->maxChunk)
+        capacity = arena->maxChunk;
+    bool own = size > capacity;
+    if (own)
+        capacity = size;
+
+    auto *chunk = (arenaChunk_t *) countedMalloc(ARENA_CHUNK_HEADER + capacity);
+    assert(chunk);
+    chunk->capacity = capacity;
+    chunk->used = size;
+    arena->chunkCount++;
+
+    // Chunk of its own is full, keep the current one first so that small values are still taken from it
+    if (own && current) {
+        chunk->next = current->next;
+        current->next = chunk;
+    } else {
+        chunk->next = current;
+        arena->chunks = chunk;
+    }
+
+    return (char *) chunk + ARENA_CHUNK_HEADER;
+}
+
+/**
+ * Function that takes memory for a value from the arena. Memory is aligned for any type and is not zeroed
+ * @param arena Pointer to valueArena_t
+ * @param size Number of bytes
+ * @return Pointer to memory, valid until the arena is deleted
+ */
+
+void *arenaAlloc(valueArena_t *arena, size_t size) {
+    assert(arena);
+
+    return arenaTake(arena, size, alignof(std::max_align_t));
+}
+
+/**
+ * Function that copies string to the arena
+ * @param arena Pointer to valueArena_t
+ * @param string Pointer to string, does not have to be null-terminated
+ * @param length Length of string
+ * @return Pointer to null-terminated copy, valid until the arena is deleted
+ */
+
+char *arenaCopyString(valueArena_t *arena, const char *string, size_t length) {
+    assert(arena);
+    assert(string || !length);
+
+    auto *copy = (char *) arenaTake(arena, length + 1, 1);
+    memcpy(copy, string, length);
+    copy[length] = '\0';
+    return copy;
+}
+
+/**
+ * Function that moves all the chunks of one arena into another. Source arena is deleted
+ * @param arena Pointer to destination valueArena_t
+ * @param source Pointer to valueArena_t to merge, must not be shared by several trees
+ */
+
+void arenaMerge(valueArena_t *arena, valueArena_t *source) {
+    assert(arena);
+    assert(source);
+    assert(arena != source);
+    assert(source->owners == 1);
+
+    if (source->chunks) {
+        arenaChunk_t *last = source->chunks;
+        while (last->next)
+            last = last->next;
+
+        // Keep the chunk with spare room first so that new values are still taken from it
+        if (arena->chunks) {
+            last->next = arena->chunks->next;
+            arena->chunks->next = source->chunks;
+        } else {
+            arena->chunks = source->chunks;
+        }
+    }
+
+    arena->chunkCount += source->chunkCount;
+    arena->bytesUsed += source->bytesUsed;
+    countedFree(source);
+}
+
+/**
+ * Value arena "destructor". Releases all the chunks at once
+ * @param arena Pointer to valueArena_t
+ */
+
+void deleteValueArena(valueArena_t *arena) {
+    assert(arena);
+
+    arenaChunk_t *chunk = arena->chunks;
+    while (chunk) {
+        arenaChunk_t *next = chunk->next;
+        countedFree(chunk);
+        chunk = next;
+    }
+
+    countedFree(arena);
+}
+
+/**
+ * Function that takes memory for a value from the tree arena. Arena is created on first use and deleted with the tree
+ * @param tree Pointer to tree_t
+ * @param size Number of bytes
+ * @return Pointer to memory aligned for any type, valid until the tree is deleted
+ */
+
+void *treeAllocValue(tree_t *tree, size_t size) {
+    assert(tree);
+
+    if (!tree->arena)
+        tree->arena = makeValueArena();
+
+    return arenaAlloc(tree->arena, size);
+}
+
+/**
+ * Function that writes INT_CODEC value
+ * @param value Value made by intValue
+ * @param buffer Pointer to buffer
+ * @param capacity Buffer size
+ * @return Value length, buffer is filled only if value fits
+ */
+
+size_t writeIntValue(void *value, char *buffer, size_t capacity) {
+    intCodecWriter_t writer;
+    return writer(value, buffer, capacity);
+}
+
+/**
+ * Function that writes DOUBLE_CODEC value
+ * @param value Value made by doubleValue
+ * @param buffer Pointer to buffer
+ * @param capacity Buffer size
+ * @return Value length, buffer is filled only if value fits
+ */
+
+size_t writeDoubleValue(void *value, char *buffer, size_t capacity) {
+    doubleCodecWriter_t writer;
+    return writer(value, buffer, capacity);
+}
+
+/**
+ * Function that writes STRING_CODEC value
+ * @param value Pointer to null-terminated string
+ * @param buffer Pointer to buffer
+ * @param capacity Buffer size
+ * @return Value length, buffer is filled only if value fits
+ */
+
+size_t writeStringValue(void *value, char *buffer, size_t capacity) {
+    stringCodecWriter_t writer;
+    return writer(value, buffer, capacity);
+}
+
+/**
+ * Function that serializes tree with built-in value codec. File and descriptor sinks are flushed afterwards
+ * @param tree Pointer to tree_t
+ * @param sink Pointer to outputSink_t
+ * @param codec Value codec
+ * @return false if any write has failed
+ */
+
+bool treeSerialize(tree_t *tree, outputSink_t *sink, VALUE_CODEC codec) {
+    assert(tree);
+    assert(sink);
+
+    treeExpandAll(tree);
+
+    sinkPut(sink, "{ ", 2);
+    if (codec == INT_CODEC) {
+        intCodecWriter_t writer;
+        serializeText(tree->head, sink, writer);
+    } else if (codec == DOUBLE_CODEC) {
+        doubleCodecWriter_t writer;
+        serializeText(tree->head, sink, writer);
+    } else {
+        stringCodecWriter_t writer;
+        serializeText(tree->head, sink, writer);
+    }
+    sinkPut(sink, "}", 1);
+
+    return sinkFlush(sink);
+}
+
+/**
+ * Function that parses serialized tree with built-in value codec. Value that the codec can not read is a parse error
+ * @param serialized Pointer to serialized tree, does not have to be null-terminated
+ * @param length Length of serialized tree in bytes
+ * @param codec Value codec
+ * @param errorOffset Optional pointer to store byte offset of the first error
+ * @param pooled Whether nodes of the new tree are taken from a node pool
+ * @return Pointer to restored tree or nullptr on error
+ */
+
+tree_t *treeParse(const char *serialized, size_t length, VALUE_CODEC codec, size_t *errorOffset, bool pooled) {
+    return parseWithCodec(codec, [&](auto &handler) {
+        return parseTree(serialized, length, handler, pooled, errorOffset);
+    });
+}
@@ -0,0 +1,144 @@
+//
+// Created by alexey on 17.10.2026.
+//
+
+#ifndef TREE_TREECODEC_H
+#define TREE_TREECODEC_H
+#include "Tree.h"
+#include <charconv>
+
+/*
+ * Built-in value codecs. Integers and doubles live right in the value slot, strings are null-terminated copies in
+ * the tree value arena. Handlers and writers are plain functors, so parsers and writers instantiated with them make
+ * no indirect call per value.
+ */
+
+const size_t CODEC_NUMBER_CHARS = 32;
+
+/**
+ * Value handler of INT_CODEC: the whole value must be a decimal 64-bit integer
+ */
+
+struct intCodecHandler_t {
+    bool operator()(const char *value, size_t length, void **result) {
+        int64_t number = 0;
+        std::from_chars_result parsed = std::from_chars(value, value + length, number);
+        if (parsed.ec != std::errc() || parsed.ptr != value + length)
+            return false;
+
+        *result = intValue(number);
+        return true;
+    }
+};
+
+/**
+ * Value handler of DOUBLE_CODEC: the whole value must be a double in fixed or scientific notation
+ */
+
+struct doubleCodecHandler_t {
+    bool operator()(const char *value, size_t length, void **result) {
+        double number = 0;
+        std::from_chars_result parsed = std::from_chars(value, value + length, number);
+        if (parsed.ec != std::errc() || parsed.ptr != value + length)
+            return false;
+
+        *result = doubleValue(number);
+        return true;
+    }
+};
+
+/**
+ * Value handler of STRING_CODEC: value is copied to the arena
+ */
+
+struct stringCodecHandler_t {
+    valueArena_t *arena;
+
+    bool operator()(const char *value, size_t length, void **result) {
+        *result = arenaCopyString(arena, value, length);
+        return true;
+    }
+};
+
+/**
+ * Value writer of INT_CODEC
+ */
+
+struct intCodecWriter_t {
+    size_t operator()(void *value, char *buffer, size_t capacity) {
+        // Sinks reserve more than any integer takes, so digits are written in place almost always
+        if (capacity >= CODEC_NUMBER_CHARS)
+            return std::to_chars(buffer, buffer + capacity, valueToInt(value)).ptr - buffer;
+
+        char digits[CODEC_NUMBER_CHARS];
+        size_t length = std::to_chars(digits, digits + sizeof(digits), valueToInt(value)).ptr - digits;
+        if (length <= capacity)
+            memcpy(buffer, digits, length);
+
+        return length;
+    }
+};
+
+/**
+ * Value writer of DOUBLE_CODEC. Writes the shortest text that reads back to the same double
+ */
+
+struct doubleCodecWriter_t {
+    size_t operator()(void *value, char *buffer, size_t capacity) {
+        if (capacity >= CODEC_NUMBER_CHARS)
+            return std::to_chars(buffer, buffer + capacity, valueToDouble(value)).ptr - buffer;
+
+        char digits[CODEC_NUMBER_CHARS];
+        size_t length = std::to_chars(digits, digits + sizeof(digits), valueToDouble(value)).ptr - digits;
+        if (length <= capacity)
+            memcpy(buffer, digits, length);
+
+        return length;
+    }
+};
+
+/**
+ * Value writer of STRING_CODEC
+ */
+
+struct stringCodecWriter_t {
+    size_t operator()(void *value, char *buffer, size_t capacity) {
+        size_t length = strlen((const char *) value);
+        if (length <= capacity)
+            memcpy(buffer, value, length);
+
+        return length;
+    }
+};
+
+/**
+ * Function that runs a parser with the value handler of the codec. Arena of STRING_CODEC goes to the parsed tree
+ * or is deleted on error
+ * @param codec Value codec
+ * @param parse Function object that takes value handler by reference and returns parsed tree or nullptr
+ * @return Pointer to parsed tree or nullptr on error
+ */
+
+template<typename Parse>
+tree_t *parseWithCodec(VALUE_CODEC codec, const Parse &parse) {
+    if (codec == INT_CODEC) {
+        intCodecHandler_t handler;
+        return parse(handler);
+    }
+
+    if (codec == DOUBLE_CODEC) {
+        doubleCodecHandler_t handler;
+        return parse(handler);
+    }
+
+    assert(codec == STRING_CODEC);
+    stringCodecHandler_t handler = {makeValueArena()};
+    tree_t *tree = parse(handler);
+    if (tree)
+        tree->arena = handler.arena;
+    else
+        deleteValueArena(handler.arena);
+
+    return tree;
+}
+#endif //TREE_TREECODEC_H
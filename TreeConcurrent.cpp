@@ -0,0 +1,209 @@
+//
+// Created by alexey on 17.10.2026.
+//
+
+#include "TreeConcurrent.h"
+#include "TreeParallel.h"
+#include <thread>
+
+static std::atomic<size_t> nextThread(0);
+static thread_local size_t threadIndex = nextThread++;
+
+/**
+ * Concurrent mode "constructor". Until endConcurrent the tree may be grown by several threads at once
+ * @param tree Pointer to tree_t without serial cache
+ * @param shards Number of size counters and node pools, 0 for twice the number of hardware threads
+ * @return Pointer to concurrentTree_t
+ */
+
+concurrentTree_t *beginConcurrent(tree_t *tree, size_t shards) {
+    assert(tree);
+    assert(!tree->cache);
+
+    treeExpandAll(tree);
+
+    if (!shards)
+        shards = parallelThreads(0) * CONCURRENT_SHARDS_PER_THREAD;
+
+    auto *concurrent = (concurrentTree_t *) countedCalloc(1, sizeof(concurrentTree_t));
+    concurrent->tree = tree;
+    // Array has to start on a cache line, otherwise every shard straddles two of them and neighbours false-share
+    size_t shardBytes = shards * sizeof(concurrentShard_t);
+    concurrent->shards = (concurrentShard_t *) countedAlignedAlloc(CONCURRENT_CACHE_LINE, shardBytes);
+    memset((void *) concurrent->shards, 0, shardBytes);
+    concurrent->shardCount = shards;
+
+    if (tree->pool) {
+        for (size_t index = 0; index < shards; index++)
+            concurrent->shards[index].pool = makeNodePool(tree->pool->maxChunk);
+    }
+
+    return concurrent;
+}
+
+/**
+ * Function that makes node with the allocator of calling thread shard
+ * @param shard Pointer to concurrentShard_t of calling thread
+ * @param parent Pointer to parent node
+ * @param value Pointer to value
+ * @return Pointer to node_t
+ */
+
+static node_t *shardMakeNode(concurrentShard_t *shard, node_t *parent, void *value) {
+    if (!shard->pool)
+        return makeNode(parent, nullptr, nullptr, value);
+
+    // Shards outnumber threads, so the lock is almost never contended
+    while (shard->busy.exchange(true, std::memory_order_acquire))
+        std::this_thread::yield();
+    node_t *node = poolMakeNode(shard->pool, parent, nullptr, nullptr, value);
+    shard->busy.store(false, std::memory_order_release);
+
+    return node;
+}
+
+/**
+ * Function that returns node that has not been attached to the allocator of calling thread shard
+ * @param shard Pointer to concurrentShard_t of calling thread
+ * @param node Pointer to node made by shardMakeNode
+ */
+
+static void shardFreeNode(concurrentShard_t *shard, node_t *node) {
+    if (!shard->pool) {
+        deleteNode(node);
+        return;
+    }
+
+    while (shard->busy.exchange(true, std::memory_order_acquire))
+        std::this_thread::yield();
+    poolFreeNode(shard->pool, node);
+    shard->busy.store(false, std::memory_order_release);
+}
+
+/**
+ * Function that attaches new node to the empty child slot
+ * @param tree Pointer to concurrentTree_t
+ * @param node Pointer to target node
+ * @param slot Pointer to left or right field of target node
+ * @param value Pointer to value for new node
+ * @return Pointer to new node, nullptr if the slot is taken already
+ */
+
+static node_t *concurrentAttach(concurrentTree_t *tree, node_t *node, node_t **slot, void *value) {
+    if (__atomic_load_n(slot, __ATOMIC_ACQUIRE)) {
+        tree->conflicts.fetch_add(1, std::memory_order_relaxed);
+        return nullptr;
+    }
+
+    concurrentShard_t *shard = &tree->shards[threadIndex % tree->shardCount];
+    node_t *child = shardMakeNode(shard, node, value);
+
+    // Release publishes the new node fields to the threads that read the slot with acquire
+    node_t *expected = nullptr;
+    if (!__atomic_compare_exchange_n(slot, &expected, child, false, __ATOMIC_RELEASE, __ATOMIC_RELAXED)) {
+        shardFreeNode(shard, child);
+        tree->conflicts.fetch_add(1, std::memory_order_relaxed);
+        return nullptr;
+    }
+
+    shard->count.fetch_add(1, std::memory_order_relaxed);
+    return child;
+}
+
+/**
+ * Function that adds left node from any thread. Unlike addLeftNode, taken slot is left as is
+ * @param tree Pointer to concurrentTree_t
+ * @param node Pointer to target node
+ * @param value Pointer to value for new node
+ * @return Pointer to new node, nullptr if node has left child already
+ */
+
+node_t *concurrentAddLeftNode(concurrentTree_t *tree, node_t *node, void *value) {
+    assert(tree);
+    assert(node);
+
+    return concurrentAttach(tree, node, &node->left, value);
+}
+
+/**
+ * Function that adds right node from any thread. Unlike addRightNode, taken slot is left as is
+ * @param tree Pointer to concurrentTree_t
+ * @param node Pointer to target node
+ * @param value Pointer to value for new node
+ * @return Pointer to new node, nullptr if node has right child already
+ */
+
+node_t *concurrentAddRightNode(concurrentTree_t *tree, node_t *node, void *value) {
+    assert(tree);
+    assert(node);
+
+    return concurrentAttach(tree, node, &node->right, value);
+}
+
+/**
+ * Function that gets left node attached by any thread
+ * @param node Pointer to node
+ * @return Pointer to left node
+ */
+
+node_t *concurrentGetLeft(node_t *node) {
+    assert(node);
+
+    return __atomic_load_n(&node->left, __ATOMIC_ACQUIRE);
+}
+
+/**
+ * Function that gets right node attached by any thread
+ * @param node Pointer to node
+ * @return Pointer to right node
+ */
+
+node_t *concurrentGetRight(node_t *node) {
+    assert(node);
+
+    return __atomic_load_n(&node->right, __ATOMIC_ACQUIRE);
+}
+
+/**
+ * Function that sums size shards. Result is exact once writers are done and approximate while they work
+ * @param tree Pointer to concurrentTree_t
+ * @return Number of nodes below the head, like tree_t::size
+ */
+
+size_t concurrentSize(const concurrentTree_t *tree) {
+    assert(tree);
+
+    size_t size = tree->tree->size;
+    for (size_t index = 0; index < tree->shardCount; index++)
+        size += tree->shards[index].count.load(std::memory_order_relaxed);
+
+    return size;
+}
+
+/**
+ * Concurrent mode "destructor". Must be called when all the writers are done. Folds shards into tree size and
+ * node pool and recomputes TREE_AUGMENT fields
+ * @param tree Pointer to concurrentTree_t
+ * @return Number of attaches that found their slot taken
+ */
+
+size_t endConcurrent(concurrentTree_t *tree) {
+    assert(tree);
+
+    tree_t *target = tree->tree;
+    target->size = concurrentSize(tree);
+
+    for (size_t index = 0; index < tree->shardCount; index++) {
+        if (tree->shards[index].pool)
+            poolMerge(target->pool, tree->shards[index].pool);
+    }
+
+    // Ancestors of attached nodes were not updated on the way, one pass is cheaper than a path per node anyway
+    treeAugment(target->head);
+
+    size_t conflicts = tree->conflicts.load();
+    countedFree(tree->shards);
+    countedFree(tree);
+
+    return conflicts;
+}
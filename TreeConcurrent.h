@@ -0,0 +1,50 @@
+//
+// Created by alexey on 17.10.2026.
+//
+
+#ifndef TREE_TREECONCURRENT_H
+#define TREE_TREECONCURRENT_H
+#include "Tree.h"
+#include <atomic>
+
+/*
+ * Concurrent mode lets several threads attach children to one tree without a global lock. A child slot is claimed
+ * with compare-and-swap, so a slot that is already taken is reported to the caller instead of being overwritten.
+ * Size is counted in per-thread shards that live in cache lines of their own, pooled trees get a node pool per shard.
+ *
+ * Between beginConcurrent and endConcurrent the tree may only be read and grown through the concurrent functions:
+ * no deletion, no serial cache, no plain add functions. Threads that walk into nodes attached by other threads read
+ * children with concurrentGetLeft / concurrentGetRight. With TREE_AUGMENT, node fields are brought up to date
+ * by endConcurrent.
+ */
+
+const size_t CONCURRENT_CACHE_LINE = 64;
+const size_t CONCURRENT_SHARDS_PER_THREAD = 2;
+
+struct alignas(CONCURRENT_CACHE_LINE) concurrentShard_t {
+    std::atomic<size_t> count;
+    std::atomic<bool> busy;
+    nodePool_t *pool;
+};
+
+struct concurrentTree_t {
+    tree_t *tree;
+    concurrentShard_t *shards;
+    size_t shardCount;
+    std::atomic<size_t> conflicts;
+};
+
+concurrentTree_t *beginConcurrent(tree_t *tree, size_t shards = 0);
+
+node_t *concurrentAddLeftNode(concurrentTree_t *tree, node_t *node, void *value);
+
+node_t *concurrentAddRightNode(concurrentTree_t *tree, node_t *node, void *value);
+
+node_t *concurrentGetLeft(node_t *node);
+
+node_t *concurrentGetRight(node_t *node);
+
+size_t concurrentSize(const concurrentTree_t *tree);
+
+size_t endConcurrent(concurrentTree_t *tree);
+#endif //TREE_TREECONCURRENT_H
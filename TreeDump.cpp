@@ -0,0 +1,248 @@
+//
+// Created by alexey on 17.10.2026.
+//
+
+/*
+ * Compact DOT dump. Nodes get short sequential ids in preorder (n0, n1, ...) and the whole dump goes through one
+ * sink buffer. Parts of the tree cut off by depth limit or node budget are replaced with "… N more" summary nodes,
+ * so the dump of a huge tree stays small enough for Graphviz. Without TREE_AUGMENT summaries count at most
+ * DUMP_COUNT_LIMIT nodes and show "N+" beyond that. Values are appended by a writer, nothing is leaked.
+ */
+
+#include "Tree.h"
+#include "TreeWriter.h"
+
+static const char DUMP_HEADER[] = "digraph {\nnode [shape=box, style=filled, fontname=monospace];\n";
+static const char DUMP_FOOTER[] = "}\n";
+
+struct dumpFrame_t {
+    node_t *node;
+    size_t depth;
+    size_t parentId;
+};
+
+struct dumpState_t {
+    outputSink_t *sink;
+    functionValueWriter_t writer;
+    dumpFrame_t *stack;
+    size_t stackSize;
+    size_t stackCapacity;
+    size_t nodeCount;
+    size_t summaryCount;
+    char *scratch;
+    size_t scratchCapacity;
+};
+
+/**
+ * Function that counts nodes of the subtree. O(1) with TREE_AUGMENT, otherwise gives up at DUMP_COUNT_LIMIT, so that
+ * a limited dump takes time proportional to its output
+ * @param root Pointer to subtree root, may be nullptr
+ * @return Number of nodes, DUMP_COUNT_LIMIT if there are at least that many without TREE_AUGMENT
+ */
+
+static size_t countElided(node_t *root) {
+    if (!root)
+        return 0;
+
+#ifdef TREE_AUGMENT
+    return root->subtreeSize;
+#else
+    size_t count = 0;
+    for (node_t *node : preorder(root)) {
+        (void) node;
+        if (++count == DUMP_COUNT_LIMIT)
+            break;
+    }
+
+    return count;
+#endif
+}
+
+/**
+ * Function that appends value escaped for DOT double-quoted string. Value is written to a scratch buffer first, so
+ * that escaped length is known before room is taken from the sink: file sinks flush when making room
+ * @param state Pointer to dumpState_t
+ * @param value Pointer to value
+ */
+
+static void dumpValue(dumpState_t *state, void *value) {
+    size_t length = state->writer(value, state->scratch, state->scratchCapacity);
+    if (length > state->scratchCapacity) {
+        state->scratchCapacity = length * 2;
+        state->scratch = (char *) countedRealloc(state->scratch, state->scratchCapacity);
+        assert(state->scratch);
+        state->writer(value, state->scratch, length);
+    }
+
+    size_t special = 0;
+    for (size_t index = 0; index < length; index++)
+        if (state->scratch[index] == '"' || state->scratch[index] == '\\')
+            special++;
+
+    char *to = sinkReserve(state->sink, length + special);
+    for (size_t index = 0; index < length; index++) {
+        char symbol = state->scratch[index];
+        if (symbol == '"' || symbol == '\\')
+            *to++ = '\\';
+        *to++ = symbol;
+    }
+    sinkCommit(state->sink, length + special);
+}
+
+/**
+ * Function that writes node record and edge from its parent
+ * @param state Pointer to dumpState_t
+ * @param frame Pointer to dumpFrame_t of the node
+ * @param head Whether node is the tree head
+ * @return Id of the node
+ */
+
+static size_t dumpNode(dumpState_t *state, const dumpFrame_t *frame, bool head) {
+    outputSink_t *sink = state->sink;
+    node_t *node = frame->node;
+    size_t id = state->nodeCount++;
+
+    const char *color = "mediumturquoise";
+    if (!head && node->parent)
+        color = node->parent->left == node ? "indianred" : "springgreen";
+
+    char *buffer = sinkReserve(sink, 96);
+    sinkCommit(sink, snprintf(buffer, 96, "n%zu [fillcolor=%s", id, color));
+
+    if (state->writer.writeValue) {
+        sinkPut(sink, ", label=\"", 9);
+        dumpValue(state, node->value);
+        sinkPut(sink, "\"", 1);
+    }
+    sinkPut(sink, "];\n", 3);
+
+    if (frame->parentId != DUMP_UNLIMITED) {
+        buffer = sinkReserve(sink, 64);
+        sinkCommit(sink, snprintf(buffer, 64, "n%zu -> n%zu;\n", frame->parentId, id));
+    }
+
+    return id;
+}
+
+/**
+ * Function that writes summary node for elided nodes
+ * @param state Pointer to dumpState_t
+ * @param parentId Id of the node that elided nodes hang from
+ * @param count Number of elided nodes, DUMP_COUNT_LIMIT or more means at least that many without TREE_AUGMENT
+ */
+
+static void dumpSummary(dumpState_t *state, size_t parentId, size_t count) {
+    if (!count)
+        return;
+
+#ifdef TREE_AUGMENT
+    const char *atLeast = "";
+#else
+    const char *atLeast = count >= DUMP_COUNT_LIMIT ? "+" : "";
+    count = count < DUMP_COUNT_LIMIT ? count : DUMP_COUNT_LIMIT;
+#endif
+
+    size_t id = state->summaryCount++;
+    char *buffer = sinkReserve(state->sink, 192);
+    sinkCommit(state->sink, snprintf(buffer, 192, "s%zu [shape=note, fillcolor=lightgrey, label=\"\xE2\x80\xA6 %zu%s more\"];"
+                                                  "\nn%zu -> s%zu [style=dashed];\n",
+                                     id, count, atLeast, parentId, id));
+}
+
+/**
+ * Function that pushes node to the walk stack
+ * @param state Pointer to dumpState_t
+ * @param node Pointer to node_t
+ * @param depth Depth of the node below dump root
+ * @param parentId Id of the parent node
+ */
+
+static void dumpPush(dumpState_t *state, node_t *node, size_t depth, size_t parentId) {
+    if (state->stackSize == state->stackCapacity) {
+        state->stackCapacity *= 2;
+        state->stack = (dumpFrame_t *) countedRealloc(state->stack, state->stackCapacity * sizeof(dumpFrame_t));
+        assert(state->stack);
+    }
+
+    state->stack[state->stackSize++] = {node, depth, parentId};
+}
+
+/**
+ * Function that dumps tree in compact DOT format
+ * @param tree Pointer to tree_t
+ * @param sink Pointer to outputSink_t
+ * @param options Pointer to dumpOptions_t, nullptr to dump whole tree without values
+ * @return false if any write has failed
+ */
+
+bool treeDumpCompact(tree_t *tree, outputSink_t *sink, const dumpOptions_t *options) {
+    assert(tree);
+    assert(sink);
+
+    treeExpandAll(tree);
+
+    dumpOptions_t defaults = {nullptr, DUMP_UNLIMITED, DUMP_UNLIMITED, nullptr};
+    if (!options)
+        options = &defaults;
+
+    node_t *root = options->root ? options->root : tree->head;
+    dumpState_t state = {sink, {options->writeValue}, nullptr, 0, 64, 0, 0, nullptr, SINK_VALUE_RESERVE};
+    state.stack = (dumpFrame_t *) countedCalloc(state.stackCapacity, sizeof(dumpFrame_t));
+    state.scratch = (char *) countedMalloc(state.scratchCapacity);
+    assert(state.stack && state.scratch);
+
+    sinkPut(sink, DUMP_HEADER, sizeof(DUMP_HEADER) - 1);
+    dumpPush(&state, root, 0, DUMP_UNLIMITED);
+
+    while (state.stackSize) {
+        dumpFrame_t frame = state.stack[--state.stackSize];
+
+        // Budget is spent: every subtree still waiting for its turn becomes one summary
+        if (state.nodeCount >= options->maxNodes) {
+            if (frame.parentId != DUMP_UNLIMITED)
+                dumpSummary(&state, frame.parentId, countElided(frame.node));
+            continue;
+        }
+
+        size_t id = dumpNode(&state, &frame, frame.node == tree->head);
+        node_t *node = frame.node;
+
+        if (frame.depth == options->maxDepth) {
+            dumpSummary(&state, id, countElided(node->left) + countElided(node->right));
+            continue;
+        }
+
+        if (node->right)
+            dumpPush(&state, node->right, frame.depth + 1, id);
+        if (node->left)
+            dumpPush(&state, node->left, frame.depth + 1, id);
+    }
+
+    sinkPut(sink, DUMP_FOOTER, sizeof(DUMP_FOOTER) - 1);
+    countedFree(state.stack);
+    countedFree(state.scratch);
+    return sinkFlush(sink);
+}
+
+/**
+ * Function that dumps tree in compact DOT format into file
+ * @param tree Pointer to tree_t
+ * @param filename Dump file name
+ * @param options Pointer to dumpOptions_t, nullptr to dump whole tree without values
+ * @return false if file can not be opened or any write has failed
+ */
+
+bool treeDumpCompact(tree_t *tree, const char *filename, const dumpOptions_t *options) {
+    assert(tree);
+    assert(filename);
+
+    FILE *dumpFile = fopen(filename, "w");
+    if (!dumpFile)
+        return false;
+
+    outputSink_t *sink = makeFileSink(dumpFile);
+    bool written = treeDumpCompact(tree, sink, options);
+    written = deleteSink(sink) && written;
+
+    return fclose(dumpFile) == 0 && written;
+}
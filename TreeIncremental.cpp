@@ -0,0 +1,610 @@
+//
+// Created by alexey on 17.10.2026.
+//
+
+/*
+ * Incremental serialization. Text of the last save is kept in fragments: a fragment holds text of one subtree,
+ * where subtrees of nested fragments are left out as holes. Every subtree whose text grows to fragmentBytes becomes
+ * a fragment of its own, head fragment covers the rest. Changes through the tree functions mark the fragment
+ * containing the changed node dirty and its ancestor fragments dirty below, walking up through parent pointers.
+ * Save re-encodes dirty fragments only and splices the rest, so encoding cost follows the size of the change.
+ */
+
+#include "Tree.h"
+#include "TreeParser.h"
+#include "TreeWriter.h"
+#include <cstdint>
+
+struct serialFragment_t;
+
+struct serialHole_t {
+    size_t offset;
+    serialFragment_t *fragment;
+};
+
+struct serialFragment_t {
+    node_t *node;
+    char *text;
+    size_t length;
+    serialHole_t *holes;
+    size_t holeCount;
+    size_t generation;
+    bool dirty;
+    bool dirtyBelow;
+};
+
+struct encodeFrame_t {
+    node_t *node;
+    PARSE_STATE state;
+    size_t start;
+    size_t holeStart;
+};
+
+struct spliceFrame_t {
+    const serialFragment_t *fragment;
+    size_t hole;
+    size_t position;
+};
+
+struct serialCache_t {
+    functionValueWriter_t writer;
+    size_t fragmentBytes;
+    serialFragment_t *root;
+    size_t generation;
+
+    node_t **keys;
+    serialFragment_t **fragments;
+    size_t capacity;
+    size_t used;
+
+    outputSink_t *scratch;
+    serialHole_t *holes;
+    size_t holeCount;
+    size_t holeCapacity;
+    serialFragment_t **work;
+    size_t workCount;
+    size_t workCapacity;
+};
+
+static node_t REMOVED_KEY = {};
+
+/**
+ * Function that finds slot of node in fragment table
+ * @param cache Pointer to serialCache_t
+ * @param node Pointer to node_t
+ * @return Slot of the node or of the empty key where it would be
+ */
+
+static size_t cacheSlot(const serialCache_t *cache, const node_t *node) {
+    size_t slot = ((uintptr_t) node >> 4) * (size_t) 0x9e3779b97f4a7c15ULL;
+    slot = (slot ^ (slot >> (sizeof(size_t) * 4))) & (cache->capacity - 1);
+
+    while (cache->keys[slot] && cache->keys[slot] != node)
+        slot = (slot + 1) & (cache->capacity - 1);
+
+    return slot;
+}
+
+/**
+ * Function that finds fragment rooted at node
+ * @param cache Pointer to serialCache_t
+ * @param node Pointer to node_t
+ * @return Pointer to serialFragment_t or nullptr
+ */
+
+static serialFragment_t *cacheFind(const serialCache_t *cache, const node_t *node) {
+    size_t slot = cacheSlot(cache, node);
+    return cache->keys[slot] ? cache->fragments[slot] : nullptr;
+}
+
+/**
+ * Function that rebuilds fragment table with the given capacity, dropping removed keys
+ * @param cache Pointer to serialCache_t
+ * @param capacity New capacity, power of two
+ */
+
+static void cacheRehash(serialCache_t *cache, size_t capacity) {
+    node_t **keys = cache->keys;
+    serialFragment_t **fragments = cache->fragments;
+    size_t oldCapacity = cache->capacity;
+
+    cache->keys = (node_t **) countedCalloc(capacity, sizeof(node_t *));
+    cache->fragments = (serialFragment_t **) countedCalloc(capacity, sizeof(serialFragment_t *));
+    assert(cache->keys && cache->fragments);
+    cache->capacity = capacity;
+    cache->used = 0;
+
+    for (size_t slot = 0; slot < oldCapacity; slot++) {
+        if (!keys[slot] || keys[slot] == &REMOVED_KEY)
+            continue;
+
+        size_t target = cacheSlot(cache, keys[slot]);
+        cache->keys[target] = keys[slot];
+        cache->fragments[target] = fragments[slot];
+        cache->used++;
+    }
+
+    countedFree(keys);
+    countedFree(fragments);
+}
+
+/**
+ * Function that creates fragment for subtree and puts it to fragment table
+ * @param cache Pointer to serialCache_t
+ * @param node Subtree root
+ * @return Pointer to serialFragment_t without text
+ */
+
+static serialFragment_t *makeFragment(serialCache_t *cache, node_t *node) {
+    if ((cache->used + 1) * 2 > cache->capacity)
+        cacheRehash(cache, cache->capacity * 2);
+
+    auto *fragment = (serialFragment_t *) countedCalloc(1, sizeof(serialFragment_t));
+    assert(fragment);
+    fragment->node = node;
+
+    size_t slot = cacheSlot(cache, node);
+    cache->keys[slot] = node;
+    cache->fragments[slot] = fragment;
+    cache->used++;
+
+    return fragment;
+}
+
+/**
+ * Function that frees fragment with all the fragments nested in it. Does not recurse
+ * @param cache Pointer to serialCache_t
+ * @param fragment Pointer to serialFragment_t
+ */
+
+static void deleteFragments(serialCache_t *cache, serialFragment_t *fragment) {
+    size_t capacity = 16;
+    size_t size = 0;
+    auto *stack = (serialFragment_t **) countedCalloc(capacity, sizeof(serialFragment_t *));
+    assert(stack);
+    stack[size++] = fragment;
+
+    while (size) {
+        serialFragment_t *current = stack[--size];
+
+        for (size_t hole = 0; hole < current->holeCount; hole++) {
+            if (size == capacity) {
+                capacity *= 2;
+                stack = (serialFragment_t **) countedRealloc(stack, capacity * sizeof(serialFragment_t *));
+                assert(stack);
+            }
+            stack[size++] = current->holes[hole].fragment;
+        }
+
+        // Node of a fragment that is still in the table may have been reused by another fragment already
+        if (current->node) {
+            size_t slot = cacheSlot(cache, current->node);
+            if (cache->keys[slot] && cache->fragments[slot] == current)
+                cache->keys[slot] = &REMOVED_KEY;
+        }
+
+        countedFree(current->text);
+        countedFree(current->holes);
+        countedFree(current);
+    }
+
+    countedFree(stack);
+}
+
+/**
+ * Function that adds hole to the fragment being encoded
+ * @param cache Pointer to serialCache_t
+ * @param fragment Pointer to nested serialFragment_t
+ */
+
+static void addHole(serialCache_t *cache, serialFragment_t *fragment) {
+    if (cache->holeCount == cache->holeCapacity) {
+        cache->holeCapacity = cache->holeCapacity ? cache->holeCapacity * 2 : 16;
+        cache->holes = (serialHole_t *) countedRealloc(cache->holes, cache->holeCapacity * sizeof(serialHole_t));
+        assert(cache->holes);
+    }
+
+    fragment->generation = cache->generation;
+    cache->holes[cache->holeCount++] = {cache->scratch->used, fragment};
+}
+
+/**
+ * Function that puts fragment on the work stack
+ * @param cache Pointer to serialCache_t
+ * @param fragment Pointer to serialFragment_t
+ */
+
+static void pushWork(serialCache_t *cache, serialFragment_t *fragment) {
+    if (cache->workCount == cache->workCapacity) {
+        cache->workCapacity = cache->workCapacity ? cache->workCapacity * 2 : 16;
+        cache->work = (serialFragment_t **) countedRealloc(cache->work,
+                                                           cache->workCapacity * sizeof(serialFragment_t *));
+        assert(cache->work);
+    }
+
+    cache->work[cache->workCount++] = fragment;
+}
+
+/**
+ * Function that schedules fragment for the current save if it or something below it has changed
+ * @param cache Pointer to serialCache_t
+ * @param fragment Pointer to serialFragment_t
+ */
+
+static void scheduleFragment(serialCache_t *cache, serialFragment_t *fragment) {
+    if (fragment->dirty || fragment->dirtyBelow)
+        pushWork(cache, fragment);
+}
+
+/**
+ * Function that moves text and holes written since start into fragment
+ * @param cache Pointer to serialCache_t
+ * @param fragment Pointer to serialFragment_t
+ * @param start Offset of fragment text in scratch sink
+ * @param holeStart Index of the first hole of the fragment
+ */
+
+static void takeText(serialCache_t *cache, serialFragment_t *fragment, size_t start, size_t holeStart) {
+    countedFree(fragment->text);
+    countedFree(fragment->holes);
+
+    fragment->length = cache->scratch->used - start;
+    fragment->text = (char *) countedMalloc(fragment->length ? fragment->length : 1);
+    assert(fragment->text);
+    memcpy(fragment->text, cache->scratch->buffer + start, fragment->length);
+
+    fragment->holeCount = cache->holeCount - holeStart;
+    size_t holeSlots = fragment->holeCount ? fragment->holeCount : 1;
+    fragment->holes = (serialHole_t *) countedCalloc(holeSlots, sizeof(serialHole_t));
+    assert(fragment->holes);
+    for (size_t hole = 0; hole < fragment->holeCount; hole++) {
+        fragment->holes[hole] = cache->holes[holeStart + hole];
+        fragment->holes[hole].offset -= start;
+    }
+
+    cache->scratch->used = start;
+    cache->holeCount = holeStart;
+}
+
+/**
+ * Function that re-encodes dirty fragment. Fragments met on the way become holes and are scheduled if changed,
+ * new subtrees that grow to fragmentBytes are cut out into new fragments, old nested fragments that are not met
+ * any more are freed
+ * @param cache Pointer to serialCache_t
+ * @param fragment Pointer to serialFragment_t
+ */
+
+static void encodeFragment(serialCache_t *cache, serialFragment_t *fragment) {
+    outputSink_t *scratch = cache->scratch;
+    sinkReset(scratch);
+    cache->holeCount = 0;
+
+    size_t capacity = 64;
+    size_t size = 0;
+    auto *stack = (encodeFrame_t *) countedCalloc(capacity, sizeof(encodeFrame_t));
+    assert(stack);
+
+    sinkPut(scratch, "\"", 1);
+    sinkPutValue(scratch, cache->writer, fragment->node->value);
+    sinkPut(scratch, "\" ", 2);
+    stack[size++] = {fragment->node, AFTER_VALUE, 0, 0};
+
+    while (size) {
+        encodeFrame_t *top = &stack[size - 1];
+        node_t *child = nullptr;
+
+        if (top->state == AFTER_VALUE) {
+            top->state = AFTER_LEFT;
+            child = top->node->left;
+            if (!child && top->node->right)
+                sinkPut(scratch, "$ ", 2);
+        } else if (top->state == AFTER_LEFT) {
+            top->state = AFTER_RIGHT;
+            child = top->node->right;
+        } else {
+            encodeFrame_t done = stack[--size];
+            if (!size)
+                break;
+
+            if (scratch->used - done.start >= cache->fragmentBytes) {
+                serialFragment_t *nested = makeFragment(cache, done.node);
+                takeText(cache, nested, done.start, done.holeStart);
+                addHole(cache, nested);
+            }
+            sinkPut(scratch, "} ", 2);
+            continue;
+        }
+
+        if (!child)
+            continue;
+
+        sinkPut(scratch, "{ ", 2);
+        serialFragment_t *nested = cacheFind(cache, child);
+        if (nested) {
+            addHole(cache, nested);
+            scheduleFragment(cache, nested);
+            sinkPut(scratch, "} ", 2);
+            continue;
+        }
+
+        if (size == capacity) {
+            capacity *= 2;
+            stack = (encodeFrame_t *) countedRealloc(stack, capacity * sizeof(encodeFrame_t));
+            assert(stack);
+        }
+        stack[size++] = {child, AFTER_VALUE, scratch->used, cache->holeCount};
+
+        sinkPut(scratch, "\"", 1);
+        sinkPutValue(scratch, cache->writer, child->value);
+        sinkPut(scratch, "\" ", 2);
+    }
+
+    countedFree(stack);
+
+    // Old holes that have not been met again belong to removed or replaced subtrees
+    serialHole_t *oldHoles = fragment->holes;
+    size_t oldHoleCount = fragment->holeCount;
+    fragment->holes = nullptr;
+
+    takeText(cache, fragment, 0, 0);
+
+    for (size_t hole = 0; hole < oldHoleCount; hole++)
+        if (oldHoles[hole].fragment->generation != cache->generation)
+            deleteFragments(cache, oldHoles[hole].fragment);
+    countedFree(oldHoles);
+}
+
+/**
+ * Function that writes spliced text of fragment and everything nested in it. Does not recurse
+ * @param cache Pointer to serialCache_t
+ * @param sink Pointer to outputSink_t
+ */
+
+static void spliceFragments(const serialCache_t *cache, outputSink_t *sink) {
+    size_t capacity = 64;
+    size_t size = 0;
+    auto *stack = (spliceFrame_t *) countedCalloc(capacity, sizeof(spliceFrame_t));
+    assert(stack);
+    stack[size++] = {cache->root, 0, 0};
+
+    while (size) {
+        spliceFrame_t *top = &stack[size - 1];
+        const serialFragment_t *fragment = top->fragment;
+
+        if (top->hole == fragment->holeCount) {
+            sinkPut(sink, fragment->text + top->position, fragment->length - top->position);
+            size--;
+            continue;
+        }
+
+        const serialHole_t *hole = &fragment->holes[top->hole++];
+        sinkPut(sink, fragment->text + top->position, hole->offset - top->position);
+        top->position = hole->offset;
+
+        if (size == capacity) {
+            capacity *= 2;
+            stack = (spliceFrame_t *) countedRealloc(stack, capacity * sizeof(spliceFrame_t));
+            assert(stack);
+        }
+        stack[size++] = {hole->fragment, 0, 0};
+    }
+
+    countedFree(stack);
+}
+
+/**
+ * Function that turns incremental serialization on. The first save encodes the whole tree, later ones only what has
+ * changed through addLeftNode, addRightNode, addLeftSubtree, addRightSubtree, deleteNode and treeMarkDirty
+ * @param tree Pointer to tree_t
+ * @param writeValue Function that appends value to the buffer if it fits and returns value length
+ * @param fragmentBytes Text length at which subtree gets a fragment of its own
+ */
+
+void treeEnableSerialCache(tree_t *tree, size_t (*writeValue)(void *, char *, size_t), size_t fragmentBytes) {
+    assert(tree);
+    assert(writeValue);
+    assert(fragmentBytes);
+
+    treeExpandAll(tree);
+
+    if (tree->cache)
+        treeDisableSerialCache(tree);
+
+    auto *cache = (serialCache_t *) countedCalloc(1, sizeof(serialCache_t));
+    assert(cache);
+
+    cache->writer = {writeValue};
+    cache->fragmentBytes = fragmentBytes;
+    cache->capacity = 64;
+    cache->keys = (node_t **) countedCalloc(cache->capacity, sizeof(node_t *));
+    cache->fragments = (serialFragment_t **) countedCalloc(cache->capacity, sizeof(serialFragment_t *));
+    assert(cache->keys && cache->fragments);
+    cache->scratch = makeMemorySink();
+
+    tree->cache = cache;
+}
+
+/**
+ * Function that turns incremental serialization off and frees cached text
+ * @param tree Pointer to tree_t
+ */
+
+void treeDisableSerialCache(tree_t *tree) {
+    assert(tree);
+
+    serialCache_t *cache = tree->cache;
+    if (!cache)
+        return;
+
+    if (cache->root)
+        deleteFragments(cache, cache->root);
+
+    countedFree(cache->keys);
+    countedFree(cache->fragments);
+    deleteSink(cache->scratch);
+    countedFree(cache->holes);
+    countedFree(cache->work);
+    countedFree(cache);
+
+    tree->cache = nullptr;
+}
+
+/**
+ * Function that tells incremental serialization that node has changed. Tree functions call it themselves, callers
+ * have to call it after changing node value or links directly
+ * @param tree Pointer to tree_t
+ * @param node Pointer to changed node
+ */
+
+void treeMarkDirty(tree_t *tree, node_t *node) {
+    assert(tree);
+    assert(node);
+
+    serialCache_t *cache = tree->cache;
+    if (!cache || !cache->root)
+        return;
+
+    // Head always has a fragment, so the walk stops at the latest there
+    serialFragment_t *fragment = nullptr;
+    while (!(fragment = cacheFind(cache, node)))
+        node = node->parent;
+
+    // Dirty fragment has all its ancestors marked already
+    if (fragment->dirty)
+        return;
+    fragment->dirty = true;
+
+    for (node = node->parent; node; node = node->parent) {
+        fragment = cacheFind(cache, node);
+        if (!fragment)
+            continue;
+
+        bool marked = fragment->dirty || fragment->dirtyBelow;
+        fragment->dirtyBelow = true;
+        if (marked)
+            return;
+    }
+}
+
+/**
+ * Function that forgets fragment rooted at node that is being freed, so that a new node at the same address
+ * does not get its text
+ * @param tree Pointer to tree_t
+ * @param node Pointer to node_t
+ */
+
+void treeForgetNode(tree_t *tree, node_t *node) {
+    serialCache_t *cache = tree->cache;
+
+    size_t slot = cacheSlot(cache, node);
+    if (!cache->keys[slot])
+        return;
+
+    cache->fragments[slot]->node = nullptr;
+    cache->keys[slot] = &REMOVED_KEY;
+}
+
+/**
+ * Function that checks whether node lies in subtree of root, looking no higher than stop
+ * @param node Pointer to node_t
+ * @param root Pointer to subtree root
+ * @param stop Pointer to ancestor of root where the walk ends
+ * @return true if root is node or its ancestor
+ */
+
+static bool nodeBelow(const node_t *node, const node_t *root, const node_t *stop) {
+    for (; node && node != stop; node = node->parent) {
+        if (node == root)
+            return true;
+    }
+
+    return false;
+}
+
+/**
+ * Function that forgets all the fragments inside subtree that leaves the tree without being freed. Walks the
+ * fragments rather than the nodes, so it takes O(fragments in subtree + holes of enclosing fragment * depth)
+ * @param tree Pointer to tree_t with serial cache enabled
+ * @param node Pointer to subtree root, still linked to its parent
+ */
+
+void treeForgetSubtree(tree_t *tree, node_t *node) {
+    serialCache_t *cache = tree->cache;
+    if (!cache->root)
+        return;
+
+    // Head always has a fragment, so the walk stops at the latest there
+    node_t *current = node;
+    serialFragment_t *outer = nullptr;
+    while (!(outer = cacheFind(cache, current)))
+        current = current->parent;
+
+    cache->workCount = 0;
+    if (current == node) {
+        pushWork(cache, outer);
+    } else {
+        for (size_t hole = 0; hole < outer->holeCount; hole++) {
+            serialFragment_t *fragment = outer->holes[hole].fragment;
+            if (nodeBelow(fragment->node, node, outer->node))
+                pushWork(cache, fragment);
+        }
+    }
+
+    while (cache->workCount) {
+        serialFragment_t *fragment = cache->work[--cache->workCount];
+        for (size_t hole = 0; hole < fragment->holeCount; hole++)
+            pushWork(cache, fragment->holes[hole].fragment);
+
+        if (!fragment->node)
+            continue;
+
+        size_t slot = cacheSlot(cache, fragment->node);
+        if (cache->keys[slot] && cache->fragments[slot] == fragment)
+            cache->keys[slot] = &REMOVED_KEY;
+        fragment->node = nullptr;
+    }
+}
+
+/**
+ * Function that serializes tree in treeSerialize text format, re-encoding only what has changed since the last call
+ * @param tree Pointer to tree_t with serial cache enabled
+ * @param sink Pointer to outputSink_t
+ * @return false if any write has failed
+ */
+
+bool treeSerializeIncremental(tree_t *tree, outputSink_t *sink) {
+    assert(tree);
+    assert(tree->cache);
+    assert(sink);
+
+    serialCache_t *cache = tree->cache;
+    cache->generation++;
+
+    if (!cache->root) {
+        cache->root = makeFragment(cache, tree->head);
+        cache->root->dirty = true;
+    }
+
+    cache->workCount = 0;
+    scheduleFragment(cache, cache->root);
+
+    while (cache->workCount) {
+        serialFragment_t *fragment = cache->work[--cache->workCount];
+
+        if (fragment->dirty) {
+            encodeFragment(cache, fragment);
+        } else {
+            for (size_t hole = 0; hole < fragment->holeCount; hole++)
+                scheduleFragment(cache, fragment->holes[hole].fragment);
+        }
+
+        fragment->dirty = false;
+        fragment->dirtyBelow = false;
+    }
+
+    sinkPut(sink, "{ ", 2);
+    spliceFragments(cache, sink);
+    sinkPut(sink, "}", 1);
+
+    return sinkFlush(sink);
+}
@@ -0,0 +1,299 @@
+//
+// Created by alexey on 17.10.2026.
+//
+
+#include "TreeParser.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#define TREE_INDEX_X86
+#include <immintrin.h>
+#endif
+
+/**
+ * Function that turns quote mask into mask of quoted regions: every bit is the XOR of all the quote bits up to it,
+ * so a region covers its opening quote and stops right before the closing one
+ * @param quotes Quote bits of the block
+ * @return Quoted region bits
+ */
+
+static inline uint64_t prefixXor(uint64_t quotes) {
+    quotes ^= quotes << 1;
+    quotes ^= quotes << 2;
+    quotes ^= quotes << 4;
+    quotes ^= quotes << 8;
+    quotes ^= quotes << 16;
+    quotes ^= quotes << 32;
+    return quotes;
+}
+
+/**
+ * Function that finds structural characters of one classified block and appends their positions
+ * @param quotes Quote bits of the block
+ * @param spaces Whitespace bits of the block
+ * @param quoted Pointer to all-ones if the block starts inside quotes and zero otherwise, updated for the next block
+ * @param base Position of the block
+ * @param positions Pointer to store positions at
+ * @return Number of positions stored
+ */
+
+static inline size_t indexBlock(uint64_t quotes, uint64_t spaces, uint64_t *quoted, uint32_t base,
+                                uint32_t *positions) {
+    uint64_t inside = prefixXor(quotes) ^ *quoted;
+    *quoted = (uint64_t) ((int64_t) inside >> 63);
+
+    // Quotes themselves and every non-whitespace byte outside of values
+    uint64_t structural = quotes | (~spaces & ~inside);
+
+    // Positions are written four at a time without checking for the end, so the count is not mispredicted per bit.
+    // Extra writes land in the INDEX_BLOCK slack after the real positions
+    size_t count = (size_t) __builtin_popcountll(structural);
+    for (size_t written = 0; written < count; written += 4) {
+        positions[written] = base + (uint32_t) __builtin_ctzll(structural | 1ULL << 63);
+        structural &= structural - 1;
+        positions[written + 1] = base + (uint32_t) __builtin_ctzll(structural | 1ULL << 63);
+        structural &= structural - 1;
+        positions[written + 2] = base + (uint32_t) __builtin_ctzll(structural | 1ULL << 63);
+        structural &= structural - 1;
+        positions[written + 3] = base + (uint32_t) __builtin_ctzll(structural | 1ULL << 63);
+        structural &= structural - 1;
+    }
+
+    return count;
+}
+
+/**
+ * Function that classifies 64 bytes one at a time
+ * @param block Pointer to 64 bytes
+ * @param quotes Pointer to store quote bits
+ * @param spaces Pointer to store whitespace bits
+ */
+
+static inline void classifyScalar(const char *block, uint64_t *quotes, uint64_t *spaces) {
+    uint64_t quoteBits = 0;
+    uint64_t spaceBits = 0;
+
+    for (unsigned index = 0; index < INDEX_BLOCK; index++) {
+        char byte = block[index];
+        quoteBits |= (uint64_t) (byte == '"') << index;
+        spaceBits |= (uint64_t) (byte == ' ' || byte == '\n' || byte == '\t' || byte == '\r') << index;
+    }
+
+    *quotes = quoteBits;
+    *spaces = spaceBits;
+}
+
+/**
+ * Function that copies the incomplete last block into a whitespace-padded one
+ * @param data Pointer to the last block
+ * @param length Number of bytes left, less than INDEX_BLOCK
+ * @param padded Pointer to INDEX_BLOCK bytes
+ */
+
+static inline void padBlock(const char *data, size_t length, char *padded) {
+    memset(padded, ' ', INDEX_BLOCK);
+    memcpy(padded, data, length);
+}
+
+/**
+ * Scalar kernel of indexStructurals
+ */
+
+static size_t indexScalar(const char *data, size_t length, uint64_t *quoted, uint32_t *positions) {
+    size_t count = 0;
+    uint64_t quotes = 0;
+    uint64_t spaces = 0;
+    size_t offset = 0;
+
+    for (; offset + INDEX_BLOCK <= length; offset += INDEX_BLOCK) {
+        classifyScalar(data + offset, &quotes, &spaces);
+        count += indexBlock(quotes, spaces, quoted, (uint32_t) offset, positions + count);
+    }
+
+    if (offset < length) {
+        char padded[INDEX_BLOCK];
+        padBlock(data + offset, length - offset, padded);
+        classifyScalar(padded, &quotes, &spaces);
+        count += indexBlock(quotes, spaces, quoted, (uint32_t) offset, positions + count);
+    }
+
+    return count;
+}
+
+#ifdef TREE_INDEX_X86
+
+/**
+ * Function that classifies 64 bytes as four SSE2 vectors
+ * @param block Pointer to 64 bytes
+ * @param quotes Pointer to store quote bits
+ * @param spaces Pointer to store whitespace bits
+ */
+
+__attribute__((target("sse2")))
+static inline void classifySse2(const char *block, uint64_t *quotes, uint64_t *spaces) {
+    const __m128i quote = _mm_set1_epi8('"');
+    const __m128i space = _mm_set1_epi8(' ');
+    const __m128i newline = _mm_set1_epi8('\n');
+    const __m128i tab = _mm_set1_epi8('\t');
+    const __m128i carriage = _mm_set1_epi8('\r');
+    uint64_t quoteBits = 0;
+    uint64_t spaceBits = 0;
+
+    for (unsigned index = 0; index < INDEX_BLOCK; index += 16) {
+        __m128i bytes = _mm_loadu_si128((const __m128i *) (block + index));
+        __m128i blank = _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(bytes, space), _mm_cmpeq_epi8(bytes, newline)),
+                                     _mm_or_si128(_mm_cmpeq_epi8(bytes, tab), _mm_cmpeq_epi8(bytes, carriage)));
+        quoteBits |= (uint64_t) (uint16_t) _mm_movemask_epi8(_mm_cmpeq_epi8(bytes, quote)) << index;
+        spaceBits |= (uint64_t) (uint16_t) _mm_movemask_epi8(blank) << index;
+    }
+
+    *quotes = quoteBits;
+    *spaces = spaceBits;
+}
+
+/**
+ * SSE2 kernel of indexStructurals
+ */
+
+__attribute__((target("sse2")))
+static size_t indexSse2(const char *data, size_t length, uint64_t *quoted, uint32_t *positions) {
+    size_t count = 0;
+    uint64_t quotes = 0;
+    uint64_t spaces = 0;
+    size_t offset = 0;
+
+    for (; offset + INDEX_BLOCK <= length; offset += INDEX_BLOCK) {
+        classifySse2(data + offset, &quotes, &spaces);
+        count += indexBlock(quotes, spaces, quoted, (uint32_t) offset, positions + count);
+    }
+
+    if (offset < length) {
+        char padded[INDEX_BLOCK];
+        padBlock(data + offset, length - offset, padded);
+        classifySse2(padded, &quotes, &spaces);
+        count += indexBlock(quotes, spaces, quoted, (uint32_t) offset, positions + count);
+    }
+
+    return count;
+}
+
+/**
+ * Function that classifies 64 bytes as two AVX2 vectors
+ * @param block Pointer to 64 bytes
+ * @param quotes Pointer to store quote bits
+ * @param spaces Pointer to store whitespace bits
+ */
+
+__attribute__((target("avx2")))
+static inline void classifyAvx2(const char *block, uint64_t *quotes, uint64_t *spaces) {
+    const __m256i quote = _mm256_set1_epi8('"');
+    const __m256i space = _mm256_set1_epi8(' ');
+    const __m256i newline = _mm256_set1_epi8('\n');
+    const __m256i tab = _mm256_set1_epi8('\t');
+    const __m256i carriage = _mm256_set1_epi8('\r');
+    uint64_t quoteBits = 0;
+    uint64_t spaceBits = 0;
+
+    for (unsigned index = 0; index < INDEX_BLOCK; index += 32) {
+        __m256i bytes = _mm256_loadu_si256((const __m256i *) (block + index));
+        __m256i blank = _mm256_or_si256(
+                _mm256_or_si256(_mm256_cmpeq_epi8(bytes, space), _mm256_cmpeq_epi8(bytes, newline)),
+                _mm256_or_si256(_mm256_cmpeq_epi8(bytes, tab), _mm256_cmpeq_epi8(bytes, carriage)));
+        quoteBits |= (uint64_t) (uint32_t) _mm256_movemask_epi8(_mm256_cmpeq_epi8(bytes, quote)) << index;
+        spaceBits |= (uint64_t) (uint32_t) _mm256_movemask_epi8(blank) << index;
+    }
+
+    *quotes = quoteBits;
+    *spaces = spaceBits;
+}
+
+/**
+ * AVX2 kernel of indexStructurals
+ */
+
+__attribute__((target("avx2")))
+static size_t indexAvx2(const char *data, size_t length, uint64_t *quoted, uint32_t *positions) {
+    size_t count = 0;
+    uint64_t quotes = 0;
+    uint64_t spaces = 0;
+    size_t offset = 0;
+
+    for (; offset + INDEX_BLOCK <= length; offset += INDEX_BLOCK) {
+        classifyAvx2(data + offset, &quotes, &spaces);
+        count += indexBlock(quotes, spaces, quoted, (uint32_t) offset, positions + count);
+    }
+
+    if (offset < length) {
+        char padded[INDEX_BLOCK];
+        padBlock(data + offset, length - offset, padded);
+        classifyAvx2(padded, &quotes, &spaces);
+        count += indexBlock(quotes, spaces, quoted, (uint32_t) offset, positions + count);
+    }
+
+    return count;
+}
+
+#endif
+
+/**
+ * Function that picks the fastest kernel the CPU supports. CPU is checked once
+ * @return Index kernel
+ */
+
+INDEX_KERNEL indexBestKernel() {
+#ifdef TREE_INDEX_X86
+    static const INDEX_KERNEL best = __builtin_cpu_supports("avx2") ? AVX2_KERNEL :
+                                     __builtin_cpu_supports("sse2") ? SSE2_KERNEL : SCALAR_KERNEL;
+    return best;
+#else
+    return SCALAR_KERNEL;
+#endif
+}
+
+/**
+ * Function that checks whether the CPU can run the kernel
+ * @param kernel Index kernel
+ * @return true if kernel can be used
+ */
+
+bool indexKernelSupported(INDEX_KERNEL kernel) {
+#ifdef TREE_INDEX_X86
+    if (kernel == AVX2_KERNEL)
+        return __builtin_cpu_supports("avx2");
+    if (kernel == SSE2_KERNEL)
+        return __builtin_cpu_supports("sse2");
+#else
+    if (kernel != SCALAR_KERNEL)
+        return false;
+#endif
+
+    return true;
+}
+
+/**
+ * Function that finds structural characters of the text format: quotes and every non-whitespace byte outside of
+ * quoted values. Input is classified 64 bytes at a time, quoted regions are found with prefix XOR of quote bits
+ * @param kernel Index kernel, must be supported by the CPU
+ * @param data Pointer to input
+ * @param length Length of input, less than 4 GiB
+ * @param quoted Pointer to quote state: all-ones if data starts inside quotes, zero otherwise. Updated for the bytes
+ * that follow data
+ * @param positions Pointer to store positions relative to data, room for length + INDEX_BLOCK positions is needed
+ * @return Number of positions stored, in increasing order
+ */
+
+size_t indexStructurals(INDEX_KERNEL kernel, const char *data, size_t length, uint64_t *quoted,
+                        uint32_t *positions) {
+    assert(data || !length);
+    assert(quoted);
+    assert(positions);
+    assert(indexKernelSupported(kernel));
+
+#ifdef TREE_INDEX_X86
+    if (kernel == AVX2_KERNEL)
+        return indexAvx2(data, length, quoted, positions);
+    if (kernel == SSE2_KERNEL)
+        return indexSse2(data, length, quoted, positions);
+#endif
+
+    return indexScalar(data, length, quoted, positions);
+}
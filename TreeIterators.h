@@ -0,0 +1,382 @@
+//
+// Created by alexey on 17.10.2026.
+//
+
+#ifndef TREE_TREEITERATORS_H
+#define TREE_TREEITERATORS_H
+#include "Tree.h"
+
+/*
+ * Traversal iterators. Depth-first orders step through parent pointers and need O(1) extra space, level order
+ * keeps a ring queue owned by its range that only grows when the tree gets wider. None of them allocates per step.
+ * Every function is a template over node type, so any node with left, right and parent fields can be walked:
+ *
+ *     for (node_t *node : preorder(tree))
+ *         ...
+ *
+ * Subtree must not be changed during the walk, except that postorder allows freeing the node just visited: the
+ * iterator finds the next node before the loop body runs.
+ */
+
+enum TRAVERSAL_ORDER {
+    PREORDER,
+    INORDER,
+    POSTORDER
+};
+
+/**
+ * Function that finds first node of the subtree in preorder
+ * @param root Pointer to subtree root
+ * @return Pointer to first node
+ */
+
+template<typename Node>
+inline Node *preorderFirst(Node *root) {
+    return root;
+}
+
+/**
+ * Function that finds next node of the subtree in preorder using parent pointers
+ * @param root Pointer to subtree root
+ * @param node Pointer to current node
+ * @return Pointer to next node or nullptr if node was the last one
+ */
+
+template<typename Node>
+inline Node *preorderNext(Node *root, Node *node) {
+    if (node->left)
+        return node->left;
+
+    if (node->right)
+        return node->right;
+
+    while (node != root) {
+        Node *parent = node->parent;
+        if (parent->left == node && parent->right)
+            return parent->right;
+        node = parent;
+    }
+
+    return nullptr;
+}
+
+/**
+ * Function that finds first node of the subtree in inorder, i. e. the leftmost one
+ * @param root Pointer to subtree root
+ * @return Pointer to first node
+ */
+
+template<typename Node>
+inline Node *inorderFirst(Node *root) {
+    while (root->left)
+        root = root->left;
+
+    return root;
+}
+
+/**
+ * Function that finds next node of the subtree in inorder using parent pointers
+ * @param root Pointer to subtree root
+ * @param node Pointer to current node
+ * @return Pointer to next node or nullptr if node was the last one
+ */
+
+template<typename Node>
+inline Node *inorderNext(Node *root, Node *node) {
+    if (node->right)
+        return inorderFirst(node->right);
+
+    while (node != root) {
+        Node *parent = node->parent;
+        if (parent->left == node)
+            return parent;
+        node = parent;
+    }
+
+    return nullptr;
+}
+
+/**
+ * Function that finds first node of the subtree in postorder, i. e. the leftmost leaf
+ * @param root Pointer to subtree root
+ * @return Pointer to first node
+ */
+
+template<typename Node>
+inline Node *postorderFirst(Node *root) {
+    while (true) {
+        if (root->left)
+            root = root->left;
+        else if (root->right)
+            root = root->right;
+        else
+            return root;
+    }
+}
+
+/**
+ * Function that finds next node of the subtree in postorder using parent pointers. Does not touch the current node
+ * besides reading its parent, so the node may be freed right after the call
+ * @param root Pointer to subtree root
+ * @param node Pointer to current node
+ * @return Pointer to next node or nullptr if node was the last one
+ */
+
+template<typename Node>
+inline Node *postorderNext(Node *root, Node *node) {
+    if (node == root)
+        return nullptr;
+
+    Node *parent = node->parent;
+    if (parent->left == node && parent->right)
+        return postorderFirst(parent->right);
+
+    return parent;
+}
+
+template<TRAVERSAL_ORDER order>
+struct traversalStep_t;
+
+template<>
+struct traversalStep_t<PREORDER> {
+    template<typename Node>
+    static Node *first(Node *root) {
+        return preorderFirst(root);
+    }
+
+    template<typename Node>
+    static Node *next(Node *root, Node *node) {
+        return preorderNext(root, node);
+    }
+};
+
+template<>
+struct traversalStep_t<INORDER> {
+    template<typename Node>
+    static Node *first(Node *root) {
+        return inorderFirst(root);
+    }
+
+    template<typename Node>
+    static Node *next(Node *root, Node *node) {
+        return inorderNext(root, node);
+    }
+};
+
+template<>
+struct traversalStep_t<POSTORDER> {
+    template<typename Node>
+    static Node *first(Node *root) {
+        return postorderFirst(root);
+    }
+
+    template<typename Node>
+    static Node *next(Node *root, Node *node) {
+        return postorderNext(root, node);
+    }
+};
+
+/**
+ * Depth-first range over subtree. Holds only the root, iterators hold root, current node and the node after it.
+ * Next node is found as soon as the iterator reaches the current one, so the loop body may free the node in postorder
+ */
+
+template<typename Node, TRAVERSAL_ORDER order>
+class depthFirstRange_t {
+public:
+    class iterator {
+    public:
+        iterator(Node *root, Node *node) : root_(root), node_(node),
+                                           next_(node ? traversalStep_t<order>::next(root, node) : nullptr) {}
+
+        Node *operator*() const {
+            return node_;
+        }
+
+        iterator &operator++() {
+            node_ = next_;
+            if (node_)
+                next_ = traversalStep_t<order>::next(root_, node_);
+            return *this;
+        }
+
+        bool operator==(const iterator &other) const {
+            return node_ == other.node_;
+        }
+
+        bool operator!=(const iterator &other) const {
+            return node_ != other.node_;
+        }
+
+    private:
+        Node *root_;
+        Node *node_;
+        Node *next_;
+    };
+
+    explicit depthFirstRange_t(Node *root) : root_(root) {}
+
+    iterator begin() const {
+        return iterator(root_, root_ ? traversalStep_t<order>::first(root_) : nullptr);
+    }
+
+    iterator end() const {
+        return iterator(root_, nullptr);
+    }
+
+private:
+    Node *root_;
+};
+
+/**
+ * Level order range over subtree. Owns ring queue of nodes waiting for their turn, queue capacity is preallocated
+ * from the size hint and doubles only when a level does not fit
+ */
+
+template<typename Node>
+class levelOrderRange_t {
+public:
+    class iterator {
+    public:
+        explicit iterator(levelOrderRange_t *range) : range_(range) {}
+
+        Node *operator*() const {
+            return range_->queue_[range_->first_];
+        }
+
+        iterator &operator++() {
+            range_->pop();
+            return *this;
+        }
+
+        bool operator==(const iterator &other) const {
+            return done() == other.done();
+        }
+
+        bool operator!=(const iterator &other) const {
+            return done() != other.done();
+        }
+
+    private:
+        levelOrderRange_t *range_;
+
+        bool done() const {
+            return !range_ || !range_->size_;
+        }
+    };
+
+    explicit levelOrderRange_t(Node *root, size_t sizeHint = 0) : queue_(nullptr), capacity_(16), first_(0),
+                                                                  size_(0) {
+        while (capacity_ < sizeHint / 2 + 1)
+            capacity_ *= 2;
+
+        queue_ = (Node **) countedMalloc(capacity_ * sizeof(Node *));
+        assert(queue_);
+
+        if (root)
+            push(root);
+    }
+
+    levelOrderRange_t(const levelOrderRange_t &) = delete;
+
+    levelOrderRange_t &operator=(const levelOrderRange_t &) = delete;
+
+    levelOrderRange_t(levelOrderRange_t &&other) noexcept : queue_(other.queue_), capacity_(other.capacity_),
+                                                             first_(other.first_), size_(other.size_) {
+        other.queue_ = nullptr;
+        other.size_ = 0;
+    }
+
+    ~levelOrderRange_t() {
+        countedFree(queue_);
+    }
+
+    iterator begin() {
+        return iterator(this);
+    }
+
+    iterator end() {
+        return iterator(nullptr);
+    }
+
+private:
+    Node **queue_;
+    size_t capacity_;
+    size_t first_;
+    size_t size_;
+
+    void push(Node *node) {
+        if (size_ == capacity_) {
+            auto *queue = (Node **) countedMalloc(capacity_ * 2 * sizeof(Node *));
+            assert(queue);
+
+            for (size_t index = 0; index < size_; index++)
+                queue[index] = queue_[(first_ + index) & (capacity_ - 1)];
+
+            countedFree(queue_);
+            queue_ = queue;
+            first_ = 0;
+            capacity_ *= 2;
+        }
+
+        queue_[(first_ + size_) & (capacity_ - 1)] = node;
+        size_++;
+    }
+
+    void pop() {
+        Node *node = queue_[first_];
+        first_ = (first_ + 1) & (capacity_ - 1);
+        size_--;
+
+        if (node->left)
+            push(node->left);
+        if (node->right)
+            push(node->right);
+    }
+};
+
+template<typename Node>
+inline depthFirstRange_t<Node, PREORDER> preorder(Node *root) {
+    return depthFirstRange_t<Node, PREORDER>(root);
+}
+
+template<typename Node>
+inline depthFirstRange_t<Node, INORDER> inorder(Node *root) {
+    return depthFirstRange_t<Node, INORDER>(root);
+}
+
+template<typename Node>
+inline depthFirstRange_t<Node, POSTORDER> postorder(Node *root) {
+    return depthFirstRange_t<Node, POSTORDER>(root);
+}
+
+template<typename Node>
+inline levelOrderRange_t<Node> levelOrder(Node *root, size_t sizeHint = 0) {
+    return levelOrderRange_t<Node>(root, sizeHint);
+}
+
+inline depthFirstRange_t<node_t, PREORDER> preorder(tree_t *tree) {
+    assert(tree);
+    treeExpandAll(tree);
+    return preorder(tree->head);
+}
+
+inline depthFirstRange_t<node_t, INORDER> inorder(tree_t *tree) {
+    assert(tree);
+    treeExpandAll(tree);
+    return inorder(tree->head);
+}
+
+inline depthFirstRange_t<node_t, POSTORDER> postorder(tree_t *tree) {
+    assert(tree);
+    treeExpandAll(tree);
+    return postorder(tree->head);
+}
+
+inline levelOrderRange_t<node_t> levelOrder(tree_t *tree) {
+    assert(tree);
+    treeExpandAll(tree);
+    return levelOrder(tree->head, tree->size + 1);
+}
+
+#endif //TREE_TREEITERATORS_H
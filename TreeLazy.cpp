@@ -0,0 +1,485 @@
+//
+// Created by alexey on 17.10.2026.
+//
+
+#include "Tree.h"
+#include "TreeParser.h"
+
+/*
+ * Lazy trees are loaded in one pass over the structural index that checks the whole input but decodes only the
+ * skeleton: nodes whose text is longer than stubBytes. Smaller subtrees hanging from the skeleton are kept as stubs,
+ * byte ranges into the input, and child pointer to a stub has LAZY_TAG set. Stub is decoded into regular nodes the
+ * first time getLeftNode or getRightNode reaches it, so expanded subtrees never contain stubs. Functions that take the
+ * whole tree and read child pointers directly (serializers, dumps, iterators, conversions) call treeExpandAll first,
+ * mutators assert that the tree is not lazy.
+ */
+
+struct lazyStub_t {
+    lazySource_t *source;
+    size_t open;
+    size_t close;
+};
+
+struct lazySource_t {
+    tree_t *tree;
+    const char *data;
+    mappedFile_t *file;
+    void *(*viewValue)(const char *, size_t);
+    void *(*inPlaceValue)(char *);
+    valueArena_t *stubs;
+    node_t **owners;
+    size_t ownerCount;
+    size_t ownerCapacity;
+    size_t pending;
+};
+
+struct lazyChild_t {
+    node_t *node;
+    size_t open;
+    size_t close;
+};
+
+struct lazyFrame_t {
+    size_t open;
+    size_t value;
+    size_t valueClose;
+    PARSE_STATE state;
+    lazyChild_t children[2];
+    size_t size;
+    size_t height;
+};
+
+struct lazyStack_t {
+    lazyFrame_t *frames;
+    size_t size;
+    size_t capacity;
+};
+
+/**
+ * Lazy source "constructor"
+ * @param data Pointer to input, must stay valid while the tree has stubs
+ * @param file Pointer to mapping owned by the source, nullptr if input is owned by caller
+ * @param viewValue Deserializer that gets value position and length, nullptr if inPlaceValue is used
+ * @param inPlaceValue Deserializer that gets value null-terminated in place, nullptr if viewValue is used
+ * @return Pointer to lazySource_t
+ */
+
+static lazySource_t *makeLazySource(const char *data, mappedFile_t *file, void *(*viewValue)(const char *, size_t),
+                                    void *(*inPlaceValue)(char *)) {
+    auto *source = (lazySource_t *) countedCalloc(1, sizeof(lazySource_t));
+    assert(source);
+
+    source->data = data;
+    source->file = file;
+    source->viewValue = viewValue;
+    source->inPlaceValue = inPlaceValue;
+    source->stubs = makeValueArena();
+    return source;
+}
+
+/**
+ * Lazy source "destructor". Stubs become invalid, owned mapping is unmapped
+ * @param source Pointer to lazySource_t
+ */
+
+void deleteLazySource(lazySource_t *source) {
+    assert(source);
+
+    deleteValueArena(source->stubs);
+    countedFree(source->owners);
+    if (source->file)
+        unmapFile(source->file);
+    countedFree(source);
+}
+
+/**
+ * Function that remembers skeleton node with a stub child, so that treeExpandAll finds every stub without a walk
+ * @param source Pointer to lazySource_t
+ * @param owner Pointer to skeleton node
+ */
+
+static void addStubOwner(lazySource_t *source, node_t *owner) {
+    if (source->ownerCount == source->ownerCapacity) {
+        source->ownerCapacity = source->ownerCapacity ? source->ownerCapacity * 2 : 64;
+        source->owners = (node_t **) countedRealloc(source->owners, source->ownerCapacity * sizeof(node_t *));
+        assert(source->owners);
+    }
+
+    source->owners[source->ownerCount++] = owner;
+}
+
+/**
+ * Function that reads opening brace and value of a node during skeleton pass and pushes its frame
+ * @param scanner Pointer to structuralScanner_t
+ * @param stack Pointer to lazyStack_t
+ * @param open Position of the opening brace
+ * @param pos Pointer to store position of the error
+ * @return false if value is missing or unterminated
+ */
+
+static bool skeletonOpen(structuralScanner_t *scanner, lazyStack_t *stack, size_t open, size_t *pos) {
+    size_t value = scannerNext(scanner);
+    if (value == scanner->length || scanner->data[value] != '"') {
+        *pos = value;
+        return false;
+    }
+
+    // Nothing inside quotes is structural, so the next position is the closing quote
+    size_t valueClose = scannerNext(scanner);
+    if (valueClose == scanner->length) {
+        *pos = valueClose;
+        return false;
+    }
+
+    if (stack->size == stack->capacity) {
+        stack->capacity = stack->capacity ? stack->capacity * 2 : 64;
+        stack->frames = (lazyFrame_t *) countedRealloc(stack->frames, stack->capacity * sizeof(lazyFrame_t));
+        assert(stack->frames);
+    }
+
+    stack->frames[stack->size++] = {open, value, valueClose, AFTER_VALUE, {}, 1, 1};
+    return true;
+}
+
+/**
+ * Function that turns child of skeleton node into a child pointer: skeleton child is linked, small subtree becomes
+ * a stub
+ * @param source Pointer to lazySource_t
+ * @param child Pointer to lazyChild_t
+ * @param node Pointer to skeleton node
+ * @return Child pointer, tagged for a stub
+ */
+
+static node_t *skeletonLink(lazySource_t *source, const lazyChild_t *child, node_t *node) {
+    if (child->node) {
+        child->node->parent = node;
+        return child->node;
+    }
+
+    if (!child->close)
+        return nullptr;
+
+    auto *stub = (lazyStub_t *) arenaAlloc(source->stubs, sizeof(lazyStub_t));
+    *stub = {source, child->open, child->close};
+    source->pending++;
+    return (node_t *) ((uintptr_t) stub | LAZY_TAG);
+}
+
+/**
+ * Function that finishes node during skeleton pass. Large subtree becomes a skeleton node, small one is left to its
+ * parent, which makes it a stub if the parent is in the skeleton
+ * @param source Pointer to lazySource_t
+ * @param pool Pointer to nodePool_t of the tree
+ * @param frame Pointer to lazyFrame_t of the node
+ * @param close Position of the closing brace
+ * @param stubBytes Largest subtree text kept as stub, head is never kept as stub
+ * @param head Whether node is the tree head
+ * @param handleValue Value handler, must not fail
+ * @return Pointer to skeleton node or nullptr for small subtree
+ */
+
+template<typename ValueHandler>
+static node_t *skeletonClose(lazySource_t *source, nodePool_t *pool, const lazyFrame_t *frame, size_t close,
+                             size_t stubBytes, bool head, ValueHandler &handleValue) {
+    if (!head && close - frame->open + 1 <= stubBytes)
+        return nullptr;
+
+    void *value = nullptr;
+    bool decoded = handleValue(source->data + frame->value + 1, frame->valueClose - frame->value - 1, &value);
+    assert(decoded);
+    (void) decoded;
+
+    node_t *node = poolMakeNode(pool, nullptr, nullptr, nullptr, value);
+    node->left = skeletonLink(source, &frame->children[0], node);
+    node->right = skeletonLink(source, &frame->children[1], node);
+    if (((uintptr_t) node->left | (uintptr_t) node->right) & LAZY_TAG)
+        addStubOwner(source, node);
+
+#ifdef TREE_AUGMENT
+    node->subtreeSize = frame->size;
+    node->height = frame->height;
+#endif
+    return node;
+}
+
+/**
+ * Function that builds skeleton of lazy tree. Whole input is checked, errors are reported at the same offset as by
+ * parseTree
+ * @param source Pointer to lazySource_t
+ * @param length Length of input
+ * @param handleValue Value handler, must not fail
+ * @param stubBytes Largest subtree text kept as stub
+ * @param errorOffset Optional pointer to store byte offset of the first error
+ * @return Pointer to pooled tree with size of the whole tree or nullptr on error
+ */
+
+template<typename ValueHandler>
+static tree_t *parseSkeleton(lazySource_t *source, size_t length, ValueHandler &handleValue, size_t stubBytes,
+                             size_t *errorOffset) {
+    const char *data = source->data;
+    structuralScanner_t scanner = {};
+    scannerInit(&scanner, data, length);
+    nodePool_t *pool = makeNodePool();
+    lazyStack_t stack = {};
+    node_t *head = nullptr;
+    size_t nodes = 1;
+
+    size_t pos = scannerNext(&scanner);
+    if (pos == length || data[pos] != '{' || !skeletonOpen(&scanner, &stack, pos, &pos))
+        goto error;
+
+    while (stack.size) {
+        pos = scannerNext(&scanner);
+        if (pos == length)
+            goto error;
+
+        lazyFrame_t *top = &stack.frames[stack.size - 1];
+        char token = data[pos];
+
+        if (token == '}' && top->state != AFTER_SKIP) {
+            node_t *result = skeletonClose(source, pool, top, pos, stubBytes, stack.size == 1, handleValue);
+            if (!--stack.size) {
+                head = result;
+                break;
+            }
+
+            lazyFrame_t *parent = &stack.frames[stack.size - 1];
+            parent->children[parent->state == AFTER_LEFT ? 0 : 1] = {result, top->open, pos};
+            parent->size += top->size;
+            if (top->height + 1 > parent->height)
+                parent->height = top->height + 1;
+        } else if (token == '$' && top->state == AFTER_VALUE) {
+            top->state = AFTER_SKIP;
+        } else if (token == '{' && top->state != AFTER_RIGHT) {
+            top->state = top->state == AFTER_VALUE ? AFTER_LEFT : AFTER_RIGHT;
+            if (!skeletonOpen(&scanner, &stack, pos, &pos))
+                goto error;
+            nodes++;
+        } else {
+            goto error;
+        }
+    }
+
+    pos = scannerNext(&scanner);
+    if (pos != length)
+        goto error;
+
+    scannerFree(&scanner);
+    countedFree(stack.frames);
+    return adoptTree(head, nodes - 1, pool);
+
+    error:
+    if (errorOffset)
+        *errorOffset = pos;
+
+    scannerFree(&scanner);
+    countedFree(stack.frames);
+    deleteNodePool(pool);
+    return nullptr;
+}
+
+/**
+ * Function that decodes stub into regular nodes of the tree. Stub range has been checked by the skeleton pass
+ * @param stub Pointer to lazyStub_t
+ * @param parent Pointer to node the stub hangs from
+ * @param handleValue Value handler, must not fail
+ * @return Pointer to subtree root
+ */
+
+template<typename ValueHandler>
+static node_t *expandStub(const lazyStub_t *stub, node_t *parent, ValueHandler &handleValue) {
+    tree_t *tree = stub->source->tree;
+    const char *data = stub->source->data + stub->open;
+    structuralScanner_t scanner = {};
+    scannerInit(&scanner, data, stub->close - stub->open + 1);
+    parseStack_t stack = {};
+    void *value = nullptr;
+
+    scannerNext(&scanner);
+    size_t pos = scannerNext(&scanner);
+    bool decoded = scanValue(&scanner, &pos, handleValue, &value);
+    node_t *root = treeMakeNode(tree, parent, nullptr, nullptr, value);
+    parseStackPush(&stack, root);
+
+    while (stack.size) {
+        pos = scannerNext(&scanner);
+        parseFrame_t *top = &stack.frames[stack.size - 1];
+        char token = data[pos];
+
+        if (token == '}') {
+            stack.size--;
+        } else if (token == '$') {
+            top->state = AFTER_SKIP;
+        } else {
+            pos = scannerNext(&scanner);
+            decoded = scanValue(&scanner, &pos, handleValue, &value) && decoded;
+
+            node_t *child = treeMakeNode(tree, top->node, nullptr, nullptr, value);
+            if (top->state == AFTER_VALUE) {
+                top->node->left = child;
+                top->state = AFTER_LEFT;
+            } else {
+                top->node->right = child;
+                top->state = AFTER_RIGHT;
+            }
+
+            parseStackPush(&stack, child);
+        }
+    }
+
+    assert(decoded);
+    (void) decoded;
+    treeAugment(root);
+    scannerFree(&scanner);
+    countedFree(stack.frames);
+    return root;
+}
+
+/**
+ * Function that decodes stub child of a lazy tree node. Called by getLeftNode and getRightNode, not thread-safe.
+ * Source is deleted together with the last stub, the tree becomes a regular one then
+ * @param node Pointer to node whose child is a stub
+ * @param dir Child direction, LEFT or RIGHT
+ * @return Pointer to decoded child
+ */
+
+node_t *lazyExpandChild(node_t *node, DIRECTION dir) {
+    assert(node);
+    assert(dir != HEAD);
+
+    node_t **slot = dir == LEFT ? &node->left : &node->right;
+    assert((uintptr_t) *slot & LAZY_TAG);
+
+    auto *stub = (lazyStub_t *) ((uintptr_t) *slot & ~LAZY_TAG);
+    lazySource_t *source = stub->source;
+    if (source->inPlaceValue) {
+        inPlaceValueHandler_t handler = {source->inPlaceValue};
+        *slot = expandStub(stub, node, handler);
+    } else {
+        viewValueHandler_t handler = {source->viewValue};
+        *slot = expandStub(stub, node, handler);
+    }
+
+    if (!--source->pending) {
+        source->tree->lazy = nullptr;
+        deleteLazySource(source);
+    }
+
+    return *slot;
+}
+
+/**
+ * Function that decodes all the stubs left, so that the whole tree API can be used. Does nothing for regular trees
+ * @param tree Pointer to tree_t
+ */
+
+void treeExpandAll(tree_t *tree) {
+    assert(tree);
+
+    // Owner is popped before its children are expanded, the last expansion deletes the source
+    while (tree->lazy) {
+        lazySource_t *source = tree->lazy;
+        assert(source->ownerCount);
+
+        node_t *owner = source->owners[--source->ownerCount];
+        getLeftNode(owner);
+        getRightNode(owner);
+    }
+}
+
+/**
+ * Function that builds lazy tree over the source. Source is deleted on error or if there is nothing left to decode
+ * @param source Pointer to lazySource_t
+ * @param length Length of input
+ * @param errorOffset Optional pointer to store byte offset of the first error
+ * @param stubBytes Largest subtree text kept as stub
+ * @return Pointer to lazy tree or nullptr on error
+ */
+
+static tree_t *makeLazyTree(lazySource_t *source, size_t length, size_t *errorOffset, size_t stubBytes) {
+    tree_t *tree = nullptr;
+    if (source->inPlaceValue) {
+        inPlaceValueHandler_t handler = {source->inPlaceValue};
+        tree = parseSkeleton(source, length, handler, stubBytes, errorOffset);
+    } else {
+        viewValueHandler_t handler = {source->viewValue};
+        tree = parseSkeleton(source, length, handler, stubBytes, errorOffset);
+    }
+
+    if (tree && source->pending) {
+        tree->lazy = source;
+        source->tree = tree;
+    } else {
+        deleteLazySource(source);
+    }
+
+    return tree;
+}
+
+/**
+ * Function that parses tree serialized by treeSerialize lazily: input is checked and only subtrees longer than
+ * stubBytes are decoded, the rest is decoded when getLeftNode or getRightNode reaches it. Tree-level functions such
+ * as treeSerialize or preorder expand the whole tree first. Until treeExpandAll is called, nodes may only be walked
+ * with getLeftNode, getRightNode and getParent and the tree may not be changed
+ * @param serialized Pointer to serialized tree, does not have to be null-terminated. Must stay valid and unchanged
+ * while the tree has stubs
+ * @param length Length of serialized tree in bytes
+ * @param deserializeValue Function that deserializes value. Gets value position and length inside the input
+ * @param errorOffset Optional pointer to store byte offset of the first error
+ * @param stubBytes Largest subtree text kept as stub
+ * @return Pointer to pooled lazy tree or nullptr on error. Size is the size of the whole tree
+ */
+
+tree_t *treeParseLazy(const char *serialized, size_t length, void *(*deserializeValue)(const char *, size_t),
+                      size_t *errorOffset, size_t stubBytes) {
+    assert(serialized);
+    assert(deserializeValue);
+
+    lazySource_t *source = makeLazySource(serialized, nullptr, deserializeValue, nullptr);
+    return makeLazyTree(source, length, errorOffset, stubBytes);
+}
+
+/**
+ * Function that deserializes tree lazily like treeParseLazy. Values are null-terminated in place when decoded
+ * @param serialized Null-terminated serialized tree. Must stay valid while the tree has stubs
+ * @param deserializeValue Function that deserializes value. Gets a pointer into the serialized buffer
+ * @param stubBytes Largest subtree text kept as stub
+ * @return Pointer to pooled lazy tree or nullptr if input is malformed
+ */
+
+tree_t *treeDeserializeLazy(char *serialized, void *(*deserializeValue)(char *), size_t stubBytes) {
+    assert(serialized);
+    assert(deserializeValue);
+
+    lazySource_t *source = makeLazySource(serialized, nullptr, nullptr, deserializeValue);
+    return makeLazyTree(source, strlen(serialized), nullptr, stubBytes);
+}
+
+/**
+ * Function that maps text snapshot and restores tree from it lazily like treeParseLazy. Mapping is kept until the
+ * last stub is decoded or the tree is deleted. Binary snapshots are restored eagerly
+ * @param filename Name of text or binary snapshot
+ * @param deserializeValue Function that deserializes value. Gets value position and length inside the mapping
+ * @param errorOffset Optional pointer to store byte offset of the first text parse error
+ * @param stubBytes Largest subtree text kept as stub
+ * @return Pointer to pooled tree or nullptr on error
+ */
+
+tree_t *treeLoadLazy(const char *filename, void *(*deserializeValue)(const char *, size_t), size_t *errorOffset,
+                     size_t stubBytes) {
+    assert(filename);
+    assert(deserializeValue);
+
+    mappedFile_t *file = mapFile(filename);
+    if (!file)
+        return nullptr;
+
+    if (file->length >= sizeof(BINARY_MAGIC) && memcmp(file->data, BINARY_MAGIC, sizeof(BINARY_MAGIC)) == 0) {
+        tree_t *tree = treeDeserializeBinary(file->data, file->length, deserializeValue, true);
+        unmapFile(file);
+        return tree;
+    }
+
+    lazySource_t *source = makeLazySource(file->data, file, deserializeValue, nullptr);
+    return makeLazyTree(source, file->length, errorOffset, stubBytes);
+}
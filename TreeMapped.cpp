@@ -0,0 +1,154 @@
+//
+// Created by alexey on 17.10.2026.
+//
+
+#include "Tree.h"
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+
+/**
+ * Function that maps file into memory read-only
+ * @param filename Name of the file to map
+ * @return Pointer to mappedFile_t or nullptr if file can not be mapped
+ */
+
+mappedFile_t *mapFile(const char *filename) {
+    assert(filename);
+
+    int fd = open(filename, O_RDONLY);
+    if (fd < 0)
+        return nullptr;
+
+    struct stat info = {};
+    if (fstat(fd, &info) != 0 || info.st_size <= 0) {
+        close(fd);
+        return nullptr;
+    }
+
+    void *data = mmap(nullptr, info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (data == MAP_FAILED)
+        return nullptr;
+
+    // Parsers read front to back, so let the kernel read ahead aggressively
+    madvise(data, info.st_size, MADV_SEQUENTIAL);
+
+    auto *file = (mappedFile_t *) countedCalloc(1, sizeof(mappedFile_t));
+    file->data = (const char *) data;
+    file->length = info.st_size;
+    return file;
+}
+
+/**
+ * Function that unmaps file mapped by mapFile. Value views into the mapping become invalid
+ * @param file Pointer to mappedFile_t
+ */
+
+void unmapFile(mappedFile_t *file) {
+    assert(file);
+
+    munmap((void *) file->data, file->length);
+    countedFree(file);
+}
+
+/**
+ * Function that restores tree from mapped text or binary snapshot. Format is detected by the binary header
+ * @param file Pointer to mappedFile_t
+ * @param deserializeValue Function that deserializes value. Gets value position and length inside the mapping
+ * @param errorOffset Optional pointer to store byte offset of the first text parse error
+ * @param pooled Whether nodes of the new tree are taken from a node pool
+ * @return Pointer to restored tree or nullptr on error
+ */
+
+tree_t *treeLoadMapped(const mappedFile_t *file, void *(*deserializeValue)(const char *, size_t),
+                       size_t *errorOffset, bool pooled) {
+    assert(file);
+    assert(deserializeValue);
+
+    if (file->length >= sizeof(BINARY_MAGIC) && memcmp(file->data, BINARY_MAGIC, sizeof(BINARY_MAGIC)) == 0)
+        return treeDeserializeBinary(file->data, file->length, deserializeValue, pooled);
+
+    return treeParse(file->data, file->length, deserializeValue, errorOffset, pooled);
+}
+
+/**
+ * Function that maps file, restores tree from it and unmaps it. Values must not keep views into the file
+ * @param filename Name of text or binary snapshot
+ * @param deserializeValue Function that deserializes value. Gets value position and length inside the mapping
+ * @param errorOffset Optional pointer to store byte offset of the first text parse error
+ * @param pooled Whether nodes of the new tree are taken from a node pool
+ * @return Pointer to restored tree or nullptr on error
+ */
+
+tree_t *treeLoad(const char *filename, void *(*deserializeValue)(const char *, size_t), size_t *errorOffset,
+                 bool pooled) {
+    assert(filename);
+    assert(deserializeValue);
+
+    mappedFile_t *file = mapFile(filename);
+    if (!file)
+        return nullptr;
+
+    tree_t *tree = treeLoadMapped(file, deserializeValue, errorOffset, pooled);
+
+    unmapFile(file);
+    return tree;
+}
+
+/**
+ * Function that maps file, restores tree from it with built-in value codec and unmaps it
+ * @param filename Name of text or binary snapshot
+ * @param codec Value codec
+ * @param errorOffset Optional pointer to store byte offset of the first text parse error
+ * @param pooled Whether nodes of the new tree are taken from a node pool
+ * @return Pointer to restored tree or nullptr on error
+ */
+
+tree_t *treeLoad(const char *filename, VALUE_CODEC codec, size_t *errorOffset, bool pooled) {
+    assert(filename);
+
+    mappedFile_t *file = mapFile(filename);
+    if (!file)
+        return nullptr;
+
+    tree_t *tree = nullptr;
+    if (file->length >= sizeof(BINARY_MAGIC) && memcmp(file->data, BINARY_MAGIC, sizeof(BINARY_MAGIC)) == 0)
+        tree = treeDeserializeBinary(file->data, file->length, codec, pooled);
+    else
+        tree = treeParse(file->data, file->length, codec, errorOffset, pooled);
+
+    unmapFile(file);
+    return tree;
+}
+
+/**
+ * Function that maps file and restores tree from it on several threads. Format is detected by the binary header
+ * @param filename Name of text or binary snapshot
+ * @param deserializeValue Function that deserializes value, called concurrently. Gets value position and length
+ * inside the mapping
+ * @param errorOffset Optional pointer to store byte offset of the first text parse error
+ * @param threads Number of threads, 0 for the number of hardware threads
+ * @return Pointer to restored pooled tree or nullptr on error
+ */
+
+tree_t *treeLoadParallel(const char *filename, void *(*deserializeValue)(const char *, size_t), size_t *errorOffset,
+                         size_t threads) {
+    assert(filename);
+    assert(deserializeValue);
+
+    mappedFile_t *file = mapFile(filename);
+    if (!file)
+        return nullptr;
+
+    tree_t *tree = nullptr;
+    if (file->length >= sizeof(BINARY_MAGIC) && memcmp(file->data, BINARY_MAGIC, sizeof(BINARY_MAGIC)) == 0)
+        tree = treeDeserializeBinaryParallel(file->data, file->length, deserializeValue, threads);
+    else
+        tree = treeParseParallel(file->data, file->length, deserializeValue, errorOffset, threads);
+
+    unmapFile(file);
+    return tree;
+}
@@ -0,0 +1,416 @@
+//
+// Created by alexey on 17.10.2026.
+//
+
+#include "TreeParallel.h"
+#include "TreeIterators.h"
+#include <atomic>
+#include <cstring>
+#include <mutex>
+#include <thread>
+
+const size_t TASK_QUEUE_CAPACITY = 64;
+
+struct taskQueue_t {
+    std::mutex lock;
+    node_t **tasks;
+    size_t first;
+    size_t capacity;
+    std::atomic<size_t> size;
+};
+
+struct localStack_t {
+    node_t **tasks;
+    size_t first;
+    size_t size;
+    size_t capacity;
+};
+
+struct parallelWalk_t {
+    taskQueue_t *queues;
+    size_t threads;
+    size_t cutoff;
+    std::atomic<size_t> pending;
+};
+
+struct parallelRun_t {
+    void (*run)(size_t, void *);
+    void *context;
+    size_t count;
+    std::atomic<size_t> next;
+};
+
+struct forEachVisitor_t {
+    void (*visit)(void *, void *);
+    void *context;
+
+    void operator()(node_t *node) const {
+        visit(node->value, context);
+    }
+};
+
+struct mapVisitor_t {
+    void *(*transform)(void *, void *);
+    void *context;
+
+    void operator()(node_t *node) const {
+        node->value = transform(node->value, context);
+    }
+};
+
+/**
+ * Function that resolves requested number of threads
+ * @param threads Number of threads, 0 for the number of hardware threads
+ * @return Number of threads, at least one
+ */
+
+size_t parallelThreads(size_t threads) {
+    if (!threads)
+        threads = std::thread::hardware_concurrency();
+
+    return threads ? threads : 1;
+}
+
+/**
+ * Function that chooses how deep parallel loaders look for subtrees to split off. A balanced tree has enough
+ * subtrees for every thread a few levels below that
+ * @param threads Number of threads
+ * @return Depth of the deepest subtree root that may be split off
+ */
+
+size_t parallelSplitDepth(size_t threads) {
+    size_t depth = 4;
+    for (size_t subtrees = 1; subtrees < threads * PARALLEL_TASKS_PER_THREAD; subtrees *= 2)
+        depth++;
+
+    return depth;
+}
+
+/**
+ * Worker thread body of parallelRun: takes tasks by index until none is left
+ * @param parallel Pointer to parallelRun_t
+ */
+
+static void runTasks(parallelRun_t *parallel) {
+    for (size_t index = parallel->next++; index < parallel->count; index = parallel->next++)
+        parallel->run(index, parallel->context);
+}
+
+/**
+ * Function that runs independent tasks on several threads. Tasks are handed out in index order, so putting the
+ * largest ones first gives the best balance. Calling thread works too and the function returns when all tasks are done
+ * @param count Number of tasks
+ * @param run Function that runs task with the given index
+ * @param context Pointer passed to run as is
+ * @param threads Number of threads, 0 for the number of hardware threads
+ */
+
+void parallelRun(size_t count, void (*run)(size_t index, void *context), void *context, size_t threads) {
+    assert(run);
+
+    threads = parallelThreads(threads);
+    if (threads > count)
+        threads = count;
+
+    parallelRun_t parallel = {run, context, count, {0}};
+    if (threads <= 1) {
+        runTasks(&parallel);
+        return;
+    }
+
+    auto *workers = new std::thread[threads - 1];
+    for (size_t worker = 1; worker < threads; worker++)
+        workers[worker - 1] = std::thread(runTasks, &parallel);
+
+    runTasks(&parallel);
+
+    for (size_t worker = 1; worker < threads; worker++)
+        workers[worker - 1].join();
+    delete[] workers;
+}
+
+/**
+ * Function that checks subtree size without walking more than count nodes
+ * @param root Pointer to subtree root
+ * @param count Size threshold
+ * @return true if subtree has at least count nodes
+ */
+
+static bool subtreeAtLeast(node_t *root, size_t count) {
+#ifdef TREE_AUGMENT
+    return root->subtreeSize >= count;
+#else
+    for (node_t *node : preorder(root)) {
+        (void) node;
+        if (--count == 0)
+            return true;
+    }
+
+    return false;
+#endif
+}
+
+/**
+ * Function that checks whether pending subtree is worth handing to another worker. With TREE_AUGMENT stored size
+ * keeps subtrees smaller than cutoff local, without it every pending subtree qualifies
+ * @param root Pointer to subtree root
+ * @param cutoff Number of nodes a split has to pay for
+ * @return true if subtree may be shared
+ */
+
+static bool worthSharing(node_t *root, size_t cutoff) {
+#ifdef TREE_AUGMENT
+    return root->subtreeSize >= cutoff;
+#else
+    (void) root;
+    (void) cutoff;
+    return true;
+#endif
+}
+
+/**
+ * Function that puts task to the bottom of worker queue
+ * @param walk Pointer to parallelWalk_t
+ * @param queue Pointer to taskQueue_t of the worker
+ * @param node Subtree root
+ */
+
+static void queuePush(parallelWalk_t *walk, taskQueue_t *queue, node_t *node) {
+    walk->pending++;
+
+    std::lock_guard<std::mutex> guard(queue->lock);
+    size_t size = queue->size.load(std::memory_order_relaxed);
+
+    if (size == queue->capacity) {
+        auto *tasks = (node_t **) countedCalloc(queue->capacity * 2, sizeof(node_t *));
+        assert(tasks);
+
+        for (size_t index = 0; index < size; index++)
+            tasks[index] = queue->tasks[(queue->first + index) & (queue->capacity - 1)];
+
+        countedFree(queue->tasks);
+        queue->tasks = tasks;
+        queue->first = 0;
+        queue->capacity *= 2;
+    }
+
+    queue->tasks[(queue->first + size) & (queue->capacity - 1)] = node;
+    queue->size.store(size + 1, std::memory_order_release);
+}
+
+/**
+ * Function that takes task from the queue. Owner takes the newest task, thieves take the oldest one, which is
+ * usually the largest subtree
+ * @param queue Pointer to taskQueue_t
+ * @param steal Whether task is taken from the top
+ * @return Subtree root or nullptr if queue is empty
+ */
+
+static node_t *queuePop(taskQueue_t *queue, bool steal) {
+    if (!queue->size.load(std::memory_order_acquire))
+        return nullptr;
+
+    std::lock_guard<std::mutex> guard(queue->lock);
+    size_t size = queue->size.load(std::memory_order_relaxed);
+    if (!size)
+        return nullptr;
+
+    node_t *node = nullptr;
+    if (steal) {
+        node = queue->tasks[queue->first];
+        queue->first = (queue->first + 1) & (queue->capacity - 1);
+    } else {
+        node = queue->tasks[(queue->first + size - 1) & (queue->capacity - 1)];
+    }
+
+    queue->size.store(size - 1, std::memory_order_release);
+    return node;
+}
+
+/**
+ * Function that puts pending right subtree to the worker's private stack
+ * @param stack Pointer to localStack_t
+ * @param node Subtree root
+ */
+
+static void localPush(localStack_t *stack, node_t *node) {
+    if (stack->size == stack->capacity) {
+        if (stack->first) {
+            memmove(stack->tasks, stack->tasks + stack->first, (stack->size - stack->first) * sizeof(node_t *));
+            stack->size -= stack->first;
+            stack->first = 0;
+        } else {
+            stack->capacity = stack->capacity ? stack->capacity * 2 : TASK_QUEUE_CAPACITY;
+            stack->tasks = (node_t **) countedRealloc(stack->tasks, stack->capacity * sizeof(node_t *));
+            assert(stack->tasks);
+        }
+    }
+
+    stack->tasks[stack->size++] = node;
+}
+
+/**
+ * Function that visits every node of the task depth-first. Pending right subtrees stay on the private stack, and
+ * after every cutoff visited nodes the shallowest of them is shared if worker queue has been emptied by thieves.
+ * So every split is paid for by at least cutoff nodes of sequential work, and with TREE_AUGMENT the shared subtree
+ * has at least cutoff nodes as well
+ * @param walk Pointer to parallelWalk_t
+ * @param queue Pointer to taskQueue_t of the worker
+ * @param stack Pointer to localStack_t of the worker
+ * @param root Task subtree root
+ * @param visit Node visitor
+ */
+
+template<typename Visitor>
+static void runTask(parallelWalk_t *walk, taskQueue_t *queue, localStack_t *stack, node_t *root,
+                    const Visitor &visit) {
+    size_t visited = 0;
+    node_t *node = root;
+    stack->first = 0;
+    stack->size = 0;
+
+    while (true) {
+        while (node) {
+            visit(node);
+            visited++;
+
+            if (node->left && node->right)
+                localPush(stack, node->right);
+            node = node->left ? node->left : node->right;
+
+            if (visited >= walk->cutoff && stack->first < stack->size &&
+                !queue->size.load(std::memory_order_relaxed) &&
+                worthSharing(stack->tasks[stack->first], walk->cutoff)) {
+                queuePush(walk, queue, stack->tasks[stack->first++]);
+                visited = 0;
+            }
+        }
+
+        if (stack->first == stack->size)
+            return;
+
+        node = stack->tasks[--stack->size];
+    }
+}
+
+/**
+ * Worker thread body: runs own tasks, steals when out of them and stops when no task is left anywhere
+ * @param walk Pointer to parallelWalk_t
+ * @param worker Worker index
+ * @param visit Node visitor
+ */
+
+template<typename Visitor>
+static void runWorker(parallelWalk_t *walk, size_t worker, const Visitor &visit) {
+    taskQueue_t *queue = &walk->queues[worker];
+    localStack_t stack = {};
+    size_t victim = worker;
+
+    while (walk->pending.load(std::memory_order_acquire)) {
+        node_t *task = queuePop(queue, false);
+
+        for (size_t attempt = 1; !task && attempt < walk->threads; attempt++) {
+            victim = (victim + 1) % walk->threads;
+            if (victim != worker)
+                task = queuePop(&walk->queues[victim], true);
+        }
+
+        if (!task) {
+            std::this_thread::yield();
+            continue;
+        }
+
+        runTask(walk, queue, &stack, task, visit);
+        walk->pending--;
+    }
+
+    countedFree(stack.tasks);
+}
+
+/**
+ * Function that visits every node of the tree on a work-stealing pool
+ * @param tree Pointer to tree_t
+ * @param threads Number of workers, 0 for the number of hardware threads
+ * @param cutoff Number of nodes a worker visits sequentially between two splits
+ * @param visit Node visitor
+ */
+
+template<typename Visitor>
+static void parallelWalk(tree_t *tree, size_t threads, size_t cutoff, const Visitor &visit) {
+    threads = parallelThreads(threads);
+    if (!cutoff)
+        cutoff = 1;
+
+    if (threads <= 1 || !subtreeAtLeast(tree->head, cutoff)) {
+        for (node_t *node : preorder(tree))
+            visit(node);
+        return;
+    }
+
+    parallelWalk_t walk = {};
+    walk.queues = new taskQueue_t[threads];
+    walk.threads = threads;
+    walk.cutoff = cutoff;
+
+    for (size_t worker = 0; worker < threads; worker++) {
+        walk.queues[worker].tasks = (node_t **) countedCalloc(TASK_QUEUE_CAPACITY, sizeof(node_t *));
+        assert(walk.queues[worker].tasks);
+        walk.queues[worker].first = 0;
+        walk.queues[worker].capacity = TASK_QUEUE_CAPACITY;
+        walk.queues[worker].size = 0;
+    }
+
+    queuePush(&walk, &walk.queues[0], tree->head);
+
+    auto *workers = new std::thread[threads - 1];
+    for (size_t worker = 1; worker < threads; worker++)
+        workers[worker - 1] = std::thread(runWorker<Visitor>, &walk, worker, std::cref(visit));
+
+    runWorker(&walk, 0, visit);
+
+    for (size_t worker = 1; worker < threads; worker++)
+        workers[worker - 1].join();
+    delete[] workers;
+
+    for (size_t worker = 0; worker < threads; worker++)
+        countedFree(walk.queues[worker].tasks);
+    delete[] walk.queues;
+}
+
+/**
+ * Function that calls visit for every node value of the tree from several threads
+ * @param tree Pointer to tree_t
+ * @param visit Function to call for every value
+ * @param context Pointer passed to visit as is
+ * @param threads Number of threads, 0 for the number of hardware threads
+ * @param cutoff Number of nodes a worker visits sequentially between two splits
+ */
+
+void parallelForEach(tree_t *tree, void (*visit)(void *value, void *context), void *context, size_t threads,
+                     size_t cutoff) {
+    assert(tree);
+    assert(visit);
+
+    treeExpandAll(tree);
+
+    parallelWalk(tree, threads, cutoff, forEachVisitor_t{visit, context});
+}
+
+/**
+ * Function that replaces every node value of the tree with transformed one using several threads
+ * @param tree Pointer to tree_t
+ * @param transform Function that returns new value for the given one
+ * @param context Pointer passed to transform as is
+ * @param threads Number of threads, 0 for the number of hardware threads
+ * @param cutoff Number of nodes a worker visits sequentially between two splits
+ */
+
+void parallelMap(tree_t *tree, void *(*transform)(void *value, void *context), void *context, size_t threads,
+                 size_t cutoff) {
+    assert(tree);
+    assert(transform);
+
+    treeExpandAll(tree);
+
+    parallelWalk(tree, threads, cutoff, mapVisitor_t{transform, context});
+}
@@ -0,0 +1,31 @@
+//
+// Created by alexey on 17.10.2026.
+//
+
+#ifndef TREE_TREEPARALLEL_H
+#define TREE_TREEPARALLEL_H
+#include "Tree.h"
+
+/*
+ * Parallel traversal. Subtrees are spawned as tasks on a work-stealing pool: every worker walks its task depth-first
+ * and gives its shallowest pending right subtree away once it has visited cutoff nodes and its own queue has been
+ * emptied by thieves. Trees smaller than cutoff nodes are walked on the calling thread.
+ * Visiting order is unspecified, callbacks must be safe to run concurrently on distinct values.
+ */
+
+const size_t PARALLEL_CUTOFF = 4096;
+const size_t PARALLEL_TASKS_PER_THREAD = 4;
+const size_t PARALLEL_MIN_INPUT = 1 << 16;
+
+size_t parallelThreads(size_t threads);
+
+size_t parallelSplitDepth(size_t threads);
+
+void parallelRun(size_t count, void (*run)(size_t index, void *context), void *context, size_t threads = 0);
+
+void parallelForEach(tree_t *tree, void (*visit)(void *value, void *context), void *context, size_t threads = 0,
+                     size_t cutoff = PARALLEL_CUTOFF);
+
+void parallelMap(tree_t *tree, void *(*transform)(void *value, void *context), void *context, size_t threads = 0,
+                 size_t cutoff = PARALLEL_CUTOFF);
+#endif //TREE_TREEPARALLEL_H
@@ -0,0 +1,610 @@
+//
+// Created by alexey on 17.10.2026.
+//
+
+#ifndef TREE_TREEPARSER_H
+#define TREE_TREEPARSER_H
+#include "Tree.h"
+#include "TreeParallel.h"
+
+/*
+ * Single-pass parser for the text format written by treeSerialize:
+ *
+ *     tree  := '{' node '}'
+ *     node  := '"' value '"' [ '{' node '}' | '$' ] [ '{' node '}' ]
+ *
+ * Input is tokenized once from left to right and nodes are created in preorder, so parse time is linear in
+ * input size. Input is never modified. Value conversion is delegated to a handler object with
+ *     bool operator()(const char *value, size_t length, void **result)
+ * that returns false if the value can not be decoded.
+ *
+ * Tokenizing is done by a structural index: windows of input are classified 64 bytes at a time with SIMD kernels
+ * (TreeIndex.cpp) into positions of quotes and of every non-whitespace byte outside quoted values. The parser then
+ * jumps from one structural position to the next and never looks at whitespace or value bytes.
+ */
+
+const unsigned INDEX_BLOCK = 64;
+const size_t INDEX_WINDOW = 1 << 16;
+
+enum INDEX_KERNEL {
+    SCALAR_KERNEL,
+    SSE2_KERNEL,
+    AVX2_KERNEL
+};
+
+enum PARSE_STATE {
+    AFTER_VALUE,
+    AFTER_SKIP,
+    AFTER_LEFT,
+    AFTER_RIGHT
+};
+
+struct parseFrame_t {
+    node_t *node;
+    PARSE_STATE state;
+};
+
+struct parseStack_t {
+    parseFrame_t *frames;
+    size_t size;
+    size_t capacity;
+};
+
+struct structuralScanner_t {
+    const char *data;
+    size_t length;
+    size_t window;
+    size_t scanned;
+    size_t windowSize;
+    uint32_t *positions;
+    size_t count;
+    size_t next;
+    uint64_t quoted;
+    INDEX_KERNEL kernel;
+};
+
+struct textSpan_t {
+    size_t open;
+    size_t close;
+    size_t depth;
+};
+
+struct textFrame_t {
+    node_t *node;
+    const char *pos;
+    const char *close;
+    size_t children;
+    bool skip;
+};
+
+template<typename ValueHandler>
+struct textTask_t {
+    const char *serialized;
+    size_t open;
+    size_t length;
+    node_t *parent;
+    bool left;
+    ValueHandler handleValue;
+    tree_t *subtree;
+    size_t errorOffset;
+};
+
+INDEX_KERNEL indexBestKernel();
+
+bool indexKernelSupported(INDEX_KERNEL kernel);
+
+size_t indexStructurals(INDEX_KERNEL kernel, const char *data, size_t length, uint64_t *quoted,
+                        uint32_t *positions);
+
+/**
+ * Value handler that terminates value in place and passes it to char * deserializer without copying
+ */
+
+struct inPlaceValueHandler_t {
+    void *(*deserializeValue)(char *);
+
+    bool operator()(const char *value, size_t length, void **result) {
+        auto *mutableValue = const_cast<char *>(value);
+        mutableValue[length] = '\0';
+        *result = deserializeValue(mutableValue);
+        return true;
+    }
+};
+
+/**
+ * Value handler that passes value position and length inside the input to the deserializer
+ */
+
+struct viewValueHandler_t {
+    void *(*deserializeValue)(const char *, size_t);
+
+    bool operator()(const char *value, size_t length, void **result) {
+        *result = deserializeValue(value, length);
+        return true;
+    }
+};
+
+/**
+ * Value handler that copies value to a reusable null-terminated buffer and passes it to char * deserializer
+ */
+
+struct copyingValueHandler_t {
+    void *(*deserializeValue)(char *);
+    char *buffer;
+    size_t capacity;
+
+    bool operator()(const char *value, size_t length, void **result) {
+        if (length + 1 > capacity) {
+            capacity = (length + 1) * 2;
+            buffer = (char *) countedRealloc(buffer, capacity);
+            assert(buffer);
+        }
+
+        memcpy(buffer, value, length);
+        buffer[length] = '\0';
+        *result = deserializeValue(buffer);
+        return true;
+    }
+};
+
+/**
+ * Function that pushes parser frame to the explicit stack, growing it when needed
+ * @param stack Pointer to parseStack_t
+ * @param node Pointer to node whose value has just been read
+ */
+
+inline void parseStackPush(parseStack_t *stack, node_t *node) {
+    if (stack->size == stack->capacity) {
+        stack->capacity = stack->capacity ? stack->capacity * 2 : 64;
+        stack->frames = (parseFrame_t *) countedRealloc(stack->frames, stack->capacity * sizeof(parseFrame_t));
+        assert(stack->frames);
+    }
+
+    stack->frames[stack->size].node = node;
+    stack->frames[stack->size].state = AFTER_VALUE;
+    stack->size++;
+}
+
+/**
+ * Function that skips whitespace
+ * @param pos Pointer to current position
+ * @param end Pointer past the end of input
+ * @return Pointer to the first non-whitespace character or end
+ */
+
+inline const char *parseSkipSpace(const char *pos, const char *end) {
+    while (pos < end && (*pos == ' ' || *pos == '\n' || *pos == '\t' || *pos == '\r'))
+        pos++;
+
+    return pos;
+}
+
+/**
+ * Structural scanner "constructor". Input is indexed lazily, one window at a time
+ * @param scanner Pointer to structuralScanner_t to fill
+ * @param data Pointer to input
+ * @param length Length of input
+ * @param kernel Index kernel
+ */
+
+inline void scannerInit(structuralScanner_t *scanner, const char *data, size_t length,
+                        INDEX_KERNEL kernel = indexBestKernel()) {
+    *scanner = {};
+    scanner->data = data;
+    scanner->length = length;
+    scanner->windowSize = length < INDEX_WINDOW ? length : INDEX_WINDOW;
+    scanner->kernel = kernel;
+    if (scanner->windowSize) {
+        scanner->positions = (uint32_t *) countedMalloc((scanner->windowSize + INDEX_BLOCK) * sizeof(uint32_t));
+        assert(scanner->positions);
+    }
+}
+
+/**
+ * Function that returns position of the next structural character. Bytes before it are not read again, so value
+ * handlers may modify value bytes and the closing quote
+ * @param scanner Pointer to structuralScanner_t
+ * @return Position of the next structural character, input length if there is none
+ */
+
+inline size_t scannerNext(structuralScanner_t *scanner) {
+    while (scanner->next == scanner->count) {
+        if (scanner->scanned == scanner->length)
+            return scanner->length;
+
+        size_t size = scanner->length - scanner->scanned;
+        if (size > scanner->windowSize)
+            size = scanner->windowSize;
+
+        scanner->window = scanner->scanned;
+        scanner->count = indexStructurals(scanner->kernel, scanner->data + scanner->scanned, size, &scanner->quoted,
+                                          scanner->positions);
+        scanner->next = 0;
+        scanner->scanned += size;
+    }
+
+    return scanner->window + scanner->positions[scanner->next++];
+}
+
+/**
+ * Structural scanner "destructor"
+ * @param scanner Pointer to structuralScanner_t
+ */
+
+inline void scannerFree(structuralScanner_t *scanner) {
+    countedFree(scanner->positions);
+    scanner->positions = nullptr;
+}
+
+/**
+ * Function that reads quoted value found by the scanner and hands it to the value handler
+ * @param scanner Pointer to structuralScanner_t
+ * @param pos Pointer to position of the opening quote, set to the closing quote on success and to the error on failure
+ * @param handleValue Value handler
+ * @param value Pointer to decoded value
+ * @return true on success
+ */
+
+template<typename ValueHandler>
+bool scanValue(structuralScanner_t *scanner, size_t *pos, ValueHandler &handleValue, void **value) {
+    const char *data = scanner->data;
+    if (*pos == scanner->length || data[*pos] != '"')
+        return false;
+
+    // Nothing inside quotes is structural, so the next position is the closing quote
+    size_t closing = scannerNext(scanner);
+    if (closing == scanner->length) {
+        *pos = closing;
+        return false;
+    }
+
+    if (!handleValue(data + *pos + 1, closing - *pos - 1, value)) {
+        (*pos)++;
+        return false;
+    }
+
+    *pos = closing;
+    return true;
+}
+
+/**
+ * Function that reads quoted value and hands it to the value handler
+ * @param pos Pointer to current position, moved past the closing quote on success
+ * @param end Pointer past the end of input
+ * @param handleValue Value handler
+ * @param value Pointer to decoded value
+ * @return true on success
+ */
+
+template<typename ValueHandler>
+bool parseValue(const char **pos, const char *end, ValueHandler &handleValue, void **value) {
+    const char *current = parseSkipSpace(*pos, end);
+    if (current == end || *current != '"') {
+        *pos = current;
+        return false;
+    }
+    current++;
+
+    auto *closing = (const char *) memchr(current, '"', end - current);
+    if (!closing) {
+        *pos = end;
+        return false;
+    }
+
+    if (!handleValue(current, closing - current, value)) {
+        *pos = current;
+        return false;
+    }
+
+    *pos = closing + 1;
+    return true;
+}
+
+/**
+ * Function that parses serialized tree
+ * @param serialized Pointer to serialized tree, does not have to be null-terminated
+ * @param length Length of serialized tree in bytes
+ * @param handleValue Value handler
+ * @param pooled Whether nodes of the new tree are taken from a node pool
+ * @param errorOffset Optional pointer to store byte offset of the first error
+ * @return Pointer to restored tree or nullptr on error
+ */
+
+template<typename ValueHandler>
+tree_t *parseTree(const char *serialized, size_t length, ValueHandler &handleValue, bool pooled,
+                  size_t *errorOffset) {
+    assert(serialized);
+
+    structuralScanner_t scanner = {};
+    scannerInit(&scanner, serialized, length);
+    tree_t *tree = nullptr;
+    parseStack_t stack = {};
+    void *value = nullptr;
+
+    size_t pos = scannerNext(&scanner);
+    if (pos == length || serialized[pos] != '{')
+        goto error;
+
+    pos = scannerNext(&scanner);
+    if (!scanValue(&scanner, &pos, handleValue, &value))
+        goto error;
+
+    tree = pooled ? makePooledTree(value) : makeTree(value);
+    parseStackPush(&stack, tree->head);
+
+    while (stack.size) {
+        pos = scannerNext(&scanner);
+        if (pos == length)
+            goto error;
+
+        parseFrame_t *top = &stack.frames[stack.size - 1];
+        char token = serialized[pos];
+
+        if (token == '}' && top->state != AFTER_SKIP) {
+            stack.size--;
+        } else if (token == '$' && top->state == AFTER_VALUE) {
+            top->state = AFTER_SKIP;
+        } else if (token == '{' && top->state != AFTER_RIGHT) {
+            pos = scannerNext(&scanner);
+            if (!scanValue(&scanner, &pos, handleValue, &value))
+                goto error;
+
+            node_t *parent = top->node;
+            node_t *child = treeMakeNode(tree, parent, nullptr, nullptr, value);
+            tree->size++;
+
+            if (top->state == AFTER_VALUE) {
+                parent->left = child;
+                top->state = AFTER_LEFT;
+            } else {
+                parent->right = child;
+                top->state = AFTER_RIGHT;
+            }
+
+            parseStackPush(&stack, child);
+        } else {
+            goto error;
+        }
+    }
+
+    pos = scannerNext(&scanner);
+    if (pos != length)
+        goto error;
+
+    treeAugment(tree->head);
+    scannerFree(&scanner);
+    countedFree(stack.frames);
+    return tree;
+
+    error:
+    if (errorOffset)
+        *errorOffset = pos;
+
+    scannerFree(&scanner);
+    countedFree(stack.frames);
+    if (tree)
+        deleteTree(tree);
+    return nullptr;
+}
+
+/**
+ * Function that finds subtrees of serialized tree without parsing values: brace positions are matched in one pass
+ * over the structural index, quoted values are never looked at
+ * @param serialized Pointer to serialized tree
+ * @param length Length of serialized tree in bytes
+ * @param maxDepth Depth of the deepest subtree to record
+ * @param spans Pointer to store calloc'ed array of subtrees in preorder
+ * @param count Pointer to store number of subtrees
+ * @return false if braces or quotes are unbalanced or tree is followed by anything but whitespace
+ */
+
+inline bool scanTextSpans(const char *serialized, size_t length, size_t maxDepth, textSpan_t **spans,
+                          size_t *count) {
+    structuralScanner_t scanner = {};
+    scannerInit(&scanner, serialized, length);
+    size_t pos = scannerNext(&scanner);
+    if (pos == length || serialized[pos] != '{') {
+        scannerFree(&scanner);
+        return false;
+    }
+
+    size_t capacity = 64;
+    *spans = (textSpan_t *) countedCalloc(capacity, sizeof(textSpan_t));
+    *count = 0;
+    auto *open = (size_t *) countedCalloc(maxDepth + 1, sizeof(size_t));
+    assert(*spans && open);
+
+    size_t depth = 0;
+    for (; pos < length; pos = scannerNext(&scanner)) {
+        char token = serialized[pos];
+
+        if (token == '{') {
+            if (depth <= maxDepth) {
+                if (*count == capacity) {
+                    capacity *= 2;
+                    *spans = (textSpan_t *) countedRealloc(*spans, capacity * sizeof(textSpan_t));
+                    assert(*spans);
+                }
+
+                (*spans)[*count] = {pos, 0, depth};
+                open[depth] = (*count)++;
+            }
+            depth++;
+        } else if (token == '}') {
+            depth--;
+            if (depth <= maxDepth)
+                (*spans)[open[depth]].close = pos;
+            if (!depth)
+                break;
+        }
+    }
+
+    // Unterminated value hides everything after its opening quote, so braces stay unbalanced
+    bool balanced = pos < length && !depth && scannerNext(&scanner) == length;
+    countedFree(open);
+    scannerFree(&scanner);
+    return balanced;
+}
+
+/**
+ * Function that parses one split off subtree, runs on parallelRun worker
+ * @param index Task index
+ * @param context Array of textTask_t
+ */
+
+template<typename ValueHandler>
+void runTextTask(size_t index, void *context) {
+    textTask_t<ValueHandler> *task = (textTask_t<ValueHandler> *) context + index;
+
+    task->subtree = parseTree(task->serialized + task->open, task->length, task->handleValue, true,
+                              &task->errorOffset);
+    task->errorOffset += task->open;
+}
+
+/**
+ * Function that checks that nothing but whitespace is left before the end of skeleton node
+ * @param frame Pointer to textFrame_t
+ * @return nullptr if node is complete, otherwise position of the error
+ */
+
+inline const char *textFrameClose(const textFrame_t *frame) {
+    const char *pos = parseSkipSpace(frame->pos, frame->close);
+    if (pos != frame->close || (frame->skip && !frame->children))
+        return pos;
+
+    return nullptr;
+}
+
+/**
+ * Function that parses serialized tree on several threads. Subtrees are found by a brace pre-scan. The upper part of
+ * the tree is parsed on the calling thread, large enough subtrees below it are parsed concurrently into their own
+ * node pools and grafted afterwards. Errors are reported at the same offset as by parseTree
+ * @param serialized Pointer to serialized tree, does not have to be null-terminated
+ * @param length Length of serialized tree in bytes
+ * @param handleValue Value handler, copied for every task
+ * @param errorOffset Optional pointer to store byte offset of the first error
+ * @param threads Number of threads, 0 for the number of hardware threads
+ * @return Pointer to restored pooled tree or nullptr on error
+ */
+
+template<typename ValueHandler>
+tree_t *parseTreeParallel(const char *serialized, size_t length, ValueHandler &handleValue, size_t *errorOffset,
+                          size_t threads) {
+    assert(serialized);
+
+    threads = parallelThreads(threads);
+    size_t splitDepth = parallelSplitDepth(threads);
+    textSpan_t *spans = nullptr;
+    size_t spanCount = 0;
+
+    // Malformed input goes to the sequential parser, which finds the exact error position
+    if (threads <= 1 || length < PARALLEL_MIN_INPUT ||
+        !scanTextSpans(serialized, length, splitDepth, &spans, &spanCount)) {
+        countedFree(spans);
+        return parseTree(serialized, length, handleValue, true, errorOffset);
+    }
+
+    size_t target = length / (threads * PARALLEL_TASKS_PER_THREAD);
+    auto *tasks = (textTask_t<ValueHandler> *) countedCalloc(spanCount, sizeof(textTask_t<ValueHandler>));
+    auto *frames = (textFrame_t *) countedCalloc(splitDepth + 1, sizeof(textFrame_t));
+    assert(tasks && frames);
+
+    size_t taskCount = 0;
+    size_t frameCount = 0;
+    const char *error = nullptr;
+    tree_t *tree = nullptr;
+
+    for (size_t index = 0; index < spanCount && !error;) {
+        const textSpan_t *span = &spans[index];
+        const char *open = serialized + span->open;
+
+        while (frameCount && frames[frameCount - 1].close < open && !error)
+            error = textFrameClose(&frames[--frameCount]);
+        if (error)
+            break;
+
+        textFrame_t *parent = frameCount ? &frames[frameCount - 1] : nullptr;
+        bool left = true;
+        if (parent) {
+            const char *pos = parseSkipSpace(parent->pos, open);
+            if (pos != open || parent->children == 2 || (parent->skip && parent->children == 1)) {
+                error = pos;
+                break;
+            }
+
+            left = !parent->skip && !parent->children;
+            parent->children++;
+            parent->pos = serialized + span->close + 1;
+        }
+
+        size_t spanLength = span->close - span->open + 1;
+        if (parent && (spanLength <= target || span->depth == splitDepth)) {
+            tasks[taskCount++] = {serialized, span->open, spanLength, parent->node, left, handleValue, nullptr, 0};
+
+            for (index++; index < spanCount && spans[index].open < span->close; index++);
+            continue;
+        }
+
+        const char *pos = open + 1;
+        void *value = nullptr;
+        if (!parseValue(&pos, serialized + span->close, handleValue, &value)) {
+            error = pos;
+            break;
+        }
+
+        node_t *node = nullptr;
+        if (parent) {
+            node = treeMakeNode(tree, parent->node, nullptr, nullptr, value);
+            if (left)
+                parent->node->left = node;
+            else
+                parent->node->right = node;
+            nodeAugmentPath(parent->node);
+            tree->size++;
+        } else {
+            tree = makePooledTree(value);
+            node = tree->head;
+        }
+
+        pos = parseSkipSpace(pos, serialized + span->close);
+        bool skip = *pos == '$';
+        frames[frameCount++] = {node, skip ? pos + 1 : pos, serialized + span->close, 0, skip};
+        index++;
+    }
+
+    while (frameCount && !error)
+        error = textFrameClose(&frames[--frameCount]);
+
+    // Tasks lie before the skeleton error if there is one, so the first error in text order is still reported
+    parallelRun(taskCount, runTextTask<ValueHandler>, tasks, threads);
+
+    size_t firstError = error ? error - serialized : length;
+    for (size_t index = 0; index < taskCount; index++)
+        if (!tasks[index].subtree && tasks[index].errorOffset < firstError)
+            firstError = tasks[index].errorOffset;
+
+    if (firstError < length || error) {
+        for (size_t index = 0; index < taskCount; index++)
+            if (tasks[index].subtree)
+                deleteTree(tasks[index].subtree);
+        if (tree)
+            deleteTree(tree);
+        if (errorOffset)
+            *errorOffset = firstError;
+        tree = nullptr;
+    } else {
+        for (size_t index = 0; index < taskCount; index++) {
+            if (tasks[index].left)
+                addLeftSubtree(tree, tasks[index].parent, tasks[index].subtree);
+            else
+                addRightSubtree(tree, tasks[index].parent, tasks[index].subtree);
+        }
+    }
+
+    countedFree(frames);
+    countedFree(tasks);
+    countedFree(spans);
+    return tree;
+}
+
+#endif //TREE_TREEPARSER_H
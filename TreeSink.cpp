@@ -0,0 +1,522 @@
+//
+// Created by alexey on 17.10.2026.
+//
+
+#include "Tree.h"
+#include "TreeParallel.h"
+#include "TreeWriter.h"
+#include <cerrno>
+#include <climits>
+#include <cstdint>
+#include <fcntl.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+struct textPiece_t {
+    size_t task;
+    size_t offset;
+    size_t length;
+};
+
+struct textSplitTask_t {
+    node_t *node;
+    outputSink_t *sink;
+    functionValueWriter_t writer;
+};
+
+struct textSplit_t {
+    outputSink_t *skeleton;
+    functionValueWriter_t writer;
+    size_t splitDepth;
+    size_t pieceStart;
+    textPiece_t *pieces;
+    size_t pieceCount;
+    size_t pieceCapacity;
+    textSplitTask_t *tasks;
+    size_t taskCount;
+    size_t taskCapacity;
+};
+
+/**
+ * Sink "constructor"
+ * @param kind Sink kind
+ * @param capacity Initial buffer capacity
+ * @return Pointer to outputSink_t
+ */
+
+static outputSink_t *makeSink(SINK_KIND kind, size_t capacity) {
+    assert(capacity);
+
+    auto *sink = (outputSink_t *) countedCalloc(1, sizeof(outputSink_t));
+    sink->kind = kind;
+    sink->fd = -1;
+    sink->buffer = (char *) countedMalloc(capacity);
+    assert(sink->buffer);
+    sink->capacity = capacity;
+    return sink;
+}
+
+/**
+ * File sink "constructor". Sink does not own the file
+ * @param file Pointer to FILE to write to
+ * @param bufferSize Size of the staging buffer
+ * @return Pointer to outputSink_t
+ */
+
+outputSink_t *makeFileSink(FILE *file, size_t bufferSize) {
+    assert(file);
+
+    outputSink_t *sink = makeSink(FILE_SINK, bufferSize);
+    sink->file = file;
+    return sink;
+}
+
+/**
+ * File descriptor sink "constructor". Sink does not own the descriptor
+ * @param fd File descriptor to write to
+ * @param bufferSize Size of the staging buffer
+ * @return Pointer to outputSink_t
+ */
+
+outputSink_t *makeFdSink(int fd, size_t bufferSize) {
+    assert(fd >= 0);
+
+    outputSink_t *sink = makeSink(FD_SINK, bufferSize);
+    sink->fd = fd;
+    return sink;
+}
+
+/**
+ * Memory sink "constructor". Memory sink keeps everything written in a growable buffer
+ * @param initialCapacity Initial buffer capacity
+ * @return Pointer to outputSink_t
+ */
+
+outputSink_t *makeMemorySink(size_t initialCapacity) {
+    return makeSink(MEMORY_SINK, initialCapacity);
+}
+
+/**
+ * Function that writes out staging buffer of file or descriptor sink. Memory sink is left intact
+ * @param sink Pointer to outputSink_t
+ * @return false if sink has failed
+ */
+
+bool sinkFlush(outputSink_t *sink) {
+    assert(sink);
+
+    if (sink->kind == MEMORY_SINK || sink->failed) {
+        if (sink->failed)
+            sink->used = 0;
+        return !sink->failed;
+    }
+
+    if (sink->kind == FILE_SINK) {
+        if (fwrite(sink->buffer, 1, sink->used, sink->file) != sink->used)
+            sink->failed = true;
+    } else {
+        size_t written = 0;
+        while (written < sink->used) {
+            ssize_t result = write(sink->fd, sink->buffer + written, sink->used - written);
+            if (result < 0 && errno == EINTR)
+                continue;
+            if (result <= 0) {
+                sink->failed = true;
+                break;
+            }
+            written += result;
+        }
+    }
+
+    sink->used = 0;
+    return !sink->failed;
+}
+
+/**
+ * Function that provides room for at least length bytes. File and descriptor sinks are flushed first, buffer
+ * grows only if a single write does not fit into it
+ * @param sink Pointer to outputSink_t
+ * @param length Number of bytes needed
+ */
+
+void sinkMakeRoom(outputSink_t *sink, size_t length) {
+    assert(sink);
+
+    if (sink->kind != MEMORY_SINK)
+        sinkFlush(sink);
+
+    if (sink->capacity - sink->used >= length)
+        return;
+
+    size_t capacity = sink->capacity * 2;
+    while (capacity - sink->used < length)
+        capacity *= 2;
+
+    sink->buffer = (char *) countedRealloc(sink->buffer, capacity);
+    assert(sink->buffer);
+    sink->capacity = capacity;
+}
+
+/**
+ * Function that appends bytes to sink
+ * @param sink Pointer to outputSink_t
+ * @param data Pointer to bytes
+ * @param length Number of bytes
+ */
+
+void sinkWrite(outputSink_t *sink, const char *data, size_t length) {
+    assert(sink);
+    assert(data || !length);
+
+    sinkPut(sink, data, length);
+}
+
+/**
+ * Function that gives access to memory sink contents
+ * @param sink Pointer to memory outputSink_t
+ * @param length Pointer to store contents length
+ * @return Pointer to contents, valid until the next sink call
+ */
+
+const char *sinkData(const outputSink_t *sink, size_t *length) {
+    assert(sink);
+    assert(sink->kind == MEMORY_SINK);
+    assert(length);
+
+    *length = sink->used;
+    return sink->buffer;
+}
+
+/**
+ * Function that empties sink so that its buffer can be reused for the next snapshot
+ * @param sink Pointer to outputSink_t
+ */
+
+void sinkReset(outputSink_t *sink) {
+    assert(sink);
+
+    sink->used = 0;
+    sink->failed = false;
+}
+
+/**
+ * Function that takes memory sink contents over. Sink starts a new empty buffer
+ * @param sink Pointer to memory outputSink_t
+ * @param length Pointer to store contents length
+ * @return Pointer to contents, should be freed by caller
+ */
+
+char *sinkRelease(outputSink_t *sink, size_t *length) {
+    assert(sink);
+    assert(sink->kind == MEMORY_SINK);
+    assert(length);
+
+    char *contents = sink->buffer;
+    *length = sink->used;
+
+    sink->buffer = (char *) countedMalloc(sink->capacity);
+    assert(sink->buffer);
+    sink->used = 0;
+    return contents;
+}
+
+/**
+ * Sink "destructor". File and descriptor sinks are flushed, but file or descriptor is not closed
+ * @param sink Pointer to outputSink_t
+ * @return false if any write has failed
+ */
+
+bool deleteSink(outputSink_t *sink) {
+    assert(sink);
+
+    bool succeeded = sinkFlush(sink);
+
+    countedFree(sink->buffer);
+    countedFree(sink);
+    return succeeded;
+}
+
+/**
+ * Function that serializes nodes into sink
+ * @param node Pointer to node_t
+ * @param sink Pointer to outputSink_t
+ * @param writeValue Function that appends value to the buffer if it fits and returns value length
+ */
+
+void nodeSerialize(node_t *node, outputSink_t *sink, size_t (*writeValue)(void *, char *, size_t)) {
+    assert(node);
+    assert(sink);
+    assert(writeValue);
+
+    functionValueWriter_t writer = {writeValue};
+    serializeText(node, sink, writer);
+}
+
+/**
+ * Function that serializes tree into sink. File and descriptor sinks are flushed afterwards
+ * @param tree Pointer to tree_t
+ * @param sink Pointer to outputSink_t
+ * @param writeValue Function that appends value to the buffer if it fits and returns value length
+ * @return false if any write has failed
+ */
+
+bool treeSerialize(tree_t *tree, outputSink_t *sink, size_t (*writeValue)(void *, char *, size_t)) {
+    assert(tree);
+    assert(sink);
+    assert(writeValue);
+
+    treeExpandAll(tree);
+
+    sinkPut(sink, "{ ", 2);
+    nodeSerialize(tree->head, sink, writeValue);
+    sinkPut(sink, "}", 1);
+
+    return sinkFlush(sink);
+}
+
+/**
+ * Function that serializes tree into memory
+ * @param tree Pointer to tree_t
+ * @param writeValue Function that appends value to the buffer if it fits and returns value length
+ * @param length Pointer to store serialized length
+ * @return Pointer to serialized tree, should be freed by caller
+ */
+
+char *treeSerializeToMemory(tree_t *tree, size_t (*writeValue)(void *, char *, size_t), size_t *length) {
+    assert(tree);
+    assert(writeValue);
+    assert(length);
+
+    outputSink_t *sink = makeMemorySink();
+    treeSerialize(tree, sink, writeValue);
+
+    char *serialized = sinkRelease(sink, length);
+    deleteSink(sink);
+    return serialized;
+}
+
+/**
+ * Function that writes pieces of memory to sink in order. Descriptor sink hands them to writev without copying,
+ * other sinks append them to the buffer
+ * @param sink Pointer to outputSink_t
+ * @param pieces Array of iovec, consumed by the call
+ * @param count Number of pieces
+ * @return false if sink has failed
+ */
+
+static bool sinkWriteVector(outputSink_t *sink, struct iovec *pieces, size_t count) {
+    if (sink->kind != FD_SINK) {
+        for (size_t index = 0; index < count; index++)
+            sinkPut(sink, (const char *) pieces[index].iov_base, pieces[index].iov_len);
+        return !sink->failed;
+    }
+
+    if (!sinkFlush(sink))
+        return false;
+
+    while (count) {
+        ssize_t result = writev(sink->fd, pieces, (int) (count < IOV_MAX ? count : IOV_MAX));
+        if (result < 0 && errno == EINTR)
+            continue;
+        if (result <= 0) {
+            sink->failed = true;
+            return false;
+        }
+
+        // Skip what was written, partial writes leave the rest of a piece for the next call
+        auto written = (size_t) result;
+        while (count && written >= pieces->iov_len) {
+            written -= pieces->iov_len;
+            pieces++;
+            count--;
+        }
+
+        if (count) {
+            pieces->iov_base = (char *) pieces->iov_base + written;
+            pieces->iov_len -= written;
+        }
+    }
+
+    return true;
+}
+
+/**
+ * Function that ends skeleton piece of the split
+ * @param split Pointer to textSplit_t
+ * @param task Index of the task that follows the skeleton text or SIZE_MAX
+ */
+
+static void splitPiece(textSplit_t *split, size_t task) {
+    if (split->pieceCount + 2 > split->pieceCapacity) {
+        split->pieceCapacity *= 2;
+        split->pieces = (textPiece_t *) countedRealloc(split->pieces, split->pieceCapacity * sizeof(textPiece_t));
+        assert(split->pieces);
+    }
+
+    size_t used = split->skeleton->used;
+    if (used > split->pieceStart)
+        split->pieces[split->pieceCount++] = {SIZE_MAX, split->pieceStart, used - split->pieceStart};
+    split->pieceStart = used;
+
+    if (task != SIZE_MAX)
+        split->pieces[split->pieceCount++] = {task, 0, 0};
+}
+
+static void splitText(textSplit_t *split, node_t *node, size_t depth);
+
+/**
+ * Function that either serializes child into skeleton or leaves it to a separate task
+ * @param split Pointer to textSplit_t
+ * @param child Pointer to child node
+ * @param depth Depth of the child
+ */
+
+static void splitChild(textSplit_t *split, node_t *child, size_t depth) {
+    if (depth < split->splitDepth) {
+        splitText(split, child, depth);
+        return;
+    }
+
+    if (split->taskCount == split->taskCapacity) {
+        split->taskCapacity *= 2;
+        split->tasks = (textSplitTask_t *) countedRealloc(split->tasks, split->taskCapacity * sizeof(textSplitTask_t));
+        assert(split->tasks);
+    }
+
+    split->tasks[split->taskCount] = {child, nullptr, split->writer};
+    splitPiece(split, split->taskCount++);
+}
+
+/**
+ * Function that serializes upper part of the tree into skeleton exactly the way serializeText does. Recursion depth
+ * is bounded by the split depth
+ * @param split Pointer to textSplit_t
+ * @param node Pointer to node_t
+ * @param depth Depth of the node
+ */
+
+static void splitText(textSplit_t *split, node_t *node, size_t depth) {
+    outputSink_t *sink = split->skeleton;
+
+    sinkPut(sink, "\"", 1);
+    sinkPutValue(sink, split->writer, node->value);
+    sinkPut(sink, "\" ", 2);
+
+    if (node->left) {
+        sinkPut(sink, "{ ", 2);
+        splitChild(split, node->left, depth + 1);
+        sinkPut(sink, "} ", 2);
+    } else if (node->right) {
+        sinkPut(sink, "$ ", 2);
+    }
+
+    if (node->right) {
+        sinkPut(sink, "{ ", 2);
+        splitChild(split, node->right, depth + 1);
+        sinkPut(sink, "} ", 2);
+    }
+}
+
+/**
+ * Function that serializes one split off subtree into its own memory sink, runs on parallelRun worker
+ * @param index Task index
+ * @param context Array of textSplitTask_t
+ */
+
+static void runSplitTask(size_t index, void *context) {
+    textSplitTask_t *task = (textSplitTask_t *) context + index;
+
+    task->sink = makeMemorySink();
+    serializeText(task->node, task->sink, task->writer);
+}
+
+/**
+ * Function that serializes tree into sink on several threads. Upper levels of the tree are serialized on the calling
+ * thread, subtrees below them are serialized concurrently into separate buffers, which are then written out in order,
+ * with a single writev per IOV_MAX buffers for descriptor sinks. Output is byte-identical to treeSerialize
+ * @param tree Pointer to tree_t
+ * @param sink Pointer to outputSink_t
+ * @param writeValue Function that appends value to the buffer if it fits and returns value length, called concurrently
+ * @param threads Number of threads, 0 for the number of hardware threads
+ * @return false if any write has failed
+ */
+
+bool treeSerializeParallel(tree_t *tree, outputSink_t *sink, size_t (*writeValue)(void *, char *, size_t),
+                           size_t threads) {
+    assert(tree);
+    assert(sink);
+    assert(writeValue);
+
+    treeExpandAll(tree);
+
+    threads = parallelThreads(threads);
+    if (threads <= 1 || tree->size < PARALLEL_CUTOFF)
+        return treeSerialize(tree, sink, writeValue);
+
+    textSplit_t split = {};
+    split.skeleton = makeMemorySink();
+    split.writer = {writeValue};
+    split.splitDepth = parallelSplitDepth(threads);
+    split.pieceCapacity = 64;
+    split.pieces = (textPiece_t *) countedCalloc(split.pieceCapacity, sizeof(textPiece_t));
+    split.taskCapacity = 64;
+    split.tasks = (textSplitTask_t *) countedCalloc(split.taskCapacity, sizeof(textSplitTask_t));
+    assert(split.pieces && split.tasks);
+
+    sinkPut(split.skeleton, "{ ", 2);
+    splitText(&split, tree->head, 0);
+    sinkPut(split.skeleton, "}", 1);
+    splitPiece(&split, SIZE_MAX);
+
+    parallelRun(split.taskCount, runSplitTask, split.tasks, threads);
+
+    auto *vector = (struct iovec *) countedCalloc(split.pieceCount, sizeof(struct iovec));
+    assert(vector);
+
+    for (size_t index = 0; index < split.pieceCount; index++) {
+        const textPiece_t *piece = &split.pieces[index];
+        if (piece->task == SIZE_MAX) {
+            vector[index].iov_base = split.skeleton->buffer + piece->offset;
+            vector[index].iov_len = piece->length;
+        } else {
+            vector[index].iov_base = split.tasks[piece->task].sink->buffer;
+            vector[index].iov_len = split.tasks[piece->task].sink->used;
+        }
+    }
+
+    bool written = sinkWriteVector(sink, vector, split.pieceCount) && sinkFlush(sink);
+
+    for (size_t index = 0; index < split.taskCount; index++)
+        deleteSink(split.tasks[index].sink);
+    deleteSink(split.skeleton);
+    countedFree(vector);
+    countedFree(split.tasks);
+    countedFree(split.pieces);
+    return written;
+}
+
+/**
+ * Function that serializes tree into file on several threads, see treeSerializeParallel above
+ * @param tree Pointer to tree_t
+ * @param filename Filename to write to
+ * @param writeValue Function that appends value to the buffer if it fits and returns value length, called concurrently
+ * @param threads Number of threads, 0 for the number of hardware threads
+ * @return false if file can not be opened or any write has failed
+ */
+
+bool treeSerializeParallel(tree_t *tree, const char *filename, size_t (*writeValue)(void *, char *, size_t),
+                           size_t threads) {
+    assert(tree);
+    assert(filename);
+    assert(writeValue);
+
+    int fd = open(filename, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0)
+        return false;
+
+    outputSink_t *sink = makeFdSink(fd);
+    bool written = treeSerializeParallel(tree, sink, writeValue, threads);
+    written = deleteSink(sink) && written;
+
+    return close(fd) == 0 && written;
+}
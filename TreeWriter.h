@@ -0,0 +1,152 @@
+//
+// Created by alexey on 17.10.2026.
+//
+
+#ifndef TREE_TREEWRITER_H
+#define TREE_TREEWRITER_H
+#include "Tree.h"
+#include "TreeIterators.h"
+
+/*
+ * Buffered writers on top of outputSink_t. Value conversion is delegated to a writer object with
+ *     size_t operator()(void *value, char *buffer, size_t capacity)
+ * that returns value length and writes the value only if it fits into capacity, like snprintf does.
+ */
+
+const size_t SINK_VALUE_RESERVE = 64;
+
+void treeForgetNode(tree_t *tree, node_t *node);
+
+void treeForgetSubtree(tree_t *tree, node_t *node);
+
+/**
+ * Value writer that calls plain function writer
+ */
+
+struct functionValueWriter_t {
+    size_t (*writeValue)(void *, char *, size_t);
+
+    size_t operator()(void *value, char *buffer, size_t capacity) {
+        return writeValue(value, buffer, capacity);
+    }
+};
+
+/**
+ * Value writer that adapts serializers returning null-terminated strings
+ */
+
+struct stringValueWriter_t {
+    char *(*serializeValue)(void *);
+    void *lastValue;
+    char *lastString;
+
+    size_t operator()(void *value, char *buffer, size_t capacity) {
+        // Second call for the same value comes after a short buffer, do not serialize value twice
+        if (!lastString || value != lastValue) {
+            lastValue = value;
+            lastString = serializeValue(value);
+        }
+
+        size_t length = strlen(lastString);
+        if (length <= capacity)
+            memcpy(buffer, lastString, length);
+
+        return length;
+    }
+};
+
+/**
+ * Function that provides room for at least length bytes in sink buffer
+ * @param sink Pointer to outputSink_t
+ * @param length Number of bytes to reserve
+ * @return Pointer to the reserved room, valid until the next sink call
+ */
+
+inline char *sinkReserve(outputSink_t *sink, size_t length) {
+    if (sink->capacity - sink->used < length)
+        sinkMakeRoom(sink, length);
+
+    return sink->buffer + sink->used;
+}
+
+/**
+ * Function that marks reserved bytes as written
+ * @param sink Pointer to outputSink_t
+ * @param length Number of written bytes
+ */
+
+inline void sinkCommit(outputSink_t *sink, size_t length) {
+    sink->used += length;
+}
+
+/**
+ * Function that appends bytes to sink
+ * @param sink Pointer to outputSink_t
+ * @param data Pointer to bytes
+ * @param length Number of bytes
+ */
+
+inline void sinkPut(outputSink_t *sink, const char *data, size_t length) {
+    memcpy(sinkReserve(sink, length), data, length);
+    sinkCommit(sink, length);
+}
+
+/**
+ * Function that lets value writer append value right into the sink buffer
+ * @param sink Pointer to outputSink_t
+ * @param writeValue Value writer
+ * @param value Value or pointer to value, passed to the writer as is
+ * @return Value length
+ */
+
+template<typename ValueWriter, typename Value>
+size_t sinkPutValue(outputSink_t *sink, ValueWriter &writeValue, const Value &value) {
+    char *buffer = sinkReserve(sink, SINK_VALUE_RESERVE);
+    size_t available = sink->capacity - sink->used;
+    size_t length = writeValue(value, buffer, available);
+
+    if (length > available) {
+        buffer = sinkReserve(sink, length);
+        writeValue(value, buffer, length);
+    }
+
+    sinkCommit(sink, length);
+    return length;
+}
+
+/**
+ * Function that serializes nodes in text format. Walks the subtree with preorder iterator, so it does not recurse.
+ * Works for any node type with left, right, parent and value fields
+ * @param node Pointer to subtree root
+ * @param sink Pointer to outputSink_t
+ * @param writeValue Value writer
+ */
+
+template<typename Node, typename ValueWriter>
+void serializeText(Node *node, outputSink_t *sink, ValueWriter &writeValue) {
+    Node *previous = nullptr;
+    for (Node *current : preorder(node)) {
+        if (!previous) {
+            // Subtree root is not preceded by any bracket
+        } else if (previous->left == current) {
+            sinkPut(sink, "{ ", 2);
+        } else if (previous->right == current) {
+            sinkPut(sink, "$ { ", 4);
+        } else {
+            // Previous node is a leaf: close subtrees up to the left sibling of the current node
+            for (Node *closed = previous; closed != current->parent->left; closed = closed->parent)
+                sinkPut(sink, "} ", 2);
+            sinkPut(sink, "} { ", 4);
+        }
+
+        sinkPut(sink, "\"", 1);
+        sinkPutValue(sink, writeValue, current->value);
+        sinkPut(sink, "\" ", 2);
+        previous = current;
+    }
+
+    for (Node *closed = previous; closed != node; closed = closed->parent)
+        sinkPut(sink, "} ", 2);
+}
+
+#endif //TREE_TREEWRITER_H
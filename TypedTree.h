@@ -0,0 +1,437 @@
+//
+// Created by alexey on 17.10.2026.
+//
+
+#ifndef TREE_TYPEDTREE_H
+#define TREE_TYPEDTREE_H
+#include "Tree.h"
+#include "TreeWriter.h"
+#include <new>
+#include <type_traits>
+#include <utility>
+
+/*
+ * Typed counterpart of tree_t. Values are stored inline in nodes, nodes are taken from slab chunks owned by the
+ * tree, and value conversion is resolved at compile time through policies:
+ *
+ *     struct Serializer {
+ *         static size_t write(const T &value, char *buffer, size_t capacity);
+ *     };
+ *
+ * write() follows snprintf convention: it returns value length and fills buffer only if the value fits.
+ * Dumper policies have the same interface and render value part of the DOT record.
+ * Serialized text is the same format as treeSerialize writes.
+ */
+
+template<typename T>
+struct typedNode_t {
+    typedNode_t *left;
+    typedNode_t *right;
+    typedNode_t *parent;
+    T value;
+};
+
+template<typename T>
+class Tree {
+public:
+    typedef typedNode_t<T> node_type;
+
+    /**
+     * Tree constructor
+     * @param headValue Value for tree head
+     */
+
+    explicit Tree(const T &headValue) : head_(nullptr), size_(0), chunks_(nullptr), freeList_(nullptr) {
+        head_ = makeNode(nullptr, headValue);
+    }
+
+    Tree(const Tree &) = delete;
+
+    Tree &operator=(const Tree &) = delete;
+
+    /**
+     * Move constructor. Other tree is left empty
+     * @param other Tree to take nodes from
+     */
+
+    Tree(Tree &&other) noexcept : head_(other.head_), size_(other.size_), chunks_(other.chunks_),
+                                  freeList_(other.freeList_) {
+        other.head_ = nullptr;
+        other.size_ = 0;
+        other.chunks_ = nullptr;
+        other.freeList_ = nullptr;
+    }
+
+    /**
+     * Move assignment. Nodes of this tree are destroyed
+     * @param other Tree to take nodes from
+     * @return Reference to this tree
+     */
+
+    Tree &operator=(Tree &&other) noexcept {
+        if (this != &other) {
+            release();
+            std::swap(head_, other.head_);
+            std::swap(size_, other.size_);
+            std::swap(chunks_, other.chunks_);
+            std::swap(freeList_, other.freeList_);
+        }
+
+        return *this;
+    }
+
+    ~Tree() {
+        release();
+    }
+
+    node_type *head() const {
+        return head_;
+    }
+
+    /**
+     * @return Number of nodes below the head, same as tree_t::size
+     */
+
+    size_t size() const {
+        return size_;
+    }
+
+    static node_type *getLeftNode(node_type *node) {
+        assert(node);
+        return node->left;
+    }
+
+    static node_type *getRightNode(node_type *node) {
+        assert(node);
+        return node->right;
+    }
+
+    static node_type *getParent(node_type *node) {
+        assert(node);
+        return node->parent;
+    }
+
+    /**
+     * Function that adds left node
+     * @param node Pointer to target node, must not have left child
+     * @param value Value for new node
+     * @return Pointer to new node
+     */
+
+    node_type *addLeftNode(node_type *node, const T &value) {
+        assert(node);
+        assert(!node->left);
+
+        node->left = makeNode(node, value);
+        size_++;
+        return node->left;
+    }
+
+    /**
+     * Function that adds right node
+     * @param node Pointer to target node, must not have right child
+     * @param value Value for new node
+     * @return Pointer to new node
+     */
+
+    node_type *addRightNode(node_type *node, const T &value) {
+        assert(node);
+        assert(!node->right);
+
+        node->right = makeNode(node, value);
+        size_++;
+        return node->right;
+    }
+
+    /**
+     * Function that adds subtree to the left. Subtree nodes and chunks are moved into this tree
+     * @param node Pointer to target node, must not have left child
+     * @param subtree Tree to attach
+     */
+
+    void addLeftSubtree(node_type *node, Tree &&subtree) {
+        assert(node);
+        assert(!node->left);
+
+        node->left = adopt(node, subtree);
+    }
+
+    /**
+     * Function that adds subtree to the right. Subtree nodes and chunks are moved into this tree
+     * @param node Pointer to target node, must not have right child
+     * @param subtree Tree to attach
+     */
+
+    void addRightSubtree(node_type *node, Tree &&subtree) {
+        assert(node);
+        assert(!node->right);
+
+        node->right = adopt(node, subtree);
+    }
+
+    /**
+     * Function that deletes node AND ALL THE SUBNODES and detaches it from parent
+     * @param node Pointer to node for deleting, must not be the head
+     */
+
+    void deleteNode(node_type *node) {
+        assert(node);
+        assert(node != head_);
+
+        node_type *parent = node->parent;
+        if (parent->left == node)
+            parent->left = nullptr;
+        else
+            parent->right = nullptr;
+
+        size_ -= destroySubtree(node, true);
+    }
+
+    /**
+     * Function that serializes tree into sink in treeSerialize format
+     * @tparam Serializer Value serializer policy
+     * @param sink Pointer to outputSink_t
+     * @return false if any write has failed
+     */
+
+    template<typename Serializer>
+    bool serialize(outputSink_t *sink) const {
+        assert(sink);
+        assert(head_);
+
+        policyWriter<Serializer> writer;
+        sinkPut(sink, "{ ", 2);
+        serializeText(head_, sink, writer);
+        sinkPut(sink, "}", 1);
+
+        return sinkFlush(sink);
+    }
+
+    /**
+     * Function that serializes tree into file in treeSerialize format
+     * @tparam Serializer Value serializer policy
+     * @param filename Filename to write to
+     * @return false if file can not be written
+     */
+
+    template<typename Serializer>
+    bool serialize(const char *filename) const {
+        assert(filename);
+
+        FILE *out = fopen(filename, "w");
+        if (!out)
+            return false;
+
+        outputSink_t *sink = makeFileSink(out);
+        bool written = serialize<Serializer>(sink);
+        written = deleteSink(sink) && written;
+        return fclose(out) == 0 && written;
+    }
+
+    /**
+     * Function that dumps tree in DOT format without values
+     * @param filename Dump file name
+     * @return false if file can not be written
+     */
+
+    bool dump(const char *filename) const {
+        return dumpFile<noValueDumper>(filename, false);
+    }
+
+    /**
+     * Function that dumps tree in DOT format
+     * @tparam Dumper Value renderer policy
+     * @param filename Dump file name
+     * @return false if file can not be written
+     */
+
+    template<typename Dumper>
+    bool dump(const char *filename) const {
+        return dumpFile<Dumper>(filename, true);
+    }
+
+private:
+    struct chunk_t {
+        chunk_t *next;
+        size_t capacity;
+        size_t used;
+    };
+
+    struct noValueDumper {
+        static size_t write(const T &, char *, size_t) {
+            return 0;
+        }
+    };
+
+    template<typename Policy>
+    struct policyWriter {
+        size_t operator()(const T &value, char *buffer, size_t capacity) {
+            return Policy::write(value, buffer, capacity);
+        }
+    };
+
+    static const size_t NODES_OFFSET = (sizeof(chunk_t) + alignof(node_type) - 1) / alignof(node_type) *
+                                       alignof(node_type);
+
+    node_type *head_;
+    size_t size_;
+    chunk_t *chunks_;
+    node_type *freeList_;
+
+    static node_type *chunkNodes(chunk_t *chunk) {
+        return (node_type *) ((char *) chunk + NODES_OFFSET);
+    }
+
+    node_type *makeNode(node_type *parent, const T &value) {
+        node_type *node = freeList_;
+
+        if (node) {
+            freeList_ = node->left;
+        } else {
+            if (!chunks_ || chunks_->used == chunks_->capacity) {
+                size_t capacity = chunks_ ? chunks_->capacity * 2 : POOL_FIRST_CHUNK;
+                if (capacity > POOL_MAX_CHUNK)
+                    capacity = POOL_MAX_CHUNK;
+
+                auto *chunk = (chunk_t *) countedMalloc(NODES_OFFSET + capacity * sizeof(node_type));
+                if (!chunk)
+                    throw std::bad_alloc();
+                chunk->next = chunks_;
+                chunk->capacity = capacity;
+                chunk->used = 0;
+                chunks_ = chunk;
+            }
+
+            node = chunkNodes(chunks_) + chunks_->used++;
+        }
+
+        node->left = nullptr;
+        node->right = nullptr;
+        node->parent = parent;
+        new(&node->value) T(value);
+        return node;
+    }
+
+    size_t destroySubtree(node_type *node, bool recycle) {
+        size_t destroyed = 0;
+        node_type *current = postorderFirst(node);
+
+        while (current) {
+            node_type *next = postorderNext(node, current);
+
+            current->value.~T();
+            if (recycle) {
+                current->left = freeList_;
+                freeList_ = current;
+            }
+            destroyed++;
+
+            current = next;
+        }
+
+        return destroyed;
+    }
+
+    node_type *adopt(node_type *parent, Tree &subtree) {
+        assert(subtree.head_);
+        assert(&subtree != this);
+
+        node_type *head = subtree.head_;
+        head->parent = parent;
+        size_ += subtree.size_ + 1;
+
+        if (subtree.chunks_) {
+            chunk_t *last = subtree.chunks_;
+            while (last->next)
+                last = last->next;
+
+            // Keep chunk with spare room first so that new nodes are still bump-allocated from it
+            if (chunks_) {
+                last->next = chunks_->next;
+                chunks_->next = subtree.chunks_;
+            } else {
+                chunks_ = subtree.chunks_;
+            }
+        }
+
+        if (subtree.freeList_) {
+            node_type *last = subtree.freeList_;
+            while (last->left)
+                last = last->left;
+            last->left = freeList_;
+            freeList_ = subtree.freeList_;
+        }
+
+        subtree.head_ = nullptr;
+        subtree.size_ = 0;
+        subtree.chunks_ = nullptr;
+        subtree.freeList_ = nullptr;
+        return head;
+    }
+
+    void release() {
+        // Trivially destructible values need no walk, chunks are released as a whole
+        if (head_ && !std::is_trivially_destructible<T>::value)
+            destroySubtree(head_, false);
+
+        while (chunks_) {
+            chunk_t *next = chunks_->next;
+            countedFree(chunks_);
+            chunks_ = next;
+        }
+
+        head_ = nullptr;
+        freeList_ = nullptr;
+        size_ = 0;
+    }
+
+    template<typename Dumper>
+    static void dumpRecord(outputSink_t *sink, node_type *node, const char *color, bool withValue) {
+        char *buffer = sinkReserve(sink, 128);
+        sinkCommit(sink, snprintf(buffer, 128, "node%p[shape=record, label=\"{%p | {PARENT|%p}",
+                                  (void *) node, (void *) node, (void *) node->parent));
+
+        if (withValue) {
+            policyWriter<Dumper> writer;
+            sinkPut(sink, "| ", 2);
+            sinkPutValue(sink, writer, node->value);
+        }
+
+        buffer = sinkReserve(sink, 192);
+        sinkCommit(sink, snprintf(buffer, 192, " | {{LEFT |<left> %p} | {RIGHT |<right> %p}}}\", style=filled, "
+                                               "fillcolor=%s];\n", (void *) node->left, (void *) node->right, color));
+    }
+
+    template<typename Dumper>
+    bool dumpFile(const char *filename, bool withValue) const {
+        assert(filename);
+        assert(head_);
+
+        FILE *out = fopen(filename, "w");
+        if (!out)
+            return false;
+
+        outputSink_t *sink = makeFileSink(out);
+        sinkPut(sink, "digraph {\nconcentrate=true\n", 27);
+        dumpRecord<Dumper>(sink, head_, "mediumturquoise", withValue);
+
+        for (node_type *current : preorder(head_)) {
+            if (current == head_)
+                continue;
+
+            bool left = current->parent->left == current;
+            dumpRecord<Dumper>(sink, current, left ? "indianred" : "springgreen", withValue);
+
+            char *buffer = sinkReserve(sink, 128);
+            sinkCommit(sink, snprintf(buffer, 128, "node%p -> node%p:%s;\nnode%p:%s -> node%p;\n",
+                                      (void *) current, (void *) current->parent, left ? "left" : "right",
+                                      (void *) current->parent, left ? "left" : "right", (void *) current));
+        }
+
+        sinkPut(sink, "}\n", 2);
+        bool written = deleteSink(sink);
+        return fclose(out) == 0 && written;
+    }
+};
+
+#endif //TREE_TYPEDTREE_H
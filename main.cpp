@@ -4,50 +4,36 @@
 #include <cstring>
 #include "Tree.h"
 
-void *deserializeValue(char *str) {
-    int *val = (int *) calloc(1, sizeof(int));
-    sscanf(str, "%d", val);
-    return val;
-}
-
-char *serializeValue(void *val) {
-    char *str = (char *) calloc(11, sizeof(char));
-    sprintf(str, "%d", *(int *) val);
-    return str;
-}
-
 char *valueDump(void *val) {
-    char *str = (char *) calloc(33, sizeof(char));
-    sprintf(str, "{VALUE | %d}", *(int *) val);
+    static char str[40];
+    snprintf(str, sizeof(str), "{VALUE | %lld}", (long long) valueToInt(val));
     return str;
 }
 
 int main() {
-//    int vals[8] = {1, 2, 3, 4, 5, 6, 7, 8};
-//    tree_t *tree = makeTree(&vals[0]);
-//    addLeftNode(tree, tree->head, &vals[1]);
-//    addRightNode(tree, tree->head, &vals[2]);
+//    tree_t *tree = makeTree(intValue(1));
+//    addLeftNode(tree, tree->head, intValue(2));
+//    addRightNode(tree, tree->head, intValue(3));
 //
-//    addLeftNode(tree, getRightNode(tree->head), &vals[3]);
-//    addRightNode(tree, getRightNode(tree->head), &vals[4]);
+//    addLeftNode(tree, getRightNode(tree->head), intValue(4));
+//    addRightNode(tree, getRightNode(tree->head), intValue(5));
 //
-//    addLeftNode(tree, getLeftNode(tree->head), &vals[5]);
-//    addRightNode(tree, getLeftNode(tree->head), &vals[6]);
+//    addLeftNode(tree, getLeftNode(tree->head), intValue(6));
+//    addRightNode(tree, getLeftNode(tree->head), intValue(7));
 //
-//    addRightNode(tree, getLeftNode(getRightNode(tree->head)), &vals[7]);
+//    addRightNode(tree, getLeftNode(getRightNode(tree->head)), intValue(8));
 //
 //    treeDump(tree, "testDump.dot", valueDump);
-//    treeSerialize(tree, "serialized.txt", serializeValue);
+//    FILE *serialized = fopen("serialized.txt", "w");
+//    outputSink_t *sink = makeFileSink(serialized);
+//    treeSerialize(tree, sink, INT_CODEC);
+//    deleteSink(sink);
+//    fclose(serialized);
 //    return 0;
 
-    FILE *ser = fopen("serialized.txt", "r");
-    fseek(ser, 0, SEEK_END);
-    int len = ftell(ser);
-    rewind(ser);
-    char *buf = (char *) calloc(len + 1, sizeof(char));
-    fread(buf, sizeof(char), len, ser);
-    tree_t *newTree = treeDeserialize(buf, deserializeValue);
-    fclose(ser);
+    tree_t *newTree = treeLoad("serialized.txt", INT_CODEC, nullptr, true);
+    if (!newTree)
+        return 1;
     treeDump(newTree, "restored.dot", valueDump);
     return 0;
 }
@@ -0,0 +1,65 @@
+//
+// Created by alexey on 17.10.2026.
+//
+
+#include "TreeTest.h"
+#include "../CompactTree.h"
+
+/**
+ * Function that checks compact tree size against its nodes
+ * @param compact Pointer to compactTree_t
+ */
+
+static void checkSize(compactTree_t *compact) {
+    size_t nodes = 0;
+    for (uint32_t node = compact->head; node != NO_NODE; node = compactPreorderNext(compact, compact->head, node))
+        nodes++;
+
+    CHECK(nodes == compact->size + 1);
+}
+
+/**
+ * Adding over an existing child deletes the old subtree, its slots are reused and size stays exact
+ */
+
+static void testReplaceChild(tree_t *tree) {
+    compactTree_t *compact = compactFromTree(tree);
+    size_t count = compact->count;
+
+    for (int round = 0; round < 20; round++) {
+        uint32_t child = compactAddLeftNode(compact, compact->head, intValue(round));
+        compactAddRightNode(compact, child, intValue(round));
+        compactAddRightNode(compact, compact->head, intValue(round));
+        checkSize(compact);
+    }
+    CHECK(compact->size == 3);
+    CHECK(compact->count <= count + 3);
+
+    for (int round = 0; round < 20; round++) {
+        compactTree_t *subtree = compactFromTree(tree);
+        size_t size = subtree->size;
+        if (round % 2)
+            compactAddLeftSubtree(compact, compact->head, subtree);
+        else
+            compactAddRightSubtree(compact, compact->head, subtree);
+        checkSize(compact);
+        CHECK(round == 0 || compact->size == 2 * size + 2);
+    }
+    CHECK(compact->count <= 2 * count + 4);
+
+    deleteCompactTree(compact);
+}
+
+int main() {
+    const size_t sizes[] = {1, 2, 100, 5000};
+
+    for (size_t nodes : sizes) {
+        for (int chain = 0; chain < 2; chain++) {
+            tree_t *tree = makeRandomTree(nodes, 5 + nodes, false, chain == 1);
+            testReplaceChild(tree);
+            deleteTree(tree);
+        }
+    }
+
+    return testResult("TestCompact");
+}
@@ -0,0 +1,188 @@
+//
+// Created by alexey on 17.10.2026.
+//
+
+#include "TreeTest.h"
+#include "../TreeIterators.h"
+#include <string>
+
+/**
+ * Function that picks random node other than the head
+ * @param tree Pointer to tree_t with at least two nodes
+ * @param seed Pointer to random state
+ * @return Pointer to node_t
+ */
+
+static node_t *randomNode(tree_t *tree, uint64_t *seed) {
+    std::vector<node_t *> nodes;
+    for (node_t *node : preorder(tree))
+        nodes.push_back(node);
+
+    return nodes[1 + testRandom(seed) % (nodes.size() - 1)];
+}
+
+/**
+ * Function that serializes the tree with its serial cache and checks the text against full serialization
+ * @param tree Pointer to tree_t with serial cache enabled
+ */
+
+static void checkIncremental(tree_t *tree) {
+    outputSink_t *sink = makeMemorySink();
+    CHECK(treeSerializeIncremental(tree, sink));
+    size_t length = 0;
+    const char *text = sinkData(sink, &length);
+
+    size_t fullLength = 0;
+    char *full = serializeInts(tree, &fullLength);
+    CHECK(length == fullLength && memcmp(text, full, length) == 0);
+
+    free(full);
+    deleteSink(sink);
+}
+
+/**
+ * Detached pooled subtree outlives its tree, shares the pool with it and goes back into it or into another tree
+ */
+
+static void testPooled(bool chain) {
+    uint64_t seed = chain ? 11 : 12;
+    tree_t *tree = makeRandomTree(3000, seed, true, chain);
+    size_t length = 0;
+    char *text = serializeInts(tree, &length);
+    tree_t *original = treeParse(text, length, INT_CODEC);
+    free(text);
+
+    // Detach and attach back restores the tree
+    node_t *node = randomNode(tree, &seed);
+    node_t *parent = node->parent;
+    bool left = parent->left == node;
+    size_t size = tree->size;
+    tree_t *subtree = detachSubtree(tree, node);
+    CHECK(subtree->pool == tree->pool);
+    CHECK(tree->size + subtree->size + 1 == size);
+    CHECK(nodeSubtreeSize(node) == subtree->size + 1);
+    if (left)
+        addLeftSubtree(tree, parent, subtree);
+    else
+        addRightSubtree(tree, parent, subtree);
+    CHECK(tree->size == size);
+    CHECK(tree->pool->owners == 1);
+    CHECK(sameTree(tree->head, original->head));
+
+    // Subtree outlives the tree it came from and keeps growing from the shared pool
+    node = randomNode(tree, &seed);
+    subtree = detachSubtree(tree, node);
+    deleteTree(tree);
+    CHECK(subtree->pool->owners == 1);
+    node_t *leaf = subtree->head;
+    while (leaf->left)
+        leaf = leaf->left;
+    addLeftNode(subtree, leaf, intValue(7));
+    CHECK(nodeSubtreeSize(subtree->head) == subtree->size + 1);
+
+    // Tree with a pool of its own moves into the shared pool of the subtree it takes
+    tree_t *sibling = detachSubtree(subtree, leaf->left);
+    tree_t *target = makePooledTree(intValue(1));
+    nodePool_t *shared = subtree->pool;
+    addRightSubtree(target, target->head, sibling);
+    CHECK(target->pool == shared);
+    CHECK(shared->owners == 2);
+    CHECK(target->size == 1 && intValue(7) == target->head->right->value);
+    deleteTree(subtree);
+    deleteTree(target);
+
+    deleteTree(original);
+}
+
+/**
+ * Detached subtree keeps the value arena of the tree alive
+ */
+
+static void testArena() {
+    const char text[] = "{ \"root\" { \"left\" { \"deep\" } } { \"right\" } }";
+    tree_t *tree = treeParse(text, sizeof(text) - 1, STRING_CODEC, nullptr, true);
+    CHECK(tree && tree->arena);
+    if (!tree)
+        return;
+
+    tree_t *subtree = detachSubtree(tree, tree->head->left);
+    CHECK(subtree->arena == tree->arena);
+    deleteTree(tree);
+
+    CHECK(strcmp((char *) subtree->head->value, "left") == 0);
+    CHECK(strcmp((char *) subtree->head->left->value, "deep") == 0);
+    deleteTree(subtree);
+}
+
+/**
+ * Serial cache drops fragments of detached subtrees, also when their nodes are freed and reused afterwards
+ */
+
+static void testSerialCache() {
+    uint64_t seed = 13;
+    tree_t *tree = makeRandomTree(5000, seed, true);
+    treeEnableSerialCache(tree, writeIntValue, 256);
+    checkIncremental(tree);
+
+    for (int round = 0; round < 20; round++) {
+        tree_t *subtree = detachSubtree(tree, randomNode(tree, &seed));
+        if (round % 2)
+            checkIncremental(tree);
+        deleteTree(subtree);
+
+        // Freed nodes go back to the shared pool and are reused here
+        for (int grow = 0; grow < 50; grow++) {
+            node_t *node = randomNode(tree, &seed);
+            if (!node->left)
+                addLeftNode(tree, node, intValue(grow));
+            else if (!node->right)
+                addRightNode(tree, node, intValue(grow));
+        }
+        checkIncremental(tree);
+    }
+
+    deleteTree(tree);
+}
+
+/**
+ * Lazy tree is expanded before its subtree leaves
+ */
+
+static void testLazy() {
+    tree_t *tree = makeRandomTree(2000, 14, true);
+    size_t length = 0;
+    char *text = serializeInts(tree, &length);
+
+    tree_t *lazy = treeParseLazy(text, length, readIntView, nullptr, 64);
+    CHECK(lazy);
+    if (lazy) {
+        uint64_t seed = 14;
+        node_t *node = tree->head;
+        node_t *lazyNode = lazy->head;
+        while (node->left || node->right) {
+            bool left = node->left && (!node->right || testRandom(&seed) % 2);
+            node = left ? node->left : node->right;
+            lazyNode = left ? getLeftNode(lazyNode) : getRightNode(lazyNode);
+        }
+
+        tree_t *subtree = detachSubtree(lazy, lazyNode->parent);
+        CHECK(!lazy->lazy);
+        CHECK(sameTree(node->parent, subtree->head));
+        CHECK(lazy->size + subtree->size + 1 == tree->size);
+        deleteTree(lazy);
+        deleteTree(subtree);
+    }
+
+    free(text);
+    deleteTree(tree);
+}
+
+int main() {
+    testPooled(false);
+    testPooled(true);
+    testArena();
+    testSerialCache();
+    testLazy();
+
+    return testResult("TestDetach");
+}
@@ -0,0 +1,131 @@
+//
+// Created by alexey on 17.10.2026.
+//
+
+#include "TreeTest.h"
+#include <string>
+
+static const char DUMP_FILE[] = "TestDump.dot";
+
+/**
+ * Function that reads the whole file
+ * @param filename Name of file
+ * @return File contents
+ */
+
+static std::string readFile(const char *filename) {
+    std::string contents;
+    FILE *file = fopen(filename, "rb");
+    CHECK(file);
+    if (!file)
+        return contents;
+
+    char buffer[4096];
+    size_t read = 0;
+    while ((read = fread(buffer, 1, sizeof(buffer), file)) > 0)
+        contents.append(buffer, read);
+    fclose(file);
+    return contents;
+}
+
+/**
+ * Quoted values dumped through a file sink smaller than the dump are escaped and written whole, the same way as
+ * through a memory sink
+ */
+
+static void testEscapedValuesSmallSink() {
+    std::vector<std::string> values;
+    for (size_t index = 0; index < 200; index++) {
+        std::string value = "v\"" + std::to_string(index) + "\\\"";
+        if (index % 10 == 0)
+            value += std::string(300, '"');
+        values.push_back(value);
+    }
+
+    tree_t *tree = makeTree((void *) values[0].c_str());
+    node_t *last = tree->head;
+    for (size_t index = 1; index < values.size(); index++) {
+        addLeftNode(tree, last, (void *) values[index].c_str());
+        last = last->left;
+    }
+
+    dumpOptions_t options = {nullptr, DUMP_UNLIMITED, DUMP_UNLIMITED, writeStringValue};
+
+    FILE *file = fopen(DUMP_FILE, "w");
+    CHECK(file);
+    if (!file) {
+        deleteTree(tree);
+        return;
+    }
+    outputSink_t *sink = makeFileSink(file, 256);
+    CHECK(treeDumpCompact(tree, sink, &options));
+    CHECK(deleteSink(sink));
+    fclose(file);
+
+    outputSink_t *memory = makeMemorySink();
+    CHECK(treeDumpCompact(tree, memory, &options));
+    size_t length = 0;
+    const char *expected = sinkData(memory, &length);
+    std::string dumped = readFile(DUMP_FILE);
+    CHECK(dumped == std::string(expected, length));
+    deleteSink(memory);
+
+    for (const std::string &value : values) {
+        std::string escaped;
+        for (char symbol : value) {
+            if (symbol == '"' || symbol == '\\')
+                escaped += '\\';
+            escaped += symbol;
+        }
+        CHECK(dumped.find("label=\"" + escaped + "\"]") != std::string::npos);
+    }
+
+    deleteTree(tree);
+}
+
+/**
+ * Elided nodes are counted exactly with TREE_AUGMENT and up to DUMP_COUNT_LIMIT otherwise
+ */
+
+static void testSummaries() {
+    tree_t *tree = makeRandomTree(5000, 21, true, true);
+    size_t elided = tree->size;
+#ifdef TREE_AUGMENT
+    std::string expected = std::to_string(elided) + " more";
+#else
+    std::string expected = std::to_string(DUMP_COUNT_LIMIT) + "+ more";
+#endif
+
+    dumpOptions_t options = {nullptr, 0, DUMP_UNLIMITED, nullptr};
+    outputSink_t *sink = makeMemorySink();
+    CHECK(treeDumpCompact(tree, sink, &options));
+    size_t length = 0;
+    const char *data = sinkData(sink, &length);
+    std::string dumped(data, length);
+    CHECK(dumped.find("\xE2\x80\xA6 " + expected) != std::string::npos);
+    deleteSink(sink);
+
+    // Small subtree is counted exactly either way
+    node_t *leaf = tree->head;
+    while (leaf->left || leaf->right)
+        leaf = leaf->left ? leaf->left : leaf->right;
+    addLeftNode(tree, leaf, intValue(1));
+    addLeftNode(tree, leaf->left, intValue(2));
+    options.root = leaf;
+    sink = makeMemorySink();
+    CHECK(treeDumpCompact(tree, sink, &options));
+    data = sinkData(sink, &length);
+    dumped.assign(data, length);
+    CHECK(dumped.find("\xE2\x80\xA6 2 more") != std::string::npos);
+    deleteSink(sink);
+
+    deleteTree(tree);
+}
+
+int main() {
+    testEscapedValuesSmallSink();
+    testSummaries();
+
+    remove(DUMP_FILE);
+    return testResult("TestDump");
+}
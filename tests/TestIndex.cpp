@@ -0,0 +1,150 @@
+//
+// Created by alexey on 17.10.2026.
+//
+
+#include "TreeTest.h"
+#include "../TreeParser.h"
+#include <string>
+
+/**
+ * Function that finds structural positions byte by byte, the reference for the kernels
+ * @param data Pointer to input
+ * @param length Length of input
+ * @return Positions of quotes and of non-whitespace bytes outside quotes
+ */
+
+static std::vector<uint32_t> referenceIndex(const char *data, size_t length) {
+    std::vector<uint32_t> positions;
+    bool quoted = false;
+
+    for (size_t pos = 0; pos < length; pos++) {
+        char byte = data[pos];
+        if (byte == '"') {
+            positions.push_back((uint32_t) pos);
+            quoted = !quoted;
+        } else if (!quoted && byte != ' ' && byte != '\n' && byte != '\t' && byte != '\r') {
+            positions.push_back((uint32_t) pos);
+        }
+    }
+
+    return positions;
+}
+
+/**
+ * Function that indexes input in windows of random length, carrying quote state between them
+ * @param kernel Index kernel
+ * @param input Input
+ * @param seed Pointer to random state
+ * @return Positions relative to input
+ */
+
+static std::vector<uint32_t> windowedIndex(INDEX_KERNEL kernel, const std::string &input, uint64_t *seed) {
+    std::vector<uint32_t> positions;
+    std::vector<uint32_t> window(input.size() + INDEX_BLOCK);
+    uint64_t quoted = 0;
+
+    for (size_t offset = 0; offset < input.size();) {
+        size_t size = 1 + testRandom(seed) % (4 * INDEX_BLOCK);
+        if (testRandom(seed) % 2)
+            size = (size + INDEX_BLOCK - 1) / INDEX_BLOCK * INDEX_BLOCK;
+        if (size > input.size() - offset)
+            size = input.size() - offset;
+
+        size_t count = indexStructurals(kernel, input.data() + offset, size, &quoted, window.data());
+        for (size_t index = 0; index < count; index++)
+            positions.push_back((uint32_t) offset + window[index]);
+        offset += size;
+    }
+
+    return positions;
+}
+
+/**
+ * Kernels agree with the reference on random input, including quoted regions that straddle blocks and windows
+ */
+
+static void testKernelsAgree() {
+    const char alphabet[] = "\"  \n\t\r{}$ab\xff";
+    uint64_t seed = 88172645463325252ULL;
+
+    for (int round = 0; round < 2000; round++) {
+        size_t length = testRandom(&seed) % 700;
+        std::string input;
+        for (size_t pos = 0; pos < length; pos++)
+            input += alphabet[testRandom(&seed) % (sizeof(alphabet) - 1)];
+
+        // Long quoted runs make regions cross several blocks
+        if (round % 4 == 0 && length > 10) {
+            size_t open = testRandom(&seed) % (length / 2);
+            size_t close = open + 65 + testRandom(&seed) % 200;
+            for (size_t pos = open; pos <= close && pos < length; pos++)
+                input[pos] = pos == open || pos == close ? '"' : 'x';
+        }
+
+        std::vector<uint32_t> expected = referenceIndex(input.data(), input.size());
+        for (int kernel = SCALAR_KERNEL; kernel <= AVX2_KERNEL; kernel++) {
+            if (!indexKernelSupported((INDEX_KERNEL) kernel))
+                continue;
+            CHECK(windowedIndex((INDEX_KERNEL) kernel, input, &seed) == expected);
+        }
+    }
+}
+
+/**
+ * Scanner finds the same positions as the reference across INDEX_WINDOW boundaries with every kernel
+ */
+
+static void testScannerWindows() {
+    std::string input = "{ \"" + std::string(INDEX_WINDOW + 100, 'v') + "\" { \"1\" } $ }";
+    input += std::string(INDEX_WINDOW - input.size() % INDEX_WINDOW - 1, ' ') + "{\"x\"}";
+    std::vector<uint32_t> expected = referenceIndex(input.data(), input.size());
+
+    for (int kernel = SCALAR_KERNEL; kernel <= AVX2_KERNEL; kernel++) {
+        if (!indexKernelSupported((INDEX_KERNEL) kernel))
+            continue;
+
+        structuralScanner_t scanner = {};
+        scannerInit(&scanner, input.data(), input.size(), (INDEX_KERNEL) kernel);
+        std::vector<uint32_t> found;
+        for (size_t pos = scannerNext(&scanner); pos < input.size(); pos = scannerNext(&scanner))
+            found.push_back((uint32_t) pos);
+        scannerFree(&scanner);
+
+        CHECK(found == expected);
+    }
+}
+
+/**
+ * Value longer than a scanner window is read whole, tree after it is still found
+ */
+
+static void testLongValue() {
+    std::string value(3 * INDEX_WINDOW + 7, 'a');
+    std::string input = "{ \"h\" { \"" + value + "\" { \"" + value + "\" } } { \"r\" } }";
+
+    viewValueHandler_t handler = {[](const char *, size_t length) { return intValue((int64_t) length); }};
+    size_t errorOffset = 0;
+    tree_t *tree = parseTree(input.data(), input.size(), handler, false, &errorOffset);
+    CHECK(tree);
+    if (!tree)
+        return;
+
+    CHECK(tree->size == 3);
+    CHECK(valueToInt(tree->head->left->value) == (int64_t) value.size());
+    CHECK(valueToInt(tree->head->left->left->value) == (int64_t) value.size());
+    CHECK(valueToInt(tree->head->right->value) == 1);
+    deleteTree(tree);
+
+    // The same input with the last closing brace missing fails at its end
+    input.pop_back();
+    tree = parseTree(input.data(), input.size(), handler, false, &errorOffset);
+    CHECK(!tree);
+    CHECK(errorOffset == input.size());
+}
+
+int main() {
+    testKernelsAgree();
+    testScannerWindows();
+    testLongValue();
+    return testResult("TestIndex");
+}
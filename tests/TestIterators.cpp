@@ -0,0 +1,86 @@
+//
+// Created by alexey on 17.10.2026.
+//
+
+#include "TreeTest.h"
+#include "../TreeIterators.h"
+
+/**
+ * Function that collects subtree nodes in the given order with an explicit stack, the reference for iterators
+ * @param root Pointer to subtree root
+ * @param order Traversal order
+ * @return Nodes in order
+ */
+
+static std::vector<node_t *> referenceOrder(node_t *root, TRAVERSAL_ORDER order) {
+    std::vector<node_t *> nodes;
+    std::vector<std::pair<node_t *, int>> stack = {{root, 0}};
+
+    while (!stack.empty()) {
+        node_t *node = stack.back().first;
+        int state = stack.back().second++;
+
+        if ((state == 0 && order == PREORDER) || (state == 1 && order == INORDER) ||
+            (state == 2 && order == POSTORDER))
+            nodes.push_back(node);
+
+        if (state == 0 && node->left)
+            stack.push_back({node->left, 0});
+        else if (state == 1 && node->right)
+            stack.push_back({node->right, 0});
+        else if (state == 2)
+            stack.pop_back();
+    }
+
+    return nodes;
+}
+
+/**
+ * Depth-first iterators visit nodes in the same order as the reference walk
+ */
+
+static void testOrders(tree_t *tree) {
+    std::vector<node_t *> visited;
+    for (node_t *node : preorder(tree))
+        visited.push_back(node);
+    CHECK(visited == referenceOrder(tree->head, PREORDER));
+
+    visited.clear();
+    for (node_t *node : inorder(tree))
+        visited.push_back(node);
+    CHECK(visited == referenceOrder(tree->head, INORDER));
+
+    visited.clear();
+    for (node_t *node : postorder(tree))
+        visited.push_back(node);
+    CHECK(visited == referenceOrder(tree->head, POSTORDER));
+}
+
+/**
+ * Postorder range-for loop may free the node it has just got
+ */
+
+static void testPostorderFree(tree_t *tree) {
+    size_t freed = 0;
+    for (node_t *node : postorder(tree->head)) {
+        countedFree(node);
+        freed++;
+    }
+
+    CHECK(freed == tree->size + 1);
+    countedFree(tree);
+}
+
+int main() {
+    const size_t sizes[] = {1, 2, 100, 5000};
+
+    for (size_t nodes : sizes) {
+        for (int chain = 0; chain < 2; chain++) {
+            tree_t *tree = makeRandomTree(nodes, 3 + nodes, false, chain == 1);
+            testOrders(tree);
+            testPostorderFree(tree);
+        }
+    }
+
+    return testResult("TestIterators");
+}
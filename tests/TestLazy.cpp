@@ -0,0 +1,233 @@
+//
+// Created by alexey on 17.10.2026.
+//
+
+#include "TreeTest.h"
+#include "../TreeIterators.h"
+#include "../TreeParallel.h"
+#include "../ManagedTree.h"
+#include <string>
+
+static const char LAZY_FILE[] = "TestLazy.txt";
+static const size_t SMALL_STUBS = 64;
+
+/**
+ * Function that counts visited values for parallelForEach
+ * @param value Visited value
+ * @param context Pointer to size_t counter
+ */
+
+static void countValue(void *value, void *context) {
+    (void) value;
+    __atomic_add_fetch((size_t *) context, 1, __ATOMIC_RELAXED);
+}
+
+/**
+ * Function that parses text lazily with small stubs
+ * @param text Pointer to serialized tree
+ * @param length Length of text
+ * @return Pointer to lazy tree
+ */
+
+static tree_t *parseLazy(const char *text, size_t length) {
+    tree_t *lazy = treeParseLazy(text, length, readIntView, nullptr, SMALL_STUBS);
+    CHECK(lazy);
+    return lazy;
+}
+
+/**
+ * Tree-level walkers work on a lazy tree that was never expanded and give the same result as on the eager one
+ */
+
+static void testWalkers(tree_t *tree) {
+    size_t length = 0;
+    char *text = serializeInts(tree, &length);
+    bool hasStubs = length > SMALL_STUBS;
+
+    // Text serializer
+    tree_t *lazy = parseLazy(text, length);
+    CHECK(!hasStubs || lazy->lazy);
+    size_t lazyLength = 0;
+    char *lazyText = serializeInts(lazy, &lazyLength);
+    CHECK(lazyLength == length && memcmp(lazyText, text, length) == 0);
+    CHECK(!lazy->lazy);
+    free(lazyText);
+    deleteTree(lazy);
+
+    // Parallel serializer
+    lazy = parseLazy(text, length);
+    outputSink_t *sink = makeMemorySink();
+    CHECK(treeSerializeParallel(lazy, sink, writeIntValue, 4));
+    const char *parallelText = sinkData(sink, &lazyLength);
+    CHECK(lazyLength == length && memcmp(parallelText, text, length) == 0);
+    deleteSink(sink);
+    deleteTree(lazy);
+
+    // Binary serializer
+    lazy = parseLazy(text, length);
+    sink = makeMemorySink();
+    CHECK(treeSerializeBinary(lazy, sink, writeIntValue));
+    const char *binary = sinkData(sink, &lazyLength);
+    tree_t *restored = treeDeserializeBinary(binary, lazyLength, readIntView);
+    CHECK(restored && sameTree(tree->head, restored->head));
+    if (restored)
+        deleteTree(restored);
+    deleteSink(sink);
+    deleteTree(lazy);
+
+    // Compact dump
+    sink = makeMemorySink();
+    CHECK(treeDumpCompact(tree, sink));
+    size_t dumpLength = 0;
+    const char *eagerDump = sinkData(sink, &dumpLength);
+    std::string dump(eagerDump, dumpLength);
+    deleteSink(sink);
+
+    lazy = parseLazy(text, length);
+    sink = makeMemorySink();
+    CHECK(treeDumpCompact(lazy, sink));
+    const char *lazyDump = sinkData(sink, &lazyLength);
+    CHECK(std::string(lazyDump, lazyLength) == dump);
+    deleteSink(sink);
+    deleteTree(lazy);
+
+    // Iterators
+    lazy = parseLazy(text, length);
+    size_t count = 0;
+    for (node_t *node : postorder(lazy)) {
+        (void) node;
+        count++;
+    }
+    CHECK(count == tree->size + 1);
+    deleteTree(lazy);
+
+    // Node walks without expanding the whole tree
+    lazy = parseLazy(text, length);
+    CHECK(nodeSubtreeSize(lazy->head) == tree->size + 1);
+    CHECK(nodeSubtreeHeight(lazy->head) == nodeSubtreeHeight(tree->head));
+    deleteTree(lazy);
+
+    // Parallel walk
+    lazy = parseLazy(text, length);
+    count = 0;
+    parallelForEach(lazy, countValue, &count, 4, 16);
+    CHECK(count == tree->size + 1);
+    deleteTree(lazy);
+
+    // Accessors expand on the way
+    lazy = parseLazy(text, length);
+    CHECK(sameTree(tree->head, lazy->head));
+    treeExpandAll(lazy);
+    CHECK(!lazy->lazy);
+    deleteTree(lazy);
+
+    free(text);
+}
+
+/**
+ * Function that copies value text into memory owned by the tree
+ * @param value Pointer to value text
+ * @param length Length of value text
+ * @return Pointer to null-terminated copy, freed with free
+ */
+
+static void *readOwnedView(const char *value, size_t length) {
+    auto *copy = (char *) malloc(length + 1);
+    memcpy(copy, value, length);
+    copy[length] = '\0';
+    return copy;
+}
+
+/**
+ * Owning wrapper destroys values of a lazy tree and changes it through node handles
+ */
+
+static void testManaged(tree_t *tree) {
+    size_t length = 0;
+    char *text = serializeInts(tree, &length);
+
+    {
+        ManagedTree managed(treeParseLazy(text, length, readOwnedView, nullptr, SMALL_STUBS), free);
+        CHECK(managed);
+    }
+
+    if (tree->head->left && tree->head->right) {
+        ManagedTree managed(treeParseLazy(text, length, readOwnedView, nullptr, SMALL_STUBS), free);
+        managed.head().right().remove();
+        managed.head().addLeft(readOwnedView("1", 1));
+        CHECK(managed.size() == 1);
+        CHECK(nodeSubtreeSize(managed.head().node()) == 2);
+    }
+
+    free(text);
+}
+
+/**
+ * Lazy loaders accept the same inputs as the eager parser, fail at the same offsets and restore the same tree
+ */
+
+static void testLoaders(tree_t *tree) {
+    size_t length = 0;
+    char *text = serializeInts(tree, &length);
+
+    std::string copy(text, length);
+    tree_t *lazy = treeDeserializeLazy(&copy[0], readIntString, SMALL_STUBS);
+    CHECK(lazy && sameTree(tree->head, lazy->head));
+    if (lazy)
+        deleteTree(lazy);
+
+    FILE *file = fopen(LAZY_FILE, "wb");
+    CHECK(file);
+    if (file) {
+        CHECK(fwrite(text, 1, length, file) == length);
+        fclose(file);
+    }
+    lazy = treeLoadLazy(LAZY_FILE, readIntView, nullptr, SMALL_STUBS);
+    CHECK(lazy);
+    if (lazy) {
+        size_t lazyLength = 0;
+        char *lazyText = serializeInts(lazy, &lazyLength);
+        CHECK(lazyLength == length && memcmp(lazyText, text, length) == 0);
+        free(lazyText);
+        deleteTree(lazy);
+    }
+
+    uint64_t seed = length;
+    for (int mutation = 0; mutation < 50; mutation++) {
+        std::string broken(text, length);
+        broken[testRandom(&seed) % length] = "{}$\" x"[testRandom(&seed) % 6];
+
+        size_t eagerOffset = 0;
+        size_t lazyOffset = 0;
+        tree_t *eager = treeParse(broken.data(), broken.size(), readIntView, &eagerOffset);
+        lazy = treeParseLazy(broken.data(), broken.size(), readIntView, &lazyOffset, SMALL_STUBS);
+        CHECK(!eager == !lazy);
+        if (!eager && !lazy)
+            CHECK(eagerOffset == lazyOffset);
+        if (eager && lazy)
+            CHECK(sameTree(eager->head, lazy->head));
+        if (eager)
+            deleteTree(eager);
+        if (lazy)
+            deleteTree(lazy);
+    }
+
+    free(text);
+}
+
+int main() {
+    const size_t sizes[] = {1, 2, 100, 5000, 60000};
+
+    for (size_t nodes : sizes) {
+        for (int chain = 0; chain < 2; chain++) {
+            tree_t *tree = makeRandomTree(nodes, 7 + nodes, chain == 0, chain == 1);
+            testWalkers(tree);
+            testLoaders(tree);
+            testManaged(tree);
+            deleteTree(tree);
+        }
+    }
+
+    remove(LAZY_FILE);
+    return testResult("TestLazy");
+}
@@ -0,0 +1,280 @@
+//
+// Created by alexey on 17.10.2026.
+//
+
+#include "TreeTest.h"
+#include "../FrozenTree.h"
+#include <string>
+
+static const char TEXT_FILE[] = "TestRoundTrip.txt";
+static const char BINARY_FILE[] = "TestRoundTrip.bin";
+
+/**
+ * Function that writes bytes to file
+ * @param filename Name of file
+ * @param data Pointer to bytes
+ * @param length Number of bytes
+ */
+
+static void writeFile(const char *filename, const char *data, size_t length) {
+    FILE *file = fopen(filename, "wb");
+    CHECK(file);
+    if (!file)
+        return;
+
+    CHECK(fwrite(data, 1, length, file) == length);
+    fclose(file);
+}
+
+/**
+ * Function that checks restored tree against the original and deletes it
+ * @param original Pointer to original tree
+ * @param restored Pointer to restored tree, may be nullptr
+ */
+
+static void checkRestored(tree_t *original, tree_t *restored) {
+    CHECK(restored);
+    if (!restored)
+        return;
+
+    CHECK(restored->size == original->size);
+    CHECK(sameTree(original->head, restored->head));
+    deleteTree(restored);
+}
+
+/**
+ * Text format: every parser and loader restores the tree, every writer produces the same text
+ */
+
+static void testText(tree_t *tree) {
+    size_t length = 0;
+    char *text = serializeInts(tree, &length);
+
+    checkRestored(tree, treeParse(text, length, INT_CODEC));
+    checkRestored(tree, treeParse(text, length, INT_CODEC, nullptr, true));
+    checkRestored(tree, treeParse(text, length, readIntView));
+    checkRestored(tree, treeParse(text, length, readIntString, nullptr, true));
+    checkRestored(tree, treeParseParallel(text, length, readIntView, nullptr, 4));
+
+    std::string copy(text, length);
+    checkRestored(tree, treeDeserialize(&copy[0], readIntString));
+    copy.assign(text, length);
+    checkRestored(tree, treeDeserializeParallel(&copy[0], readIntString, 4));
+
+    outputSink_t *sink = makeMemorySink();
+    CHECK(treeSerializeParallel(tree, sink, writeIntValue, 4));
+    size_t parallelLength = 0;
+    const char *parallelText = sinkData(sink, &parallelLength);
+    CHECK(parallelLength == length && memcmp(parallelText, text, length) == 0);
+    deleteSink(sink);
+
+    tree_t *restored = treeParse(text, length, INT_CODEC, nullptr, true);
+    size_t again = 0;
+    char *textAgain = serializeInts(restored, &again);
+    CHECK(again == length && memcmp(textAgain, text, length) == 0);
+    free(textAgain);
+    deleteTree(restored);
+
+    writeFile(TEXT_FILE, text, length);
+    checkRestored(tree, treeLoad(TEXT_FILE, readIntView));
+    checkRestored(tree, treeLoad(TEXT_FILE, INT_CODEC, nullptr, true));
+    checkRestored(tree, treeLoadParallel(TEXT_FILE, readIntView, nullptr, 4));
+
+    free(text);
+}
+
+/**
+ * Binary format: every reader restores the tree, converters agree with direct writers
+ */
+
+static void testBinary(tree_t *tree) {
+    outputSink_t *sink = makeMemorySink();
+    CHECK(treeSerializeBinary(tree, sink, writeIntValue));
+    size_t length = 0;
+    const char *binary = sinkData(sink, &length);
+
+    checkRestored(tree, treeDeserializeBinary(binary, length, readIntView));
+    checkRestored(tree, treeDeserializeBinary(binary, length, INT_CODEC, true));
+    checkRestored(tree, treeDeserializeBinaryParallel(binary, length, readIntView, 4));
+
+    writeFile(BINARY_FILE, binary, length);
+    checkRestored(tree, treeLoad(BINARY_FILE, readIntView));
+    checkRestored(tree, treeLoadParallel(BINARY_FILE, readIntView, nullptr, 4));
+
+    // Text -> binary -> text gives the text back
+    size_t textLength = 0;
+    char *text = serializeInts(tree, &textLength);
+    CHECK(serializedToBinary(text, textLength, (char *) BINARY_FILE));
+    mappedFile_t *file = mapFile(BINARY_FILE);
+    CHECK(file);
+    if (file) {
+        CHECK(binaryToSerialized(file->data, file->length, (char *) TEXT_FILE));
+        unmapFile(file);
+    }
+
+    file = mapFile(TEXT_FILE);
+    CHECK(file && file->length == textLength && memcmp(file->data, text, textLength) == 0);
+    if (file)
+        unmapFile(file);
+
+    free(text);
+    deleteSink(sink);
+}
+
+/**
+ * Bulk builder restores the tree from its preorder bitmap
+ */
+
+static void testPreorderBits(tree_t *tree) {
+    size_t bitCount = 0;
+    uint8_t *bits = treeToPreorderBits(tree, &bitCount);
+    CHECK(bitCount == 2 * (tree->size + 1) + 1);
+
+    std::vector<void *> values;
+    for (node_t *node = tree->head; node;) {
+        values.push_back(node->value);
+        if (node->left) {
+            node = node->left;
+        } else if (node->right) {
+            node = node->right;
+        } else {
+            while (node->parent && (node->parent->right == node || !node->parent->right))
+                node = node->parent;
+            node = node->parent ? node->parent->right : nullptr;
+        }
+    }
+
+    checkRestored(tree, treeFromPreorderBits(bits, bitCount, values.data(), values.size()));
+    free(bits);
+}
+
+/**
+ * Frozen tree in every layout thaws back into the tree and leaves the source as it was
+ */
+
+static void testFrozen(tree_t *tree) {
+    size_t length = 0;
+    char *text = serializeInts(tree, &length);
+
+    const FROZEN_LAYOUT layouts[] = {PREORDER_LAYOUT, LEVEL_LAYOUT, VEB_LAYOUT};
+    for (FROZEN_LAYOUT layout : layouts) {
+        frozenTree_t *frozen = freezeTree(tree, layout);
+        CHECK(frozen->count == tree->size + 1);
+        CHECK(frozen->nodes[0].value == tree->head->value);
+        checkRestored(tree, thawTree(frozen, layout == VEB_LAYOUT));
+        deleteFrozenTree(frozen);
+
+        size_t again = 0;
+        char *textAgain = serializeInts(tree, &again);
+        CHECK(again == length && memcmp(textAgain, text, length) == 0);
+        free(textAgain);
+    }
+
+    free(text);
+}
+
+/**
+ * Level-order builder with presence bitmap keeps values that are nullptr, intValue(0) among them
+ */
+
+static void testLevelOrder() {
+    void *values[] = {intValue(0), intValue(1), intValue(0), intValue(0), nullptr, intValue(5), intValue(0)};
+    const uint8_t present[] = {0x6f};
+
+    size_t errorOffset = 0;
+    tree_t *tree = treeFromLevelOrder(values, present, 7, &errorOffset);
+    CHECK(tree);
+    if (tree) {
+        node_t *head = tree->head;
+        CHECK(tree->size == 5);
+        CHECK(head->value == intValue(0));
+        CHECK(head->left->value == intValue(1) && head->right->value == intValue(0));
+        CHECK(head->left->left->value == intValue(0) && !head->left->right);
+        CHECK(head->right->left->value == intValue(5) && head->right->right->value == intValue(0));
+        deleteTree(tree);
+    }
+
+    // Without bitmap the zero head reads as a hole
+    CHECK(!treeFromLevelOrder(values, 7, &errorOffset) && errorOffset == 0);
+
+    const uint8_t orphan[] = {0x09};
+    CHECK(!treeFromLevelOrder(values, orphan, 7, &errorOffset) && errorOffset == 3);
+}
+
+/**
+ * Malformed text is rejected at the same offset by sequential and parallel parsers
+ */
+
+static void testErrorOffsets() {
+    struct {
+        const char *text;
+        size_t offset;
+    } cases[] = {
+            {"", 0},
+            {"   ", 3},
+            {"{ \"1\" ", 6},
+            {"{ \"1\" } x", 8},
+            {"{ \"1\" $ }", 8},
+            {"{ \"1\" { x } }", 8},
+            {"{ \"1\" { \"2\" } { \"3\" } { \"4\" } }", 22},
+            {"{ \"1\" { \"2", 10},
+            {"{ \"1\" { \"z\" } }", 9},
+    };
+
+    for (const auto &test : cases) {
+        size_t length = strlen(test.text);
+        size_t errorOffset = (size_t) -1;
+        CHECK(!treeParse(test.text, length, INT_CODEC, &errorOffset));
+        CHECK(errorOffset == test.offset);
+    }
+
+    // Mutated large input, so that the parallel parser splits it
+    tree_t *tree = makeRandomTree(20000, 7, true);
+    size_t length = 0;
+    char *text = serializeInts(tree, &length);
+    uint64_t seed = 2463534242ULL;
+    const char mutations[] = "{}$\" x";
+
+    for (int round = 0; round < 50; round++) {
+        std::string broken(text, length);
+        broken[testRandom(&seed) % length] = mutations[testRandom(&seed) % (sizeof(mutations) - 1)];
+
+        size_t sequentialOffset = 1;
+        size_t parallelOffset = 2;
+        tree_t *sequential = treeParse(broken.data(), broken.size(), readIntView, &sequentialOffset, true);
+        tree_t *parallel = treeParseParallel(broken.data(), broken.size(), readIntView, &parallelOffset, 4);
+
+        CHECK(!sequential == !parallel);
+        if (!sequential && !parallel)
+            CHECK(sequentialOffset == parallelOffset);
+        if (sequential)
+            deleteTree(sequential);
+        if (parallel)
+            deleteTree(parallel);
+    }
+
+    free(text);
+    deleteTree(tree);
+}
+
+int main() {
+    const size_t sizes[] = {1, 2, 100, 5000, 60000};
+
+    for (size_t nodes : sizes) {
+        for (int chain = 0; chain < 2; chain++) {
+            tree_t *tree = makeRandomTree(nodes, 1 + nodes, chain == 0, chain == 1);
+            testText(tree);
+            testBinary(tree);
+            testPreorderBits(tree);
+            testFrozen(tree);
+            deleteTree(tree);
+        }
+    }
+
+    testErrorOffsets();
+    testLevelOrder();
+
+    remove(TEXT_FILE);
+    remove(BINARY_FILE);
+    return testResult("TestRoundTrip");
+}
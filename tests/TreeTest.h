@@ -0,0 +1,158 @@
+//
+// Created by alexey on 17.10.2026.
+//
+
+#ifndef TREE_TREETEST_H
+#define TREE_TREETEST_H
+#include "../Tree.h"
+#include <vector>
+
+/*
+ * Minimal test helpers. Every test executable counts failed checks and returns non-zero if there were any, so CTest
+ * needs nothing but the exit code.
+ */
+
+static size_t testFailures = 0;
+
+#define CHECK(condition) \
+    do { \
+        if (!(condition)) { \
+            fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__, #condition); \
+            testFailures++; \
+        } \
+    } while (0)
+
+/**
+ * Function that reports test result
+ * @param name Test executable name
+ * @return Exit code
+ */
+
+inline int testResult(const char *name) {
+    if (testFailures)
+        fprintf(stderr, "%s: %zu checks failed\n", name, testFailures);
+    else
+        printf("%s: ok\n", name);
+
+    return testFailures ? 1 : 0;
+}
+
+/**
+ * Deterministic xorshift generator, so that failures reproduce
+ * @param state Pointer to generator state, must not be zero
+ * @return Next random number
+ */
+
+inline uint64_t testRandom(uint64_t *state) {
+    *state ^= *state << 13;
+    *state ^= *state >> 7;
+    *state ^= *state << 17;
+    return *state;
+}
+
+/**
+ * Function that builds random tree with INT_CODEC values 0, 1, 2... in creation order
+ * @param nodes Number of nodes
+ * @param seed Random seed
+ * @param pooled Whether nodes are taken from a node pool
+ * @param chain Whether every node is attached to the previous one, which makes a degenerate tree
+ * @return Pointer to tree_t
+ */
+
+inline tree_t *makeRandomTree(size_t nodes, uint64_t seed, bool pooled, bool chain = false) {
+    tree_t *tree = pooled ? makePooledTree(intValue(0)) : makeTree(intValue(0));
+    std::vector<node_t *> open = {tree->head};
+
+    for (size_t index = 1; index < nodes; index++) {
+        size_t pick = chain ? open.size() - 1 : testRandom(&seed) % open.size();
+        node_t *parent = open[pick];
+        bool left = !parent->left && (parent->right || testRandom(&seed) % 2);
+
+        if (left)
+            addLeftNode(tree, parent, intValue((int64_t) index));
+        else
+            addRightNode(tree, parent, intValue((int64_t) index));
+        open.push_back(left ? parent->left : parent->right);
+
+        // Full nodes leave the list of nodes with a free slot
+        if (parent->left && parent->right) {
+            open[pick] = open.back();
+            open.pop_back();
+        }
+    }
+
+    return tree;
+}
+
+/**
+ * Function that compares shape and values of two trees. Children are taken with getLeftNode and getRightNode, so
+ * lazy trees can be compared too
+ * @param first Pointer to subtree root
+ * @param second Pointer to subtree root
+ * @return true if subtrees are equal
+ */
+
+inline bool sameTree(node_t *first, node_t *second) {
+    std::vector<node_t *> pending = {first, second};
+
+    while (!pending.empty()) {
+        node_t *right = pending.back();
+        pending.pop_back();
+        node_t *left = pending.back();
+        pending.pop_back();
+
+        if (!left || !right) {
+            if (left != right)
+                return false;
+            continue;
+        }
+
+        if (left->value != right->value)
+            return false;
+
+        pending.push_back(getLeftNode(left));
+        pending.push_back(getLeftNode(right));
+        pending.push_back(getRightNode(left));
+        pending.push_back(getRightNode(right));
+    }
+
+    return true;
+}
+
+/**
+ * Value deserializer that reads decimal integer into INT_CODEC value
+ * @param value Pointer to value inside the input
+ * @param length Value length
+ * @return INT_CODEC value
+ */
+
+inline void *readIntView(const char *value, size_t length) {
+    int64_t number = 0;
+    bool negative = length && value[0] == '-';
+    for (size_t pos = negative; pos < length; pos++)
+        number = number * 10 + (value[pos] - '0');
+
+    return intValue(negative ? -number : number);
+}
+
+/**
+ * Value deserializer that reads null-terminated decimal integer into INT_CODEC value
+ * @param value Null-terminated value
+ * @return INT_CODEC value
+ */
+
+inline void *readIntString(char *value) {
+    return readIntView(value, strlen(value));
+}
+
+/**
+ * Function that serializes tree with INT_CODEC values into memory
+ * @param tree Pointer to tree_t
+ * @param length Pointer to store text length
+ * @return Pointer to text, should be freed by caller
+ */
+
+inline char *serializeInts(tree_t *tree, size_t *length) {
+    return treeSerializeToMemory(tree, writeIntValue, length);
+}
+#endif //TREE_TREETEST_H